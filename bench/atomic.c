@@ -0,0 +1,88 @@
+// Measures the collection pauses of a HEAP of small objects with pointers, each
+// referencing a short atomic object (e.g. a string), allocated in turn so they
+// would share blocks (and cache lines) unless atomic objects are segregated.
+//
+//     $ make bench
+//     $ GC_PRINT_STATS=1 ./build/bench-atomic
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "immix.h"
+
+#define NODE_COUNT (1000 * 1000)
+#define COLLECTIONS 10
+#define MIN_SIZE 16
+#define MAX_SIZE 176
+
+typedef struct Node {
+    struct Node *next;
+    char *string;
+} Node;
+
+static Node *head;
+static uint64_t collections;
+static uint64_t total_pause;
+static uint64_t max_pause;
+
+static inline uint64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+void GC_collect() {
+    uint64_t start = now();
+    GC_collect_once();
+    uint64_t pause = now() - start;
+
+    collections++;
+    total_pause += pause;
+    if (pause > max_pause) max_pause = pause;
+}
+
+static unsigned long state = 88172645463325252UL;
+
+static inline unsigned long next_random() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+int main() {
+    GC_init();
+
+    for (size_t i = 0; i < NODE_COUNT; i++) {
+        size_t size = MIN_SIZE + next_random() % (MAX_SIZE - MIN_SIZE);
+        char *string = GC_malloc_atomic(size);
+        memset(string, 'x', size);
+
+        Node *node = GC_malloc(sizeof(Node));
+        node->string = string;
+        node->next = head;
+        head = node;
+    }
+
+    // only measure the collections of the full HEAP
+    collections = 0;
+    total_pause = 0;
+    max_pause = 0;
+
+    for (size_t i = 0; i < COLLECTIONS; i++) {
+        GC_collect();
+    }
+
+    printf("heap=%zuMB collections=%lu\n",
+            GC_get_memory_use() / 1024 / 1024,
+            (unsigned long)collections);
+    printf("pauses: average=%luus max=%luus\n",
+            (unsigned long)(total_pause / collections / 1000),
+            (unsigned long)(max_pause / 1000));
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+// Fragments the small object space then measures how much of it is reclaimed:
+// allocates many small objects, drops most of them in a pattern that leaves a
+// few live objects in every block, then keeps allocating short-lived objects
+// of another size that don't fit the holes well.
+//
+// Compare with and without opportunistic evacuation with:
+//
+//     $ make bench
+//     $ GC_EVACUATE=1 GC_PRINT_STATS=1 ./build/bench-fragmentation
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "immix.h"
+
+#define OBJECT_COUNT (512 * 1024)
+#define KEEP_EVERY 16
+#define ITERATIONS (4 * 1000 * 1000)
+#define SCRATCH_SIZE 1024
+
+typedef struct Node {
+    struct Node *next;
+    size_t value;
+    char payload[];
+} Node;
+
+// live objects are only referenced from the HEAP (the arrays themselves are
+// large objects), not from the stack or the DATA and BSS sections, so they can
+// be evacuated
+static Node **objects;
+static Node **scratch;
+
+void GC_collect() {
+    GC_collect_once();
+}
+
+static inline uint64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static unsigned long state = 88172645463325252UL;
+
+static inline unsigned long next_random() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static void report(const char *phase) {
+    printf("%s: heap=%zuKB usage=%zuKB\n",
+            phase,
+            GC_get_memory_use() / 1024,
+            GC_get_heap_usage() / 1024);
+}
+
+int main() {
+    GC_init();
+
+    objects = GC_malloc(sizeof(Node *) * OBJECT_COUNT);
+
+    for (size_t i = 0; i < OBJECT_COUNT; i++) {
+        objects[i] = GC_malloc(sizeof(Node) + 32 + next_random() % 64);
+        objects[i]->value = i;
+    }
+    GC_write_barrier(objects);
+    report("allocated");
+
+    // keep 1 object out of N: every block keeps a few live lines
+    for (size_t i = 0; i < OBJECT_COUNT; i++) {
+        if (i % KEEP_EVERY != 0) objects[i] = NULL;
+    }
+    GC_write_barrier(objects);
+    GC_collect_once();
+    report("fragmented");
+
+    scratch = GC_malloc(sizeof(Node *) * SCRATCH_SIZE);
+    uint64_t start = now();
+
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        Node *node = GC_malloc(sizeof(Node) + 256 + next_random() % 1024);
+        node->value = i;
+        scratch[i % SCRATCH_SIZE] = node;
+        GC_write_barrier(scratch);
+    }
+
+    uint64_t elapsed = now() - start;
+
+    for (size_t i = 0; i < OBJECT_COUNT; i += KEEP_EVERY) {
+        if (objects[i]->value != i) {
+            fprintf(stderr, "corrupted object %zu\n", i);
+            return 1;
+        }
+    }
+
+    GC_collect_once();
+    report("collected");
+    printf("elapsed=%.0fms\n", (double)elapsed / 1e6);
+
+    return 0;
+}
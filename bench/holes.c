@@ -0,0 +1,81 @@
+// Measures the allocation throughput of a mix of object sizes (70% smaller than
+// 200 bytes, 20% up to 2KB, the rest up to 8KB) for a program replacing random
+// objects of a long-lived set, so collections leave blocks with holes of many
+// sizes for allocators to recycle.
+//
+//     $ make bench
+//     $ GC_PRINT_STATS=1 ./build/bench-holes
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "immix.h"
+
+#define LIVE_COUNT (64 * 1024)
+#define ITERATIONS (4 * 1000 * 1000)
+
+static void **live;
+static uint64_t collections;
+
+static inline uint64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+void GC_collect() {
+    GC_collect_once();
+    collections++;
+}
+
+static unsigned long state = 88172645463325252UL;
+
+static inline unsigned long next_random() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static inline size_t next_size() {
+    unsigned long n = next_random() % 10;
+    if (n < 7) return 16 + next_random() % (200 - 16);
+    if (n < 9) return 200 + next_random() % (2048 - 200);
+    return 2048 + next_random() % (8192 - 2048);
+}
+
+int main() {
+    GC_init();
+
+    live = GC_malloc(sizeof(void *) * LIVE_COUNT);
+    memset(live, 0, sizeof(void *) * LIVE_COUNT);
+
+    uint64_t start = now();
+    size_t allocated = 0;
+
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        size_t size = next_size();
+        void *object = GC_malloc_atomic(size);
+        allocated += size;
+
+        // keep an object now and then
+        if (i % 4 == 0) {
+            live[next_random() % LIVE_COUNT] = object;
+            GC_write_barrier(live);
+        }
+    }
+
+    uint64_t elapsed = now() - start;
+
+    printf("elapsed=%.0fms allocated=%zuMB heap=%zuMB collections=%lu\n",
+            (double)elapsed / 1e6,
+            allocated / 1024 / 1024,
+            GC_get_memory_use() / 1024 / 1024,
+            (unsigned long)collections);
+
+    return 0;
+}
@@ -0,0 +1,95 @@
+// Measures the collection pauses of a program keeping a few long-lived large
+// objects while allocating many short-lived large objects, so each collection
+// frees and merges many chunks.
+//
+// Compare sweeping the large object space during the collection, or on the
+// background thread with:
+//
+//     $ make bench
+//     $ GC_INITIAL_HEAP_SIZE=64m GC_CONCURRENT_SWEEP=0 GC_PRINT_STATS=1 ./build/bench-large
+//
+// The background thread can only shorten the pauses when a CPU is available
+// to run it. On a single CPU it takes the CPU from the program, and both
+// modes average 300-400us pauses, within the run-to-run noise.
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "immix.h"
+
+#define LIVE_COUNT 16
+#define ITERATIONS (50 * 1000)
+#define MIN_SIZE (256 * 1024)
+#define MAX_SIZE (512 * 1024)
+
+static void **live;
+static uint64_t collections;
+static uint64_t total_pause;
+static uint64_t max_pause;
+
+static inline uint64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+void GC_collect() {
+    uint64_t start = now();
+    GC_collect_once();
+    uint64_t pause = now() - start;
+
+    collections++;
+    total_pause += pause;
+    if (pause > max_pause) max_pause = pause;
+}
+
+static unsigned long state = 88172645463325252UL;
+
+static inline unsigned long next_random() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static inline void *allocate() {
+    return GC_malloc_atomic(MIN_SIZE + next_random() % (MAX_SIZE - MIN_SIZE));
+}
+
+int main() {
+    GC_init();
+
+    live = GC_malloc(sizeof(void *) * LIVE_COUNT);
+
+    for (size_t i = 0; i < LIVE_COUNT; i++) {
+        live[i] = allocate();
+    }
+    GC_write_barrier(live);
+
+    uint64_t start = now();
+
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        void *object = allocate();
+
+        // replace a long-lived object now and then
+        if (i % 8 == 0) {
+            live[next_random() % LIVE_COUNT] = object;
+            GC_write_barrier(live);
+        }
+    }
+
+    uint64_t elapsed = now() - start;
+
+    printf("elapsed=%.0fms heap=%zuMB collections=%lu\n",
+            (double)elapsed / 1e6,
+            GC_get_memory_use() / 1024 / 1024,
+            (unsigned long)collections);
+    printf("pauses: average=%luus max=%luus\n",
+            (unsigned long)(collections == 0 ? 0 : total_pause / collections / 1000),
+            (unsigned long)(max_pause / 1000));
+
+    return 0;
+}
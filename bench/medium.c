@@ -0,0 +1,72 @@
+// Measures the allocation throughput of medium objects (8KB to 64KB buffers,
+// e.g. IO buffers or growing arrays) for a program keeping a few hundred of
+// them alive while allocating many short-lived ones.
+//
+//     $ make bench
+//     $ GC_PRINT_STATS=1 ./build/bench-medium
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "immix.h"
+
+#define LIVE_COUNT 256
+#define ITERATIONS (200 * 1000)
+#define MIN_SIZE (8 * 1024)
+#define MAX_SIZE (64 * 1024)
+
+static void **live;
+static uint64_t collections;
+
+void GC_collect() {
+    GC_collect_once();
+    collections++;
+}
+
+static inline uint64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static unsigned long state = 88172645463325252UL;
+
+static inline unsigned long next_random() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+int main() {
+    GC_init();
+
+    live = GC_malloc(sizeof(void *) * LIVE_COUNT);
+    uint64_t start = now();
+
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        size_t size = MIN_SIZE + next_random() % (MAX_SIZE - MIN_SIZE);
+        void *buffer = (i % 2) ? GC_malloc_atomic(size) : GC_malloc(size);
+
+        // touch the buffer, like a program filling an IO buffer would
+        memset(buffer, 0, 64);
+
+        if (i % 4 == 0) {
+            live[next_random() % LIVE_COUNT] = buffer;
+            GC_write_barrier(live);
+        }
+    }
+
+    uint64_t elapsed = now() - start;
+
+    printf("elapsed=%.0fms heap=%zuMB collections=%lu\n",
+            (double)elapsed / 1e6,
+            GC_get_memory_use() / 1024 / 1024,
+            (unsigned long)collections);
+
+    return 0;
+}
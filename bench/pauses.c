@@ -0,0 +1,115 @@
+// Measures the mutator throughput and the distribution of pauses (the latency
+// of individual allocations) for a program keeping a large long-lived HEAP
+// while allocating many short-lived objects.
+//
+// Compare the stop-the-world, incremental and concurrent modes with:
+//
+//     $ make bench
+//     $ GC_CONCURRENT=1 ./build/bench-pauses
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "immix.h"
+
+#define CACHE_SIZE (256 * 1024)
+#define ITERATIONS (4 * 1000 * 1000)
+#define BUCKETS 32
+
+typedef struct Node {
+    struct Node *next;
+    size_t value;
+    char payload[];
+} Node;
+
+static Node **cache;
+static uint64_t histogram[BUCKETS];
+static uint64_t max_latency;
+
+void GC_collect() {
+    GC_collect_once();
+}
+
+static inline uint64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static unsigned long state = 88172645463325252UL;
+
+static inline unsigned long next_random() {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static inline Node *allocate(size_t size) {
+    uint64_t start = now();
+    Node *node = GC_malloc(sizeof(Node) + size);
+    uint64_t latency = now() - start;
+
+    // log2 buckets of microseconds
+    int bucket = 0;
+    for (uint64_t us = latency / 1000; us > 0 && bucket < BUCKETS - 1; us >>= 1) bucket++;
+    histogram[bucket]++;
+    if (latency > max_latency) max_latency = latency;
+
+    return node;
+}
+
+static uint64_t percentile(uint64_t total, double ratio) {
+    uint64_t count = 0;
+    for (int bucket = 0; bucket < BUCKETS; bucket++) {
+        count += histogram[bucket];
+        if (count >= total * ratio) return bucket == 0 ? 1 : (uint64_t)1 << bucket;
+    }
+    return (uint64_t)1 << (BUCKETS - 1);
+}
+
+int main() {
+    GC_init();
+
+    cache = GC_malloc(sizeof(Node *) * CACHE_SIZE);
+
+    for (size_t i = 0; i < CACHE_SIZE; i++) {
+        cache[i] = allocate(next_random() % 128);
+        cache[i]->next = NULL;
+        cache[i]->value = i;
+    }
+    GC_write_barrier(cache);
+
+    uint64_t start = now();
+
+    for (size_t i = 0; i < ITERATIONS; i++) {
+        // short-lived objects
+        Node *node = allocate(next_random() % 256);
+        node->value = i;
+
+        // replace a long-lived object now and then
+        if (i % 16 == 0) {
+            size_t index = next_random() % CACHE_SIZE;
+            node->next = cache[index]->next;
+            cache[index] = node;
+            GC_write_barrier(cache);
+        }
+    }
+
+    uint64_t elapsed = now() - start;
+
+    printf("throughput=%.0f allocations/s elapsed=%.0fms heap=%zuMB\n",
+            (double)ITERATIONS / ((double)elapsed / 1e9),
+            (double)elapsed / 1e6,
+            GC_get_memory_use() / 1024 / 1024);
+    printf("pauses: p99=<%luus p99.9=<%luus p99.99=<%luus max=%luus\n",
+            (unsigned long)percentile(ITERATIONS + CACHE_SIZE, 0.99),
+            (unsigned long)percentile(ITERATIONS + CACHE_SIZE, 0.999),
+            (unsigned long)percentile(ITERATIONS + CACHE_SIZE, 0.9999),
+            (unsigned long)(max_latency / 1000));
+
+    return 0;
+}
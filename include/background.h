@@ -0,0 +1,41 @@
+#ifndef GC_BACKGROUND_H
+#define GC_BACKGROUND_H
+
+#include <pthread.h>
+
+typedef void (*background_task_t)(void *data);
+
+// A GC thread running a task in the background, while the program keeps
+// running. Running a task returns immediately. The task must regularly check
+// Background_isStopping and return as soon as it's true. The thread is started
+// on the first run.
+typedef struct GC_Background {
+    int started;
+    pthread_t thread;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    background_task_t task;
+    void *data;
+    int running;
+    int stopping;
+} Background;
+
+void GC_Background_init(Background *self);
+void GC_Background_run(Background *self, background_task_t task, void *data);
+void GC_Background_stop(Background *self);
+
+static inline int Background_isRunning(Background *self) {
+    return __atomic_load_n(&self->running, __ATOMIC_ACQUIRE);
+}
+
+static inline int Background_isStopping(Background *self) {
+    return __atomic_load_n(&self->stopping, __ATOMIC_ACQUIRE);
+}
+
+#define Background_init GC_Background_init
+#define Background_run GC_Background_run
+#define Background_stop GC_Background_stop
+
+#endif
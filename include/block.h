@@ -11,28 +11,100 @@
 #include "line_header.h"
 #include "utils.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define INVALID_LINE_INDEX -1
 
+// Line bitmaps (e.g. blacklisted lines) have one bit per line.
+#define LINE_WORDS ((LINE_COUNT + 63) / 64)
+
 enum BlockFlag {
     BLOCK_FLAG_FREE = 0x0,
     BLOCK_FLAG_RECYCLABLE = 0x1,
     BLOCK_FLAG_UNAVAILABLE = 0x2
 };
 
+struct GC_Nursery;
+
 typedef struct GC_Block {
     uint8_t marked;
     uint8_t flag;
+    uint8_t dirty;
+    uint8_t evacuate;
+    uint8_t atomic;
     int16_t first_free_line_index;
+    int16_t live_lines;
+    int16_t largest_hole;
     struct GC_Block *next;
-    char line_headers[LINE_COUNT];
+    struct GC_Nursery *owner;
+    uint64_t blacklist[LINE_WORDS];
+
+    // recyclable blocks: the free lines to allocate into (see
+    // Block_nextHole); the lines themselves aren't touched until allocated
+    uint64_t holes[LINE_WORDS];
+
+    // padded to a multiple of 16 headers (see Block_sweepLineHeaders)
+    char line_headers[LINE_WORDS * 64];
 } Block;
 
 static inline void Block_init(Block *self) {
     memset((char *)self, 0, sizeof(Block));
 }
 
+// The first blocks of a region hold the metadata of the region's blocks
+// (including their own, unused, metadata).
+#define REGION_METADATA_BLOCKS ((REGION_BLOCKS * sizeof(Block) + BLOCK_SIZE - 1) / BLOCK_SIZE)
+
+GC_STATIC_ASSERT(IS_POWER_OF_TWO(BLOCK_SIZE), block_size_is_a_power_of_two);
+GC_STATIC_ASSERT(IS_POWER_OF_TWO(LINE_SIZE), line_size_is_a_power_of_two);
+GC_STATIC_ASSERT(LINE_SIZE < BLOCK_SIZE, blocks_have_many_lines);
+GC_STATIC_ASSERT(LINE_SIZE >= 2 * WORD_SIZE, lines_fit_an_object);
+
+// line indexes (and counts) are int16_t in the block metadata
+GC_STATIC_ASSERT(LINE_COUNT <= INT16_MAX, line_count_fits_int16);
+
+// small objects fit a free block
+GC_STATIC_ASSERT(LARGE_OBJECT_SIZE <= BLOCK_SIZE, small_objects_fit_a_block);
+GC_STATIC_ASSERT(LARGE_OBJECT_SIZE % WORD_SIZE == 0, large_object_size_is_word_aligned);
+
+// Block_from masks addresses with the region size, and the metadata leave
+// blocks to allocate into
+GC_STATIC_ASSERT(IS_POWER_OF_TWO(REGION_BLOCKS), region_blocks_is_a_power_of_two);
+GC_STATIC_ASSERT(REGION_METADATA_BLOCKS < REGION_BLOCKS, region_metadata_leave_blocks);
+GC_STATIC_ASSERT(GC_INITIAL_HEAP_SIZE >= (REGION_METADATA_BLOCKS + 2) * BLOCK_SIZE, initial_heap_has_blocks);
+
 static inline Block *Block_from(void *pointer) {
-    return (Block *)((uintptr_t)pointer & BLOCK_SIZE_IN_BYTES_INVERSE_MASK);
+    uintptr_t region = (uintptr_t)pointer & ~(REGION_SIZE - 1);
+    return (Block *)region + ((uintptr_t)pointer - region) / BLOCK_SIZE;
+}
+
+// Returns the block number in the region.
+static inline size_t Block_index(Block *self) {
+    return (size_t)(((uintptr_t)self & (REGION_SIZE - 1)) / sizeof(Block));
+}
+
+// The block holds region metadata: it doesn't contain any object.
+static inline int Block_isMetadata(Block *self) {
+    return Block_index(self) < REGION_METADATA_BLOCKS;
+}
+
+// Returns the first block at or after the address, skipping the region
+// metadata. Iterates the blocks in [start, stop), in address order:
+//
+//     for (Block *block = Block_first(start); block < Block_from(stop); block = Block_next(block))
+static inline Block *Block_first(void *address) {
+    Block *block = Block_from(address);
+    if (Block_isMetadata(block)) return block - Block_index(block) + REGION_METADATA_BLOCKS;
+    return block;
+}
+
+// Returns the next block (in the next region after the last block of a
+// region).
+static inline Block *Block_next(Block *self) {
+    if (Block_index(self) < REGION_BLOCKS - 1) return self + 1;
+    return Block_first((char *)self - Block_index(self) * sizeof(Block) + REGION_SIZE);
 }
 
 static inline void Block_setFlag(Block *self, enum BlockFlag flag) {
@@ -65,8 +137,12 @@ static inline void Block_setUnavailable(Block *self) {
 }
 
 
+// Parallel markers (and allocators, while marking) mark blocks concurrently.
 static inline void Block_mark(Block *self) {
-    self->marked = 1;
+    // avoid contention when many objects of the block are marked
+    if (!__atomic_load_n(&self->marked, __ATOMIC_RELAXED)) {
+        __atomic_fetch_or(&self->marked, 1, __ATOMIC_RELAXED);
+    }
 }
 
 static inline void Block_unmark(Block *self) {
@@ -76,16 +152,86 @@ static inline void Block_unmark(Block *self) {
 static inline int Block_isMarked(Block *self) {
     return self->marked == 1;
 }
+// The block contains dirty objects (see Object_setDirty).
+static inline void Block_setDirty(Block *self) {
+    self->dirty = 1;
+}
+
+static inline int Block_isDirty(Block *self) {
+    return self->dirty;
+}
+
+static inline void Block_clearDirty(Block *self) {
+    self->dirty = 0;
+}
+
+// Evacuation: the block is fragmented, the collection will try to move its
+// objects into free blocks (see Collector_evacuate).
+static inline void Block_setEvacuate(Block *self) {
+    self->evacuate = 1;
+}
+
+static inline int Block_isEvacuating(Block *self) {
+    return self->evacuate;
+}
+
+static inline void Block_clearEvacuate(Block *self) {
+    self->evacuate = 0;
+}
+
+// The block only contains atomic objects (see LocalAllocator_initCursor): the
+// collector doesn't have to search it for pointers.
+static inline void Block_setAtomic(Block *self) {
+    self->atomic = 1;
+}
+
+static inline int Block_isAtomic(Block *self) {
+    return self->atomic;
+}
+
+static inline void Block_clearAtomic(Block *self) {
+    self->atomic = 0;
+}
+
+// Blacklisting: lines that false pointers point into (i.e. free lines) are
+// recorded during marking, so we avoid allocating into them until the next
+// collection, otherwise the new objects would be retained.
+static inline void Block_blacklistLine(Block *self, int line_index) {
+    assert(line_index >= 0);
+    assert(line_index < LINE_COUNT);
+    uint64_t *word = self->blacklist + line_index / 64;
+    uint64_t bit = (uint64_t)1 << (line_index % 64);
+
+    // avoid contention when many pointers fall into the same line
+    if (!(__atomic_load_n(word, __ATOMIC_RELAXED) & bit)) {
+        __atomic_fetch_or(word, bit, __ATOMIC_RELAXED);
+    }
+}
+
+static inline int Block_isLineBlacklisted(Block *self, int line_index) {
+    return (self->blacklist[line_index / 64] >> (line_index % 64)) & 1;
+}
+
+static inline int Block_hasBlacklistedLines(Block *self) {
+    for (size_t i = 0; i < sizeof(self->blacklist) / sizeof(uint64_t); i++) {
+        if (self->blacklist[i]) return 1;
+    }
+    return 0;
+}
 
+static inline void Block_clearBlacklist(Block *self) {
+    memset(self->blacklist, 0, sizeof(self->blacklist));
+}
 
-// Returns a pointer to the first line in the block (after metadata).
+// Returns a pointer to the first line in the block.
 static inline char *Block_start(Block *self) {
-    return (char *)self + LINE_SIZE;
+    size_t index = Block_index(self);
+    return (char *)(self - index) + index * BLOCK_SIZE;
 }
 
 // Returns a pointer to the block limit.
 static inline char *Block_stop(Block *self) {
-    return (char *)self + BLOCK_SIZE;
+    return Block_start(self) + BLOCK_SIZE;
 }
 
 // Returns whether a pointer points into the allocatable lines of a block.
@@ -112,12 +258,14 @@ static inline char *Block_lineHeader(Block *self, int line_index) {
     return self->line_headers + line_index;
 }
 
-// Returns the line index that a pointer into the block points to.
+// Returns the line index that a pointer into the block points to, or
+// INVALID_LINE_INDEX when it points before the block or into region metadata.
 static inline int Block_lineIndex(Block *self, void *pointer) {
-    //assert((char *)pointer >= Block_start(self));
-    assert((char *)pointer <= Block_stop(self));
+    if (Block_isMetadata(self)) return INVALID_LINE_INDEX;
 
     intptr_t diff = (char *)pointer - Block_start(self);
+    assert(diff <= (intptr_t)BLOCK_SIZE);
+
     if (diff < 0) return INVALID_LINE_INDEX;
     return (int)(diff / LINE_SIZE);
 }
@@ -129,6 +277,277 @@ static inline char *Block_line(Block *self, int line_index) {
     return Block_start(self) + (line_index * LINE_SIZE);
 }
 
+// Returns the object starting exactly at the given address, or NULL if no object
+// starts there. Only walks the objects of a single line, which is much faster
+// than resolving an interior pointer.
+static inline Object *Block_findObject(Block *self, char *address) {
+    int line_index = Block_lineIndex(self, address);
+    if (line_index == INVALID_LINE_INDEX) return NULL;
+
+    char *line_header = Block_lineHeader(self, line_index);
+    if (!LineHeader_containsObject(line_header)) return NULL;
+
+    char *cursor = Block_line(self, line_index) + LineHeader_getOffset(line_header);
+
+    while (cursor < address) {
+        size_t size = Object_loadSize((Object *)cursor);
+        if (size == 0) return NULL;
+        cursor += size;
+    }
+
+    if (cursor == address && Object_loadSize((Object *)cursor) != 0) {
+        return (Object *)cursor;
+    }
+    return NULL;
+}
+
+// Returns the end of the last object starting in the line, or NULL if no object
+// starts in the line.
+static inline char *Block_lineObjectsStop(Block *self, int line_index) {
+    char *line_header = Block_lineHeader(self, line_index);
+    if (!LineHeader_containsObject(line_header)) return NULL;
+
+    char *line = Block_line(self, line_index);
+    int offset = LineHeader_getOffset(line_header);
+
+    while (offset < LINE_SIZE) {
+        size_t size = ((Object *)(line + offset))->size;
+        if (size == 0) break;
+        offset += size;
+    }
+    return line + offset;
+}
+
+// Returns the object that the address points into, or NULL if the address
+// doesn't point into an object (e.g. a free line). Searches previous lines when
+// the object starts before the line.
+static inline Object *Block_findObjectContaining(Block *self, char *address) {
+    int line_index = Block_lineIndex(self, address);
+    if (line_index == INVALID_LINE_INDEX) return NULL;
+
+    for (; line_index >= 0; line_index--) {
+        char *line_header = Block_lineHeader(self, line_index);
+        if (!LineHeader_containsObject(line_header)) continue;
+
+        char *line = Block_line(self, line_index);
+        char *cursor = line + LineHeader_getOffset(line_header);
+
+        // first object in line is *after* the address: search previous lines
+        if (cursor > address) continue;
+
+        while (cursor <= address && cursor < line + LINE_SIZE) {
+            Object *object = (Object *)cursor;
+            size_t size = Object_loadSize(object);
+            if (size == 0) return NULL;
+            if (Object_contains(object, address)) return object;
+            cursor += size;
+        }
+        return NULL;
+    }
+    return NULL;
+}
+
+// Marks the lines of a (marked) object. Exact line marking marks all the lines
+// that the object touches, so sweeping doesn't have to skip a free line after
+// marked lines (see Block_sweepLines).
+static inline void Block_markObjectLines(Block *self, Object *object, int exact) {
+    int line_index = Block_lineIndex(self, object);
+    char *line_header = Block_lineHeader(self, line_index);
+
+    // conservative marking (immix page 5): small objects (smaller than
+    // LINE_SIZE) are more common than medium objects (larger than LINE_SIZE)
+    // and we can speed up marking by only marking the starting line.
+    if (object->size <= LINE_SIZE && !exact) {
+        // small object: only mark the starting line
+        LineHeader_mark(line_header);
+    } else {
+        // medium object (or exact line marking): mark all lines exactly
+        char *line = Block_line(self, line_index);
+        char *limit = (char *)object + object->size;
+        do {
+            LineHeader_mark(line_header);
+            line += LINE_SIZE;
+            line_header++;
+        } while (line < limit);
+    }
+}
+
+// Line statistics of swept blocks (see Block_sweepLines).
+typedef struct GC_LineStats {
+    size_t recyclable_blocks;
+    size_t holes;
+    size_t hole_lines;
+    size_t blacklisted_lines;
+
+    // conservative marking: free lines that aren't part of a hole (skipped
+    // after a marked line); exact line marking: free lines recovered in holes
+    // that conservative marking would have skipped
+    size_t skipped_lines;
+} LineStats;
+
+static inline void LineStats_clear(LineStats *self) {
+    memset(self, 0, sizeof(LineStats));
+}
+
+static inline void LineStats_add(LineStats *self, LineStats *other) {
+    self->recyclable_blocks += other->recyclable_blocks;
+    self->holes += other->holes;
+    self->hole_lines += other->hole_lines;
+    self->blacklisted_lines += other->blacklisted_lines;
+    self->skipped_lines += other->skipped_lines;
+}
+
+// Returns the mask of the actual lines in a word of a line bitmap.
+static inline uint64_t Lines_mask(int word) {
+    int count = LINE_COUNT - word * 64;
+    return count >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << count) - 1;
+}
+
+// Returns the index of the first line, from the given line on, whose bit is
+// set (or unset) in a line bitmap, or LINE_COUNT if there is none.
+static inline int Lines_find(uint64_t *lines, int line_index, int set) {
+    for (int word = line_index / 64; word < LINE_WORDS; word++) {
+        uint64_t bits = set ? lines[word] : ~lines[word];
+        if (word == line_index / 64) bits &= ~(uint64_t)0 << (line_index % 64);
+
+        if (bits != 0) {
+            int index = word * 64 + __builtin_ctzll(bits);
+            return index < LINE_COUNT ? index : LINE_COUNT;
+        }
+    }
+    return LINE_COUNT;
+}
+
+// Clears the headers of the lines that aren't marked, and fills the bitmap of
+// the marked lines. Compares 16 line headers at once with SSE2.
+static inline void Block_sweepLineHeaders(Block *self, uint64_t *marked) {
+    char *line_headers = self->line_headers;
+
+    for (int word = 0; word < LINE_WORDS; word++) {
+        uint64_t bits = 0;
+
+#if defined(__SSE2__)
+        const __m128i flag = _mm_set1_epi8(LINE_MARKED);
+
+        for (int i = 0; i < 4; i++) {
+            __m128i *headers = (__m128i *)(line_headers + word * 64 + i * 16);
+            __m128i value = _mm_loadu_si128(headers);
+            __m128i mask = _mm_cmpeq_epi8(_mm_and_si128(value, flag), flag);
+
+            _mm_storeu_si128(headers, _mm_and_si128(value, mask));
+            bits |= (uint64_t)(uint16_t)_mm_movemask_epi8(mask) << (i * 16);
+        }
+#else
+        for (int i = 0; i < 64; i++) {
+            char *line_header = line_headers + word * 64 + i;
+
+            if (LineHeader_isMarked(line_header)) {
+                bits |= (uint64_t)1 << i;
+            } else {
+                LineHeader_clear(line_header);
+            }
+        }
+#endif
+
+        marked[word] = bits;
+    }
+}
+
+// Recyclable blocks: finds the first hole from the given line on. Sets the
+// hole's start and limit, and returns the line index to search the next hole
+// from, or INVALID_LINE_INDEX if there are no more holes.
+//
+// Exact line marking: the last object of the previous line may be a dead
+// object that spans into the hole; the hole starts after it, so collecting
+// doesn't unmark (or mark) that object over new objects.
+static inline int Block_nextHole(Block *self, int line_index, char **start, char **limit) {
+    while (1) {
+        line_index = Lines_find(self->holes, line_index, 1);
+        if (line_index == LINE_COUNT) return INVALID_LINE_INDEX;
+
+        int limit_index = Lines_find(self->holes, line_index, 0);
+        *start = Block_line(self, line_index);
+        *limit = limit_index == LINE_COUNT ? Block_stop(self) : Block_line(self, limit_index);
+
+        if (line_index > 0) {
+            char *stop = Block_lineObjectsStop(self, line_index - 1);
+            if (stop > *start) *start = stop;
+        }
+        if (*start < *limit) return limit_index;
+
+        // the dead object spans the whole hole
+        if (limit_index == LINE_COUNT) return INVALID_LINE_INDEX;
+        line_index = limit_index;
+    }
+}
+
+// Sweeps the lines of a marked block: clears the free lines, then determines
+// and records the holes in the block metadata. Also counts the live (marked)
+// lines, and accumulates line statistics. Returns the index of the first free
+// line, or INVALID_LINE_INDEX if the block has no free line.
+static inline int Block_sweepLines(Block *self, int exact, LineStats *stats) {
+    uint64_t marked[LINE_WORDS];
+    uint64_t previous_free = 0;
+    uint64_t previous_hole = 0;
+    int live_lines = 0;
+
+    Block_sweepLineHeaders(self, marked);
+
+    // we determine and record holes (free lines) in a recycled block while
+    // sweeping (so allocating doesn't have to do it), for the whole block at
+    // once, with a few bit operations per 64 lines:
+    for (int word = 0; word < LINE_WORDS; word++) {
+        uint64_t blacklisted = self->blacklist[word] & ~marked[word];
+        uint64_t free = ~(marked[word] | self->blacklist[word]) & Lines_mask(word);
+
+        live_lines += __builtin_popcountll(marked[word]);
+
+        // blacklisted: false pointers point into the line, don't allocate
+        // into it until the next collection
+        stats->blacklisted_lines += __builtin_popcountll(blacklisted);
+
+        // conservative marking (immix page 5): the collector only marked the
+        // starting line for small objects (smaller than LINE_SIZE), but small
+        // objects may span a line, so we skip a free line when determining
+        // holes: a free line only belongs to a hole if the previous line is
+        // free too
+        uint64_t skipped = free & ~((free << 1) | previous_free);
+        uint64_t holes = exact ? free : free & ~skipped;
+
+        self->holes[word] = holes;
+        stats->skipped_lines += __builtin_popcountll(skipped);
+        stats->hole_lines += __builtin_popcountll(holes);
+        stats->holes += __builtin_popcountll(holes & ~((holes << 1) | previous_hole));
+
+        previous_free = free >> 63;
+        previous_hole = holes >> 63;
+    }
+
+    int first_free_line_index = Lines_find(self->holes, 0, 1);
+    int largest_hole = 0;
+
+    if (first_free_line_index == LINE_COUNT) {
+        first_free_line_index = INVALID_LINE_INDEX;
+    } else {
+        stats->recyclable_blocks++;
+
+        // the size of the largest hole (in whole lines) tells which
+        // allocations the block can fit (see GlobalAllocator_recyclableBucket);
+        // exact line marking: a hole may start after a dead object that spans
+        // into it, so we measure the holes as allocators see them
+        char *start, *limit;
+        int line_index = first_free_line_index;
+        while ((line_index = Block_nextHole(self, line_index, &start, &limit)) != INVALID_LINE_INDEX) {
+            int lines = (int)((limit - start) / LINE_SIZE);
+            if (lines > largest_hole) largest_hole = lines;
+        }
+    }
+
+    self->live_lines = live_lines;
+    self->largest_hole = largest_hole;
+    return first_free_line_index;
+}
+
 static inline void Line_update(Block *block, Object *object) {
     assert(Block_contains(block, (char *)object));
 
@@ -145,7 +564,7 @@ static inline void Line_update(Block *block, Object *object) {
         //DEBUG("GC: set first object in line block=%p object=%p line_index=%d offset=%ld\n",
         //        (void *)block, (void *)object, line_index, offset);
 
-        LineHeader_setOffset(line_header, offset);
+        LineHeader_publishOffset(line_header, offset);
     //} else {
     //    DEBUG("GC: not first object in line block=%p object=%p line_index=%d\n",
     //            (void *)block, (void *)object, line_index);
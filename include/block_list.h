@@ -32,6 +32,19 @@ static inline void BlockList_push(BlockList *self, Block *block) {
     self->size++;
 }
 
+// Appends the blocks of another list (the other list is left untouched).
+static inline void BlockList_append(BlockList *self, BlockList *other) {
+    if (BlockList_isEmpty(other)) return;
+
+    if (BlockList_isEmpty(self)) {
+        self->first = other->first;
+    } else {
+        self->last->next = other->first;
+    }
+    self->last = other->last;
+    self->size += other->size;
+}
+
 static inline Block *BlockList_shift(BlockList *self) {
     Block *block = self->first;
 
@@ -43,4 +56,20 @@ static inline Block *BlockList_shift(BlockList *self) {
     return block;
 }
 
+// Removes the block that follows the previous block, or the first block if
+// previous is NULL.
+static inline Block *BlockList_removeNext(BlockList *self, Block *previous) {
+    if (previous == NULL) return BlockList_shift(self);
+
+    Block *block = previous->next;
+
+    if (block != NULL) {
+        previous->next = block->next;
+        if (self->last == block) self->last = previous;
+        self->size--;
+    }
+
+    return block;
+}
+
 #endif
@@ -7,9 +7,14 @@
 #include "object.h"
 #include "utils.h"
 
+// The chunk size is the size of the object (counting the object metadata and
+// the mutator size). It must be right before the object header (see
+// Object_size).
 typedef struct Chunk {
     struct Chunk *next;
     uint8_t allocated;
+    uint8_t io; // an IO buffer, see GC_malloc_io
+    size_t size;
     Object object;
 } Chunk;
 
@@ -19,16 +24,24 @@ typedef struct Chunk {
 static inline void Chunk_init(Chunk *chunk, size_t size) {
     chunk->next = NULL;
     chunk->allocated = 0;
-    chunk->object.size = size;
+    chunk->io = 0;
+    chunk->size = size;
 
     // not required:
+    chunk->object.size = 0;
     chunk->object.marked = 0;
     chunk->object.atomic = 0;
+    chunk->object.dirty = 0;
+    chunk->object.flags = OBJECT_FLAG_LARGE;
 }
 
 static inline void Chunk_allocate(Chunk *self, int atomic) {
     self->allocated = 1;
+    self->io = 0;
+    self->object.marked = 0;
     self->object.atomic = atomic;
+    self->object.dirty = 0;
+    self->object.flags = OBJECT_FLAG_LARGE;
 }
 
 static inline int Chunk_isAllocated(Chunk *self) {
@@ -38,7 +51,7 @@ static inline int Chunk_isAllocated(Chunk *self) {
 // Returns the chunk size, counting the chunk and object metadata and the
 // mutator size.
 static inline int Chunk_size(Chunk *chunk) {
-    return chunk->object.size + CHUNK_HEADER_SIZE;
+    return chunk->size + CHUNK_HEADER_SIZE;
 }
 
 // Returns the mutator size, counting neither the chunk nor object metadata.
@@ -46,8 +59,10 @@ static inline int Chunk_size(Chunk *chunk) {
 //    return Object_mutatorSize(chunk->object);
 //}
 
+// Allocators mark chunks while the markers may be marking (see
+// Object_tryMark).
 static inline void Chunk_mark(Chunk *chunk) {
-    chunk->object.marked = 1;
+    __atomic_store_n(&chunk->object.marked, 1, __ATOMIC_RELAXED);
 }
 
 static inline void Chunk_unmark(Chunk *chunk) {
@@ -64,7 +79,7 @@ static inline void* Chunk_mutatorAddress(Chunk *chunk) {
 
 static inline int Chunk_contains(Chunk *chunk, void *pointer) {
     void *start = Chunk_mutatorAddress(chunk);
-    void *stop = (char *)chunk + CHUNK_HEADER_SIZE + chunk->object.size;
+    void *stop = (char *)chunk + CHUNK_HEADER_SIZE + chunk->size;
     return (pointer >= start) && (pointer < stop);
 }
 
@@ -113,7 +128,7 @@ static inline void ChunkList_insert(ChunkList *self, Chunk *chunk, Chunk* after)
 }
 
 static inline Chunk *ChunkList_split(ChunkList *self, Chunk *chunk, size_t size) {
-    size_t remaining = chunk->object.size - size;
+    size_t remaining = chunk->size - size;
 
     if (remaining < CHUNK_MIN_SIZE) {
         // not enough space to accomodate a new chunk, the use the whole chunk.
@@ -122,7 +137,7 @@ static inline Chunk *ChunkList_split(ChunkList *self, Chunk *chunk, size_t size)
     }
 
     // resize current chunk
-    chunk->object.size = size;
+    chunk->size = size;
 
     // insert new chunk (free)
     Chunk *free_chunk = (Chunk *)((char *)chunk + CHUNK_HEADER_SIZE + size);
@@ -130,8 +145,8 @@ static inline Chunk *ChunkList_split(ChunkList *self, Chunk *chunk, size_t size)
     ChunkList_insert(self, free_chunk, chunk);
 
     DEBUG("GC: split chunk=%p [size=%zu] free=%p [size=%zu] next=%p\n",
-            (void *)chunk, chunk->object.size,
-            (void *)free_chunk, free_chunk->object.size,
+            (void *)chunk, chunk->size,
+            (void *)free_chunk, free_chunk->size,
             (void *)free_chunk->next);
 
     assert(((char *)chunk + CHUNK_HEADER_SIZE + size) == ((char *)free_chunk));
@@ -178,12 +193,12 @@ static inline void ChunkList_merge(ChunkList *self, Chunk *chunk, Chunk *limit,
     size = (size_t)(stop - (char *)chunk) - CHUNK_HEADER_SIZE;
 
     DEBUG("GC: merge chunk=%p size=%zu next=%p new_size=%zu\n",
-            (void *)chunk, chunk->object.size,
+            (void *)chunk, chunk->size,
             (void *)limit, size);
-    assert(size > chunk->object.size);
+    assert(size > chunk->size);
 
     chunk->next = limit;
-    chunk->object.size = size;
+    chunk->size = size;
 
     if (limit == NULL) {
         self->last = chunk;
@@ -191,40 +206,55 @@ static inline void ChunkList_merge(ChunkList *self, Chunk *chunk, Chunk *limit,
     self->size = self->size - count;
 }
 
-// Iterates the list and deallocates any chunk whose chunk hasn't been marked.
-static inline void ChunkList_sweep(ChunkList *self) {
-    Chunk *chunk = self->first;
+// Deallocates the chunks that haven't been marked, starting from the given
+// chunk, and merges consecutive free chunks. Stops on a marked chunk once at
+// least count chunks have been swept, so the next call never has to merge with
+// the chunks swept by this call. Returns the next chunk to sweep, or NULL when
+// the whole list has been swept.
+static inline Chunk *ChunkList_sweepSome(ChunkList *self, Chunk *chunk, size_t count) {
+    size_t swept = 0;
 
     while (chunk != NULL) {
         if (Chunk_isMarked(chunk)) {
+            if (swept >= count) return chunk;
+
             // chunk is marked: keep allocation
             DEBUG("GC: keep chunk=%p ptr=%p size=%zu\n",
-                    (void *)chunk, Chunk_mutatorAddress(chunk), Object_size(&chunk->object));
+                    (void *)chunk, Chunk_mutatorAddress(chunk), chunk->size);
             chunk = chunk->next;
+            swept++;
         } else {
             DEBUG("GC: free chunk=%p ptr=%p size=%zu\n",
-                    (void *)chunk, Chunk_mutatorAddress(chunk), Object_size(&chunk->object));
+                    (void *)chunk, Chunk_mutatorAddress(chunk), chunk->size);
 
             // 'free' chunk
             chunk->allocated = 0;
 
             // iterate the following chunks until we find a marked chunk
             Chunk *limit = chunk->next;
-            size_t count = 0;
+            size_t merged = 0;
 
             while ((limit != NULL) && !Chunk_isMarked(limit)) {
                 limit = limit->next;
-                count++;
+                merged++;
             }
 
             // merge unmarked chunks
             if (limit != chunk->next) {
-                ChunkList_merge(self, chunk, limit, count);
+                ChunkList_merge(self, chunk, limit, merged);
             }
 
             chunk = limit;
+            swept += merged + 1;
         }
     }
+
+    return NULL;
+}
+
+// Iterates the list and deallocates any chunk whose chunk hasn't been marked.
+static inline void ChunkList_sweep(ChunkList *self) {
+    ChunkList_sweepSome(self, self->first, SIZE_MAX);
 }
 
 static inline void ChunkList_validate(ChunkList *self, void *heap_stop) {
@@ -236,7 +266,7 @@ static inline void ChunkList_validate(ChunkList *self, void *heap_stop) {
         count++;
 
         if (chunk->next == NULL) {
-            void *actual = (char *)chunk + CHUNK_HEADER_SIZE + chunk->object.size;
+            void *actual = (char *)chunk + CHUNK_HEADER_SIZE + chunk->size;
 
             if (actual != heap_stop) {
                 fprintf(stderr, "ASSERTION FAILED: heap_stop %p == chunk+header+size %p\n", heap_stop, actual);
@@ -254,7 +284,7 @@ static inline void ChunkList_validate(ChunkList *self, void *heap_stop) {
         }
 
         char *expected = (char *)chunk->next;
-        char *actual = (char *)chunk + CHUNK_HEADER_SIZE + chunk->object.size;
+        char *actual = (char *)chunk + CHUNK_HEADER_SIZE + chunk->size;
 
         if (actual != expected) {
             fprintf(stderr, "ASSERTION FAILED: chunk->next %p == chunk+header+size %p\n", (void *)expected, (void *)actual);
@@ -269,7 +299,7 @@ static inline void ChunkList_debug(ChunkList *self) {
     Chunk *chunk = self->first;
     while (chunk != NULL) {
         fprintf(stderr, "CHUNK_LIST: chunk=%p allocated=%d size=%zu marked=%d atomic=%d\n",
-                (void *)chunk, chunk->allocated, chunk->object.size, chunk->object.marked, chunk->object.atomic);
+                (void *)chunk, chunk->allocated, chunk->size, chunk->object.marked, chunk->object.atomic);
         chunk = chunk->next;
     }
 }
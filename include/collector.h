@@ -1,22 +1,103 @@
 #ifndef IMMIX_COLLECTOR_H
 #define IMMIX_COLLECTOR_H
 
+#include "array.h"
+#include "background.h"
 #include "global_allocator.h"
+#include "hash.h"
+#include "root_sources.h"
+#include "roots.h"
 #include "stack.h"
+#include "workers.h"
 
 typedef void (*collect_callback_t)(void);
 
+// Maximum number of displacements that can be registered with
+// GC_register_displacement.
+#define DISPLACEMENTS_MAX 8
+
+// Eager sweeping: GC workers claim ranges of N blocks to sweep.
+#define SWEEP_RANGE_BLOCKS 256
+
+// Capacity of the mark stack of each GC worker (in regions). A worker moves
+// half its stack to the shared overflow stack when it's full, and takes
+// regions back from there when its stack is empty.
+#define MARK_STACK_CAPACITY 16384
+
+// Marking state of a GC worker: each worker has its own mark stack and
+// statistics, so workers don't have to synchronize, except for marking
+// objects and overflowing their mark stack.
+typedef struct GC_Marker {
+    struct GC_Collector *collector;
+    GlobalAllocator *global_allocator;
+    Stack stack;
+    RootSources sources;
+    uint64_t heap_nanoseconds;
+    size_t ignored_pointers;
+    size_t marked_bytes;
+    int concurrent;
+    int pinning;
+} Marker;
+
 typedef struct GC_Collector {
     GlobalAllocator *global_allocator;
     collect_callback_t collect_callback;
-    Stack roots;
+    Roots roots;
+    Hash *stack_roots;
+
+    // registering the roots of a nursery collection: cached stack roots are
+    // read but not updated (see Collector_addNurseryRoots)
+    int nursery_roots;
+
+    // mutator addresses of the objects pinned by the program (see GC_pin),
+    // once per pin
+    Array pinned_roots;
+
+    Workers workers;
+    Marker *markers;
+    Stack overflow_stack;
+    pthread_mutex_t overflow_mutex;
+    RootSources sources;
+    uint64_t heap_nanoseconds;
+    uint64_t mark_nanoseconds;
+    size_t ignored_pointers;
+    size_t marked_bytes;
+    int minor;
+    int interior_pointers;
+    int displacement_count;
+    size_t displacements[DISPLACEMENTS_MAX];
+    size_t incremental_step;
+    int concurrent;
+    Background background;
+    uint64_t background_nanoseconds;
+    size_t step_count;
+    uint64_t step_max_nanoseconds;
+    uint64_t final_nanoseconds;
+    char *evacuation_cursor;
+    char *evacuation_limit;
+    size_t evacuation_candidates;
+    size_t evacuated_objects;
+    size_t evacuated_bytes;
+    size_t pinned_objects;
+    uint64_t evacuation_nanoseconds;
+    uint64_t sweep_nanoseconds;
+    Sweeper *sweepers;
+    size_t sweeper_capacity;
+    size_t sweep_range_count;
+    size_t next_sweep_range;
     int is_collecting;
 } Collector;
 
-void GC_Collector_init(Collector *self, GlobalAllocator *allocator);
+void GC_Collector_init(Collector *self, GlobalAllocator *allocator, int workers, int interior_pointers, int concurrent);
 void GC_Collector_collect(Collector *self);
 void GC_Collector_addRoots(Collector *self, void *stack_top, void *stack_bottom, const char *source);
+void GC_Collector_addCachedRoots(Collector *self, void *stack_top, void *stack_bottom, const char *source, size_t epoch);
+void GC_Collector_addNurseryRoots(Collector *self);
 void GC_Collector_mark(Collector *self);
+void GC_Collector_startMarking(Collector *self);
+int GC_Collector_markStep(Collector *self);
+void GC_Collector_printStats(Collector *self);
+void GC_Collector_registerDisplacement(Collector *self, size_t offset);
 
 static inline void Collector_registerCollectCallback(Collector *self, collect_callback_t callback) {
     self->collect_callback = callback;
@@ -29,6 +110,72 @@ static inline void Collector_callCollectCallback(Collector *self) {
     }
 }
 
+// The pinned roots are scanned with the other roots (see
+// Collector_addAllRoots), which also pins them for evacuation. Only the base
+// address of an allocated object can be pinned: other pointers are ignored.
+static inline void Collector_pin(Collector *self, void *pointer) {
+    Object *object = GlobalAllocator_findObject(self->global_allocator, pointer, 0);
+    if (object == NULL) return;
+
+    Array_push(&self->pinned_roots, pointer);
+    Object_setPinnedRoot(object);
+}
+
+// Removes one pin of the object. Unpinning an object that wasn't pinned is a
+// no-op.
+static inline void Collector_unpin(Collector *self, void *pointer) {
+    void **found = NULL;
+    int pins = 0;
+
+    for (void **cursor = self->pinned_roots.buffer; cursor < self->pinned_roots.cursor; cursor++) {
+        if (*cursor == pointer) {
+            if (found == NULL) found = cursor;
+            pins++;
+        }
+    }
+    if (found == NULL) return;
+
+    // the order doesn't matter: move the last pin into the free slot
+    self->pinned_roots.cursor--;
+    *found = *self->pinned_roots.cursor;
+
+    if (pins == 1) Object_clearPinnedRoot((Object *)pointer - 1);
+}
+
+// Removes all the pins of an object that is freed: its address may be reused.
+static inline void Collector_unpinAll(Collector *self, void *pointer) {
+    void **cursor = self->pinned_roots.buffer;
+
+    while (cursor < self->pinned_roots.cursor) {
+        if (*cursor == pointer) {
+            self->pinned_roots.cursor--;
+            *cursor = *self->pinned_roots.cursor;
+        } else {
+            cursor++;
+        }
+    }
+    Object_clearPinnedRoot((Object *)pointer - 1);
+}
+
+// Returns true if the pointer is the base address of the object, or the base
+// address plus one of the registered displacements.
+static inline int Collector_isBasePointer(Collector *self, Object *object, void *pointer) {
+    char *base = (char *)Object_mutatorAddress(object);
+    if ((char *)pointer < base) return 0;
+
+    size_t offset = (size_t)((char *)pointer - base);
+    if (offset == 0) return 1;
+
+    for (int i = 0; i < self->displacement_count; i++) {
+        if (self->displacements[i] == offset) return 1;
+    }
+    return 0;
+}
+
+static inline int Collector_isMarking(Collector *self) {
+    return GlobalAllocator_isMarking(self->global_allocator);
+}
+
 static inline void Collector_setCollecting(Collector *self, int value) {
     assert(value == 0 || value == 1);
     self->is_collecting = value;
@@ -41,6 +188,12 @@ static inline int Collector_isCollecting(Collector *self) {
 #define Collector_init GC_Collector_init
 #define Collector_collect GC_Collector_collect
 #define Collector_addRoots GC_Collector_addRoots
+#define Collector_addCachedRoots GC_Collector_addCachedRoots
+#define Collector_addNurseryRoots GC_Collector_addNurseryRoots
 #define Collector_mark GC_Collector_mark
+#define Collector_startMarking GC_Collector_startMarking
+#define Collector_markStep GC_Collector_markStep
+#define Collector_printStats GC_Collector_printStats
+#define Collector_registerDisplacement GC_Collector_registerDisplacement
 
 #endif
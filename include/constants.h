@@ -1,18 +1,57 @@
 #ifndef GC_CONSTANTS_H
 #define GC_CONSTANTS_H
 
-// Each IMMIX block is 32KB, and sliced in 128 lines of 256 bytes each. The
-// first line is reserved for block and line metadata, hence 127 lines are
-// available.
+// The heap geometry is chosen at compile time, for example:
+//
+//     $ make CUSTOM="-DGC_BLOCK_SIZE=65536 -DGC_LINE_SIZE=128"
+//
+// Blocks and lines are powers of two, and lines are at most 256 bytes (see
+// LineHeader_setOffset). The derived invariants are checked at compile time
+// (see GC_STATIC_ASSERT). `make bench-matrix` runs the benchmarks against
+// different geometries.
+#ifndef GC_BLOCK_SIZE
+#define GC_BLOCK_SIZE 32768
+#endif
+
+#ifndef GC_LINE_SIZE
+#define GC_LINE_SIZE 256
+#endif
+
+// Defaults to a quarter of a block (8KB with 32KB blocks).
+#ifndef GC_LARGE_OBJECT_SIZE
+#define GC_LARGE_OBJECT_SIZE (GC_BLOCK_SIZE / 4)
+#endif
+
+// By default, each IMMIX block is 32KB, and sliced in 128 lines of 256 bytes
+// each. The block and line metadata live out of the block (see REGION_SIZE),
+// hence all the lines are available.
 
-#define BLOCK_SIZE ((size_t)32768)
+#define BLOCK_SIZE ((size_t)GC_BLOCK_SIZE)
 #define BLOCK_SIZE_IN_BYTES_INVERSE_MASK (~(BLOCK_SIZE - 1))
 
-#define LINE_SIZE 256
-#define LINE_COUNT 127
+#define LINE_SIZE GC_LINE_SIZE
+#define LINE_COUNT ((int)(BLOCK_SIZE / LINE_SIZE))
 
-// Objects of 8192 and more will be allocated to the large object space.
-#define LARGE_OBJECT_SIZE (size_t)8192
+// The small object space is made of regions of 128 blocks (4MB by default).
+// The first blocks of each region hold the metadata of all the blocks in the
+// region, as a dense array indexed by block number (see Block_from).
+#define REGION_BLOCKS 128
+#define REGION_SIZE (BLOCK_SIZE * REGION_BLOCKS)
+
+// Objects of LARGE_OBJECT_SIZE and more will be allocated to the medium object
+// space, or to the large object space when they don't fit a medium block.
+#define LARGE_OBJECT_SIZE ((size_t)GC_LARGE_OBJECT_SIZE)
+
+// Each medium block is 256KB, and sliced in 256 granules of 1KB each. The first
+// granule is reserved for block metadata, hence objects of up to 255KB
+// (including the object header) are medium objects.
+#define MEDIUM_BLOCK_SIZE ((size_t)262144)
+#define MEDIUM_GRANULE_SIZE ((size_t)1024)
+#define MEDIUM_GRANULE_COUNT ((int)(MEDIUM_BLOCK_SIZE / MEDIUM_GRANULE_SIZE))
+#define MEDIUM_OBJECT_SIZE (MEDIUM_BLOCK_SIZE - MEDIUM_GRANULE_SIZE)
+
+// Each thread keeps up to N freed IO buffers (see GC_free_io) to recycle them.
+#define IO_POOL_SIZE 8
 
 // Grow the small object space by 30%.
 #define GROWTH_RATE 30
@@ -27,4 +66,86 @@
 // #define GC_MAXIMUM_HEAP_SIZE
 #define GC_FREE_SPACE_DIVISOR 3
 
+// Number of GC threads (including the collecting thread), for example to scan
+// roots in parallel. Defaults to the number of online processors.
+// #define GC_WORKERS
+
+// Whether pointers into an object (not only to its start) keep the object
+// alive. Set to 0 to only recognize base pointers, plus the offsets registered
+// with GC_register_displacement.
+#define GC_INTERIOR_POINTERS 1
+
+// Incremental marking: when enabled, marking progresses in bounded steps
+// interleaved with allocations (each step scans about GC_INCREMENTAL_STEP
+// bytes), and only the final remark and sweep stop the program. Requires the
+// program to call GC_write_barrier.
+#define GC_INCREMENTAL 0
+#define GC_INCREMENTAL_STEP (256 * 1024)
+
+// Concurrent marking: same as incremental marking, but a background thread
+// marks the HEAP while the program keeps running.
+#define GC_CONCURRENT 0
+
+// Generational collection (sticky mark bits): objects that survived a
+// collection are old and are only collected by full collections. Minor
+// collections only trace young objects from the roots and from the old
+// objects modified since the last collection. Requires the program to call
+// GC_write_barrier.
+#define GC_GENERATIONAL 0
+
+// Do a full collection instead of a minor collection when more than N% of the
+// young objects survived the last minor collection (minor collections aren't
+// productive anymore).
+#define GC_MAXIMUM_SURVIVAL_RATE 50
+
+// Size of the thread-local nursery of each thread (0 disables nurseries).
+// Threads allocate small objects into their nursery, and collect it without
+// stopping other threads, until objects escape. Requires the program to call
+// GC_write_barrier.
+#define GC_NURSERY_SIZE 0
+
+// A nursery collection must free at least 1/N of the nursery, otherwise the
+// nursery is released into the shared heap.
+#define GC_NURSERY_MINIMUM_FREE_DIVISOR 4
+
+// Opportunistic evacuation (defragmentation): full collections move the
+// objects out of fragmented blocks into free blocks, so the fragmented blocks
+// become free. Objects referenced from the roots (stacks, DATA and BSS
+// sections) are pinned. Pointers in the HEAP are updated, hence pointer-sized
+// words of objects that aren't atomic must be actual pointers.
+//
+// WARNING: objects are scanned conservatively, without type information. Any
+// pointer-sized word of an object that isn't atomic whose value happens to be
+// an address within a moved object is rewritten to the new address, even if
+// the program stored it as an integer (e.g. a hash or a counter), silently
+// corrupting it. Only enable evacuation for programs that keep such values in
+// atomic objects.
+#define GC_EVACUATE 0
+
+// Evacuate recyclable blocks with at most N% live lines (after the last
+// collection).
+#define GC_EVACUATION_THRESHOLD 25
+
+// Keep N% of the small object space (at least one block) free for the
+// evacuated objects: allocators grow the HEAP instead of using the last free
+// blocks.
+#define GC_EVACUATION_RESERVE 2
+
+// Exact line marking: marking an object marks all the lines it touches, so
+// sweeping recovers the free line after each marked line that conservative
+// line marking (immix page 5) must skip, at the expense of slower marking.
+#define GC_EXACT_LINE_MARKING 0
+
+// Lazy sweeping: collections don't sweep the small object space, blocks are
+// swept when allocators need a block, so sweeping doesn't pause the program.
+// Set to 0 to sweep all blocks during the collection (GC workers sweep in
+// parallel).
+#define GC_LAZY_SWEEP 1
+
+// Concurrent sweeping: collections don't sweep the large object space, a
+// background thread frees the unmarked chunks and merges them after the
+// collection, while the program keeps running. Large allocations help sweep
+// the chunks when the swept chunks can't fit them.
+#define GC_CONCURRENT_SWEEP 1
+
 #endif
@@ -1,20 +1,49 @@
 #ifndef GC_GLOBAL_ALLOCATOR_H
 #define GC_GLOBAL_ALLOCATOR_H
 
+#include <pthread.h>
 #include "constants.h"
 #include "block_list.h"
 #include "chunk_list.h"
+#include "medium_block.h"
 #include "hash.h"
 
 typedef void (*finalizer_t)(void *);
 
+// Maximum number of false pointers into free large chunks that are remembered
+// between collections.
+#define LARGE_BLACKLIST_MAX 256
+
+// Concurrent sweeping: number of chunks swept at once while holding the large
+// chunk list lock (see ChunkList_sweepSome).
+#define LARGE_SWEEP_STEP 64
+
+// Recyclable blocks are bucketed by the size of their largest hole: less than
+// 2 lines, 2 to 3 lines, 4 to 7 lines, and 8 lines or more (see
+// GlobalAllocator_recyclableBucket).
+#define RECYCLABLE_BUCKETS 4
+
 typedef struct GC_GlobalAllocator {
     size_t small_heap_size;
     void *small_heap_start;
     void *small_heap_stop;
 
     BlockList free_list;
-    BlockList recyclable_list;
+    BlockList recyclable_lists[RECYCLABLE_BUCKETS];
+
+    // lazy sweeping: blocks in [sweep_cursor, sweep_stop) weren't swept since
+    // the last collection
+    int lazy_sweep;
+    Block *sweep_cursor;
+    Block *sweep_stop;
+
+    // medium object space: the blocks with enough free granules for a medium
+    // object, that no allocator owns
+    size_t medium_heap_size;
+    void *medium_heap_start;
+    void *medium_heap_stop;
+
+    MediumBlockList medium_list;
 
     size_t large_heap_size;
     void *large_heap_start;
@@ -22,28 +51,75 @@ typedef struct GC_GlobalAllocator {
 
     ChunkList large_chunk_list;
 
+    // protects the large chunk list against concurrent marking and sweeping
+    // (the program must still hold GC_lock to allocate)
+    pthread_mutex_t large_mutex;
+
+    // concurrent sweeping: chunks from large_sweep_cursor on weren't swept
+    // since the last collection (NULL once the whole list has been swept)
+    int concurrent_sweep;
+    Chunk *large_sweep_cursor;
+
+    void *large_blacklist[LARGE_BLACKLIST_MAX];
+    size_t large_blacklist_size;
+
+    size_t blacklisted_bytes;
+
+    // exact line marking (see Block_markObjectLines); statistics of the
+    // blocks swept since the last collection, and of the last complete sweep
+    int exact_line_marking;
+    LineStats line_stats;
+    LineStats swept_line_stats;
+
     Hash *finalizers;
 
     size_t memory_limit;
     size_t free_space_divisor;
+    int incremental;
+    int marking;
+    int generational;
+    int minor;
+    size_t survival_rate;
+    size_t promoted_bytes;
+    int evacuate;
     size_t allocated_bytes_since_collect;
     size_t total_allocated_bytes;
 } GlobalAllocator;
 
+// The free and recyclable blocks found while sweeping a range of blocks (see
+// GlobalAllocator_sweepBlocks).
+typedef struct GC_Sweeper {
+    BlockList free_list;
+    BlockList recyclable_lists[RECYCLABLE_BUCKETS];
+    LineStats line_stats;
+} Sweeper;
+
 void GC_GlobalAllocator_init(GlobalAllocator *self, size_t initial_size);
-void *GC_GlobalAllocator_allocateLarge(GlobalAllocator *self, size_t size, int atomic);
+void *GC_GlobalAllocator_allocateLarge(GlobalAllocator *self, size_t size, size_t alignment, int atomic);
 void GC_GlobalAllocator_deallocateLarge(GlobalAllocator *self, void *pointer);
-Block *GC_GlobalAllocator_nextBlock(GlobalAllocator *self);
+MediumBlock *GC_GlobalAllocator_nextMediumBlock(GlobalAllocator *self, MediumBlock *previous, int count);
+void GC_GlobalAllocator_deallocateMedium(GlobalAllocator *self, void *pointer);
+void GC_GlobalAllocator_sweepMedium(GlobalAllocator *self);
+Block *GC_GlobalAllocator_nextBlock(GlobalAllocator *self, size_t size);
 Block *GC_GlobalAllocator_nextFreeBlock(GlobalAllocator *self);
 void GC_GlobalAllocator_recycleBlocks(GlobalAllocator *self);
+void GC_GlobalAllocator_finishSweeping(GlobalAllocator *self);
+void GC_GlobalAllocator_sweepBlocks(GlobalAllocator *self, Sweeper *sweeper, Block *start, Block *stop);
+void GC_GlobalAllocator_recycleSweptBlocks(GlobalAllocator *self, Sweeper *sweepers, size_t count);
+int GC_GlobalAllocator_sweepLarge(GlobalAllocator *self, size_t count);
 
 static inline void GlobalAllocator_registerFinalizer(GlobalAllocator *self, Object *object, finalizer_t callback) {
     void *ptr = *(void **)(&callback);
     Hash_insert(self->finalizers, object, ptr);
+    Object_setFinalizer(object);
 }
 
 static inline finalizer_t GlobalAllocator_deleteFinalizer(GlobalAllocator *self, Object *object) {
     finalizer_t callback;
+
+    if (!Object_hasFinalizer(object)) return NULL;
+    Object_clearFinalizer(object);
+
     *(void **)(&callback) = Hash_delete(self->finalizers, object);
     return callback;
 }
@@ -70,12 +146,133 @@ static inline int GlobalAllocator_inSmallHeap(GlobalAllocator *self, void *point
     return (pointer >= self->small_heap_start) && (pointer < self->small_heap_stop);
 }
 
+static inline int GlobalAllocator_inMediumHeap(GlobalAllocator *self, void *pointer) {
+    return (pointer >= self->medium_heap_start) && (pointer < self->medium_heap_stop);
+}
+
 static inline int GlobalAllocator_inLargeHeap(GlobalAllocator *self, void *pointer) {
     return (pointer >= self->large_heap_start) && (pointer < self->large_heap_stop);
 }
 
 static inline int GlobalAllocator_inHeap(GlobalAllocator *self, void *pointer) {
-    return GlobalAllocator_inSmallHeap(self, pointer) || GlobalAllocator_inLargeHeap(self, pointer);
+    return GlobalAllocator_inSmallHeap(self, pointer) ||
+        GlobalAllocator_inMediumHeap(self, pointer) ||
+        GlobalAllocator_inLargeHeap(self, pointer);
+}
+
+// Records a false pointer into a free large chunk. Called by GC workers during
+// marking, hence the atomic.
+static inline void GlobalAllocator_blacklistLarge(GlobalAllocator *self, void *pointer) {
+    size_t index = __atomic_fetch_add(&self->large_blacklist_size, 1, __ATOMIC_RELAXED);
+    if (index < LARGE_BLACKLIST_MAX) {
+        self->large_blacklist[index] = pointer;
+    }
+}
+
+static inline size_t GlobalAllocator_largeBlacklistSize(GlobalAllocator *self) {
+    size_t size = self->large_blacklist_size;
+    return size < LARGE_BLACKLIST_MAX ? size : LARGE_BLACKLIST_MAX;
+}
+
+static inline void GlobalAllocator_clearLargeBlacklist(GlobalAllocator *self) {
+    self->large_blacklist_size = 0;
+}
+
+static inline void GlobalAllocator_lockLarge(GlobalAllocator *self) {
+    pthread_mutex_lock(&self->large_mutex);
+}
+
+static inline void GlobalAllocator_unlockLarge(GlobalAllocator *self) {
+    pthread_mutex_unlock(&self->large_mutex);
+}
+
+// Incremental marking is in progress: objects must be allocated black (marked)
+// and modified objects must be remembered (write barrier). Read by all the
+// threads and the background marker, hence the atomics: a thread that sees the
+// flag also sees the unmarked HEAP.
+static inline int GlobalAllocator_isMarking(GlobalAllocator *self) {
+    return __atomic_load_n(&self->marking, __ATOMIC_ACQUIRE);
+}
+
+static inline void GlobalAllocator_setMarking(GlobalAllocator *self, int value) {
+    __atomic_store_n(&self->marking, value, __ATOMIC_RELEASE);
+}
+
+// Returns the object that the pointer points to (or into, when `interior` is
+// true) whatever the space it was allocated in, or NULL if the pointer doesn't
+// point to an allocated object.
+static inline Object *GlobalAllocator_findObject(GlobalAllocator *self, void *pointer, int interior) {
+    Object *object = NULL;
+
+    if (GlobalAllocator_inSmallHeap(self, pointer)) {
+        Block *block = Block_from(pointer);
+        if (interior) {
+            object = Block_findObjectContaining(block, pointer);
+        } else {
+            object = Block_findObject(block, (char *)pointer - sizeof(Object));
+        }
+    } else if (GlobalAllocator_inMediumHeap(self, pointer)) {
+        object = MediumBlock_findObject(MediumBlock_from(pointer), pointer);
+    } else if (GlobalAllocator_inLargeHeap(self, pointer)) {
+        GlobalAllocator_lockLarge(self);
+        Chunk *chunk = ChunkList_find(&self->large_chunk_list, pointer);
+        if (chunk != NULL && Chunk_isAllocated(chunk)) object = &chunk->object;
+        GlobalAllocator_unlockLarge(self);
+    }
+
+    if (object == NULL) return NULL;
+    if (interior) return Object_contains(object, pointer) ? object : NULL;
+    return Object_mutatorAddress(object) == pointer ? object : NULL;
+}
+
+// Returns true if the pointer is the mutator address of an allocated IO buffer
+// (see GC_LocalAllocator_allocateIo).
+static inline int GlobalAllocator_isIoBuffer(GlobalAllocator *self, void *pointer) {
+    if (!GlobalAllocator_inLargeHeap(self, pointer)) return 0;
+
+    GlobalAllocator_lockLarge(self);
+    Chunk *chunk = ChunkList_find(&self->large_chunk_list, pointer);
+    int io = chunk != NULL && Chunk_isAllocated(chunk) && chunk->io && Chunk_mutatorAddress(chunk) == pointer;
+    GlobalAllocator_unlockLarge(self);
+
+    return io;
+}
+
+// Modified objects must be remembered while marking (incremental marking) and
+// between collections (generational).
+static inline int GlobalAllocator_needsWriteBarrier(GlobalAllocator *self) {
+    return GlobalAllocator_isMarking(self) || self->generational;
+}
+
+// Remembers the modified object, so the next collection (or the final remark)
+// scans it again (see Collector_rescanDirtyObjects).
+static inline void GlobalAllocator_writeBarrier(GlobalAllocator *self, Object *object) {
+    if (!GlobalAllocator_needsWriteBarrier(self)) return;
+
+    Object_setDirty(object);
+
+    if (GlobalAllocator_inSmallHeap(self, object)) {
+        Block_setDirty(Block_from(object));
+    } else if (GlobalAllocator_inMediumHeap(self, object)) {
+        MediumBlock_setDirty(MediumBlock_from(object));
+    }
+}
+
+static inline void GlobalAllocator_clearRecyclableLists(BlockList *recyclable_lists) {
+    for (int bucket = 0; bucket < RECYCLABLE_BUCKETS; bucket++) {
+        BlockList_clear(recyclable_lists + bucket);
+    }
+}
+
+// Lazy sweeping: some blocks weren't swept since the last collection.
+static inline int GlobalAllocator_isSweeping(GlobalAllocator *self) {
+    return self->sweep_cursor < self->sweep_stop;
+}
+
+// Concurrent sweeping: the collection only restarts the sweep of the large
+// chunk list, see GlobalAllocator_sweepLarge.
+static inline void GlobalAllocator_startSweepingLarge(GlobalAllocator *self) {
+    self->large_sweep_cursor = self->large_chunk_list.first;
 }
 
 static inline void GlobalAllocator_incrementCounters(GlobalAllocator *self, size_t increment) {
@@ -83,6 +280,26 @@ static inline void GlobalAllocator_incrementCounters(GlobalAllocator *self, size
     self->total_allocated_bytes += increment;
 }
 
+// Thread-local nurseries: objects allocated into a nursery only count towards
+// the next collection once the nursery is released into the shared heap.
+static inline void GlobalAllocator_incrementTotalCounter(GlobalAllocator *self, size_t increment) {
+    self->total_allocated_bytes += increment;
+}
+
+static inline void GlobalAllocator_incrementCollectCounter(GlobalAllocator *self, size_t increment) {
+    self->allocated_bytes_since_collect += increment;
+}
+
+// Explicitly freed objects (see GC_free) don't count towards the next
+// collection.
+static inline void GlobalAllocator_decrementCollectCounter(GlobalAllocator *self, size_t decrement) {
+    if (self->allocated_bytes_since_collect < decrement) {
+        self->allocated_bytes_since_collect = 0;
+    } else {
+        self->allocated_bytes_since_collect -= decrement;
+    }
+}
+
 static inline void GlobalAllocator_resetCounters(GlobalAllocator *self) {
     self->allocated_bytes_since_collect = 0;
 }
@@ -96,14 +313,21 @@ static inline size_t GlobalAllocator_totalAllocatedBytes(GlobalAllocator *self)
 }
 
 static inline size_t GlobalAllocator_heapSize(GlobalAllocator *self) {
-    return self->small_heap_size + self->large_heap_size;
+    return self->small_heap_size + self->medium_heap_size + self->large_heap_size;
 }
 
 #define GlobalAllocator_init GC_GlobalAllocator_init
 #define GlobalAllocator_allocateLarge GC_GlobalAllocator_allocateLarge
 #define GlobalAllocator_deallocateLarge GC_GlobalAllocator_deallocateLarge
+#define GlobalAllocator_nextMediumBlock GC_GlobalAllocator_nextMediumBlock
+#define GlobalAllocator_deallocateMedium GC_GlobalAllocator_deallocateMedium
+#define GlobalAllocator_sweepMedium GC_GlobalAllocator_sweepMedium
 #define GlobalAllocator_nextBlock GC_GlobalAllocator_nextBlock
 #define GlobalAllocator_nextFreeBlock GC_GlobalAllocator_nextFreeBlock
 #define GlobalAllocator_recycleBlocks GC_GlobalAllocator_recycleBlocks
+#define GlobalAllocator_finishSweeping GC_GlobalAllocator_finishSweeping
+#define GlobalAllocator_sweepBlocks GC_GlobalAllocator_sweepBlocks
+#define GlobalAllocator_recycleSweptBlocks GC_GlobalAllocator_recycleSweptBlocks
+#define GlobalAllocator_sweepLarge GC_GlobalAllocator_sweepLarge
 
 #endif
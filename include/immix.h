@@ -21,11 +21,51 @@ int GC_in_heap(void *pointer);
 void *GC_malloc(size_t size);
 void *GC_malloc_atomic(size_t size);
 void *GC_realloc(void *pointer, size_t size);
+
+// Same as GC_malloc and GC_malloc_atomic but only pointers to the start of the
+// allocation (or a registered displacement) keep it alive, interior pointers
+// are ignored. Such pointers are also resolved faster.
+void *GC_malloc_base_only(size_t size);
+void *GC_malloc_atomic_base_only(size_t size);
+
+// Same as GC_malloc and GC_malloc_atomic but the allocation is aligned on a
+// power of two, for example a cache line (64) for SIMD buffers or per-thread
+// counters, or the page size (see sysconf(3)) for zero-copy IO. Aligned objects
+// are never moved (see GC_EVACUATE), but GC_realloc doesn't keep the alignment.
+void *GC_memalign(size_t alignment, size_t size);
+void *GC_memalign_atomic(size_t alignment, size_t size);
+
+// Allocates an atomic buffer for zero-copy IO (e.g. vmsplice, O_DIRECT or
+// MSG_ZEROCOPY): the buffer is page-aligned, its size is rounded up to whole
+// pages, no GC metadata shares its pages, and it never moves.
+//
+// GC_free_io releases a buffer the program won't access anymore (nor the
+// kernel): the thread recycles it on a later GC_malloc_io, or hands its pages
+// back to the kernel (MADV_FREE). Other pointers are ignored.
+void *GC_malloc_io(size_t size);
+void GC_free_io(void *pointer);
+
+// Registers an offset from the start of allocations that will be considered a
+// valid reference when interior pointers aren't recognized, for example when
+// the program tags its pointers. Up to 8 displacements can be registered.
+void GC_register_displacement(size_t offset);
+
+// Frees an allocation the program won't access anymore. Its finalizer, if any,
+// is unregistered without being called. Pointers that aren't the base address
+// of an allocation, or that were freed already, are ignored.
 void GC_free(void *pointer);
 
 typedef void (*GC_finalizer_t)(void *);
 void GC_register_finalizer(void *pointer, GC_finalizer_t);
 
+// Pins an allocation (its base address) while C code or an in-flight syscall
+// holds a pointer the collector can't see, e.g. in memory allocated with libc
+// malloc: the allocation is reachable and never moves until it's unpinned.
+// Pins nest: each GC_pin must be balanced by a GC_unpin. Pointers that aren't
+// the base address of an allocation are ignored, and GC_free drops the pins.
+void GC_pin(void *pointer);
+void GC_unpin(void *pointer);
+
 void GC_init_thread();
 void GC_deinit_thread(void *);
 
@@ -38,13 +78,49 @@ void GC_collect();
 void GC_collect_once();
 int GC_is_collecting();
 
+// Incremental marking (see GC_INCREMENTAL): starts marking (unmarks objects and
+// scans the roots, through GC_collect so the world is stopped) or marks a
+// bounded number of objects. Calls GC_collect to complete the collection
+// (remark & sweep) once everything has been marked. Returns true if marking is
+// still in progress. Steps are also taken automatically when allocating.
+int GC_collect_a_little();
+
+// Incremental marking, generational collection and thread-local nurseries: the
+// program must call the write barrier after storing a pointer into an object,
+// with a pointer to (or into) the object; other pointers are ignored. Objects
+// allocated while marking don't need it. This is a no-op unless the collector
+// is marking, generational or nurseries are enabled.
+void GC_write_barrier(void *pointer);
+
+// Thread-local nurseries (see GC_NURSERY_SIZE): the object (and the objects it
+// references) escaped the current thread, for example it's passed to another
+// thread through memory that the write barrier doesn't cover. This is a no-op
+// unless nurseries are enabled.
+void GC_publish(void *pointer);
+
+// Thread-local nurseries: the current thread switched to another stack whose
+// bottom (highest address) is stack_bottom, for example it resumed a fiber.
+// Nursery collections only scan the stack they run on, and can't run on an
+// unknown stack. Must be called before each switch; NULL is the thread stack.
+void GC_set_stackbottom(void *stack_bottom);
+
 // We don't detect or collect stacks to iterate to find objects to mark. The
 // program is responsible for registering a callback that will call
-// GC_mark_region for all required stack roots; except for the DATA and BSS
-// sections that are automatically handled.
+// GC_add_roots for all required stack roots; except for the DATA and BSS
+// sections that are automatically handled. Nursery collections (see
+// GC_NURSERY_SIZE) also call the callback, from any thread, while holding
+// GC_lock.
 typedef void (*GC_collect_callback_t)(void);
 void GC_register_collect_callback(GC_collect_callback_t);
-void GC_mark_region(void *stack_pointer, void *stack_bottom, const char *source);
+void GC_add_roots(void *stack_pointer, void *stack_bottom, const char *source);
+
+// Same as GC_add_roots but for stacks that may not have changed since the
+// previous collection, for example the stack of an idle fiber. The epoch must
+// change whenever the stack may have been modified (e.g. the fiber was
+// resumed). As long as the stack top and epoch are identical, the collector
+// will mark the HEAP pointers it found during the previous collection instead
+// of scanning the whole stack again.
+void GC_add_cached_roots(void *stack_pointer, void *stack_bottom, const char *source, size_t epoch);
 
 // Returns the total memory mapped for the HEAP, in bytes.
 size_t GC_get_memory_use();
@@ -52,4 +128,17 @@ size_t GC_get_memory_use();
 // Returns the total memory allocated in the HEAP, in bytes.
 size_t GC_get_heap_usage();
 
+// Blacklisting: words found while scanning that point into free memory are
+// remembered until the next collection, and allocations avoid these addresses
+// so they can't be retained by false pointers. Reports the number of free lines
+// withheld from allocation by the last collection, the number of blacklisted
+// addresses into the large object space, and the total number of bytes skipped
+// when allocating large objects.
+void GC_blacklist_stats(size_t *lines, size_t *addresses, size_t *bytes);
+
+// Prints HEAP usage and statistics about the last collection (e.g. time spent
+// scanning each root source) to STDERR. Also printed after each collection when
+// the GC_PRINT_STATS environment variable is set.
+void GC_print_stats();
+
 #endif
@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <assert.h>
 #include "constants.h"
+#include "utils.h"
 
 // 0x 111111             1        1
 //    ^                  ^        ^
@@ -17,6 +18,11 @@ enum LineHeaderFlags {
 
 #define LINE_OBJECT_OFFSET_MARK (uint8_t)0xFC
 
+// the offset of the first object in a line is word aligned, and must fit the 6
+// bits of the header
+GC_STATIC_ASSERT(LINE_SIZE <= 256, line_offsets_fit_the_header);
+GC_STATIC_ASSERT(WORD_SIZE % 4 == 0, line_offsets_leave_the_flag_bits);
+
 static inline void LineHeader_clear(char *flag) {
     *flag = (uint8_t)LINE_EMPTY;
 }
@@ -25,8 +31,10 @@ static inline int LineHeader_isMarked(char *flag) {
     return (*flag & LINE_MARKED) == LINE_MARKED;
 }
 
+// Atomic: the program may concurrently publish the first object of the line
+// (see LineHeader_publishOffset) while a background thread is marking.
 static inline int LineHeader_mark(char *flag) {
-    return *flag |= LINE_MARKED;
+    return __atomic_or_fetch(flag, LINE_MARKED, __ATOMIC_RELAXED);
 }
 
 static inline int LineHeader_unmark(char *flag) {
@@ -34,7 +42,7 @@ static inline int LineHeader_unmark(char *flag) {
 }
 
 static inline int LineHeader_containsObject(char *flag) {
-    return (*flag & LINE_CONTAINS_OBJECT) == LINE_CONTAINS_OBJECT;
+    return (__atomic_load_n(flag, __ATOMIC_ACQUIRE) & LINE_CONTAINS_OBJECT) == LINE_CONTAINS_OBJECT;
 }
 
 static inline void LineHeader_setOffset(char *flag, int offset) {
@@ -44,20 +52,21 @@ static inline void LineHeader_setOffset(char *flag, int offset) {
     *flag = (offset & LINE_OBJECT_OFFSET_MARK) | LINE_CONTAINS_OBJECT;
 }
 
+// Same as LineHeader_setOffset but keeps the mark bit, and publishes the first
+// object of the line to concurrent markers: the object must have been
+// initialized before.
+static inline void LineHeader_publishOffset(char *flag, int offset) {
+    assert(offset % WORD_SIZE == 0);
+    assert(offset >= 0);
+    assert(offset < LINE_SIZE);
+    assert((*flag & LINE_OBJECT_OFFSET_MARK) == 0);
+    __atomic_or_fetch(flag, (offset & LINE_OBJECT_OFFSET_MARK) | LINE_CONTAINS_OBJECT, __ATOMIC_RELEASE);
+}
+
 static inline int LineHeader_getOffset(char *flag) {
     assert(LineHeader_containsObject(flag));
     return (int)(*flag & LINE_OBJECT_OFFSET_MARK);
 }
 
 
-typedef struct GC_Hole {
-    char *limit;
-    struct GC_Hole *next;
-} Hole;
-
-static inline void Hole_init(Hole *self) {
-    self->limit = NULL;
-    self->next = NULL;
-}
-
 #endif
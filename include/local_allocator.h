@@ -2,28 +2,61 @@
 #define GC_LOCAL_ALLOCATOR_H
 
 #include "global_allocator.h"
+#include "nursery.h"
 
-typedef struct GC_LocalAllocator {
-    GlobalAllocator *global_allocator;
-
+// Bump allocates into the holes of a block.
+typedef struct GC_Cursor {
     Block *block;
     char *cursor;
     char *limit;
-    Hole *next;
+    int next_line_index;
+} Cursor;
+
+typedef struct GC_LocalAllocator {
+    GlobalAllocator *global_allocator;
+    Nursery nursery;
+
+    // atomic objects are allocated into their own blocks, so they don't
+    // share cache lines with objects the collector must scan
+    Cursor small;
+    Cursor atomic;
 
     Block *overflow_block;
     char *overflow_cursor;
     char *overflow_limit;
+
+    // medium objects are allocated into the free granules of a medium block
+    // owned by the allocator
+    MediumBlock *medium_block;
+
+    // freed IO buffers (see GC_free_io), oldest first; the collector doesn't
+    // know about them, so collections empty the pool before marking
+    void *io_pool[IO_POOL_SIZE];
+    int io_pool_size;
 } LocalAllocator;
 
 void *GC_LocalAllocator_allocateSmall(LocalAllocator *self, size_t size, int atomic);
+void *GC_LocalAllocator_allocateSmallAligned(LocalAllocator *self, size_t size, size_t alignment, int atomic);
+void *GC_LocalAllocator_allocateMedium(LocalAllocator *self, size_t size, int atomic);
+void GC_LocalAllocator_deallocateSmall(LocalAllocator *self, void *pointer);
+void *GC_LocalAllocator_allocateIo(LocalAllocator *self, size_t size);
+void GC_LocalAllocator_freeIo(LocalAllocator *self, void *pointer);
+void GC_LocalAllocator_releaseIoPool(LocalAllocator *self);
 void GC_LocalAllocator_reset(LocalAllocator *self);
 
 #define LocalAllocator_allocateSmall GC_LocalAllocator_allocateSmall
+#define LocalAllocator_allocateSmallAligned GC_LocalAllocator_allocateSmallAligned
+#define LocalAllocator_allocateMedium GC_LocalAllocator_allocateMedium
+#define LocalAllocator_deallocateSmall GC_LocalAllocator_deallocateSmall
+#define LocalAllocator_allocateIo GC_LocalAllocator_allocateIo
+#define LocalAllocator_freeIo GC_LocalAllocator_freeIo
+#define LocalAllocator_releaseIoPool GC_LocalAllocator_releaseIoPool
 #define LocalAllocator_reset GC_LocalAllocator_reset
 
-static inline void LocalAllocator_init(LocalAllocator *self, GlobalAllocator *global_allocator) {
+static inline void LocalAllocator_init(LocalAllocator *self, GlobalAllocator *global_allocator, size_t nursery_size) {
     self->global_allocator = global_allocator;
+    Nursery_init(&self->nursery, global_allocator, nursery_size);
+    self->io_pool_size = 0;
     LocalAllocator_reset(self);
 }
 
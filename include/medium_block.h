@@ -0,0 +1,279 @@
+#ifndef GC_MEDIUM_BLOCK_H
+#define GC_MEDIUM_BLOCK_H
+
+#include "config.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include "constants.h"
+#include "object.h"
+#include "utils.h"
+
+// Granule bitmaps have one bit per granule.
+#define MEDIUM_GRANULE_WORDS (MEDIUM_GRANULE_COUNT / 64)
+
+// The smallest medium object spans that many granules.
+#define MEDIUM_MINIMUM_GRANULES ((int)(LARGE_OBJECT_SIZE / MEDIUM_GRANULE_SIZE))
+
+GC_STATIC_ASSERT(MEDIUM_GRANULE_COUNT % 64 == 0, medium_granule_bitmaps_are_words);
+GC_STATIC_ASSERT(LARGE_OBJECT_SIZE % MEDIUM_GRANULE_SIZE == 0, medium_objects_are_granules);
+GC_STATIC_ASSERT(LARGE_OBJECT_SIZE < MEDIUM_OBJECT_SIZE, medium_objects_fit_a_block);
+
+// A block of the medium object space. Objects are allocated into runs of free
+// granules, and the collector finds them with the bitmap of the granules that
+// start an object. The first granule is reserved for the block metadata.
+typedef struct GC_MediumBlock {
+    uint8_t marked;
+    uint8_t dirty;
+
+    // the block is in the list of blocks to allocate into (see
+    // GlobalAllocator_nextMediumBlock)
+    uint8_t listed;
+
+    // the largest run of free granules, as of the last sweep, or when an
+    // allocator released the block (deallocations may free larger runs)
+    int16_t largest_run;
+    int free_granules;
+    struct GC_MediumBlock *next;
+
+    // allocated granules (including the reserved granule), and the granules
+    // that start an object
+    uint64_t granules[MEDIUM_GRANULE_WORDS];
+    uint64_t starts[MEDIUM_GRANULE_WORDS];
+} MediumBlock;
+
+GC_STATIC_ASSERT(sizeof(MediumBlock) <= MEDIUM_GRANULE_SIZE, medium_metadata_fit_a_granule);
+
+typedef struct GC_MediumBlockList {
+    MediumBlock *first;
+    MediumBlock *last;
+    size_t size;
+} MediumBlockList;
+
+static inline void MediumBlock_init(MediumBlock *self) {
+    memset((char *)self, 0, sizeof(MediumBlock));
+    self->granules[0] = 1;
+    self->free_granules = MEDIUM_GRANULE_COUNT - 1;
+    self->largest_run = MEDIUM_GRANULE_COUNT - 1;
+}
+
+static inline MediumBlock *MediumBlock_from(void *pointer) {
+    return (MediumBlock *)((uintptr_t)pointer & ~(MEDIUM_BLOCK_SIZE - 1));
+}
+
+// See Block_mark.
+static inline void MediumBlock_mark(MediumBlock *self) {
+    if (!__atomic_load_n(&self->marked, __ATOMIC_RELAXED)) {
+        __atomic_fetch_or(&self->marked, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static inline void MediumBlock_unmark(MediumBlock *self) {
+    self->marked = 0;
+}
+
+static inline int MediumBlock_isMarked(MediumBlock *self) {
+    return self->marked == 1;
+}
+
+// The block contains dirty objects (see Object_setDirty).
+static inline void MediumBlock_setDirty(MediumBlock *self) {
+    self->dirty = 1;
+}
+
+static inline int MediumBlock_isDirty(MediumBlock *self) {
+    return self->dirty;
+}
+
+static inline void MediumBlock_clearDirty(MediumBlock *self) {
+    self->dirty = 0;
+}
+
+static inline int MediumBlock_granuleIndex(MediumBlock *self, void *pointer) {
+    return (int)(((char *)pointer - (char *)self) / MEDIUM_GRANULE_SIZE);
+}
+
+static inline Object *MediumBlock_granule(MediumBlock *self, int index) {
+    return (Object *)((char *)self + (size_t)index * MEDIUM_GRANULE_SIZE);
+}
+
+// Returns how many granules an object of that size (including its header)
+// spans.
+static inline int MediumBlock_granuleCount(size_t size) {
+    return (int)((size + MEDIUM_GRANULE_SIZE - 1) / MEDIUM_GRANULE_SIZE);
+}
+
+// Returns the index of the first granule, from the given granule on, whose bit
+// is set (or unset) in a granule bitmap, or MEDIUM_GRANULE_COUNT if there is
+// none. Deallocations may clear bits concurrently, hence the atomic loads.
+static inline int Granules_find(uint64_t *granules, int index, int set) {
+    for (int word = index / 64; word < MEDIUM_GRANULE_WORDS; word++) {
+        uint64_t bits = __atomic_load_n(granules + word, __ATOMIC_RELAXED);
+        if (!set) bits = ~bits;
+        if (word == index / 64) bits &= ~(uint64_t)0 << (index % 64);
+
+        if (bits != 0) {
+            return word * 64 + __builtin_ctzll(bits);
+        }
+    }
+    return MEDIUM_GRANULE_COUNT;
+}
+
+// Sets (or clears) the bits of count granules from the given granule on.
+static inline void Granules_update(uint64_t *granules, int index, int count, int set) {
+    while (count > 0) {
+        int bit = index % 64;
+        int n = count < 64 - bit ? count : 64 - bit;
+        uint64_t mask = (n == 64 ? ~(uint64_t)0 : ((uint64_t)1 << n) - 1) << bit;
+
+        if (set) {
+            __atomic_fetch_or(granules + index / 64, mask, __ATOMIC_RELAXED);
+        } else {
+            __atomic_fetch_and(granules + index / 64, ~mask, __ATOMIC_RELAXED);
+        }
+        index += n;
+        count -= n;
+    }
+}
+
+// Returns the index of the first granule of the first run of at least count
+// free granules, or MEDIUM_GRANULE_COUNT if there is none.
+static inline int MediumBlock_findRun(MediumBlock *self, int count) {
+    int index = Granules_find(self->granules, 1, 0);
+
+    while (index + count <= MEDIUM_GRANULE_COUNT) {
+        int stop = Granules_find(self->granules, index, 1);
+        if (stop - index >= count) return index;
+        index = Granules_find(self->granules, stop, 0);
+    }
+    return MEDIUM_GRANULE_COUNT;
+}
+
+static inline int MediumBlock_findLargestRun(MediumBlock *self) {
+    int largest = 0;
+    int index = Granules_find(self->granules, 1, 0);
+
+    while (index < MEDIUM_GRANULE_COUNT) {
+        int stop = Granules_find(self->granules, index, 1);
+        if (stop - index > largest) largest = stop - index;
+        index = Granules_find(self->granules, stop, 0);
+    }
+    return largest;
+}
+
+// Allocates count granules (first fit). Returns NULL if there is no run of
+// free granules large enough. The object must be initialized before it's
+// published (see MediumBlock_publish).
+static inline Object *MediumBlock_allocate(MediumBlock *self, int count) {
+    if (self->free_granules < count) return NULL;
+
+    int index = MediumBlock_findRun(self, count);
+    if (index == MEDIUM_GRANULE_COUNT) return NULL;
+
+    Granules_update(self->granules, index, count, 1);
+    __atomic_fetch_sub(&self->free_granules, count, __ATOMIC_RELAXED);
+
+    return MediumBlock_granule(self, index);
+}
+
+// Records the start of an initialized object, so markers can find it
+// (including a background thread, see MediumBlock_findObject).
+static inline void MediumBlock_publish(MediumBlock *self, Object *object) {
+    int index = MediumBlock_granuleIndex(self, object);
+    __atomic_fetch_or(self->starts + index / 64, (uint64_t)1 << (index % 64), __ATOMIC_RELEASE);
+}
+
+static inline void MediumBlock_deallocate(MediumBlock *self, Object *object) {
+    int index = MediumBlock_granuleIndex(self, object);
+    int count = MediumBlock_granuleCount(object->size);
+
+    __atomic_fetch_and(self->starts + index / 64, ~((uint64_t)1 << (index % 64)), __ATOMIC_RELAXED);
+    Granules_update(self->granules, index, count, 0);
+    __atomic_fetch_add(&self->free_granules, count, __ATOMIC_RELAXED);
+}
+
+// Returns the index of the first granule, from the given granule on, that
+// starts an object, or MEDIUM_GRANULE_COUNT. Iterates the objects in the
+// block:
+//
+//     for (int i = MediumBlock_nextObject(block, 1); i < MEDIUM_GRANULE_COUNT; i = MediumBlock_nextObject(block, i + 1))
+static inline int MediumBlock_nextObject(MediumBlock *self, int index) {
+    return Granules_find(self->starts, index, 1);
+}
+
+// Returns the object containing the address, or NULL if the address is in the
+// block metadata, a free granule or the free space after an object.
+static inline Object *MediumBlock_findObject(MediumBlock *self, void *pointer) {
+    int index = MediumBlock_granuleIndex(self, pointer);
+    if (index == 0) return NULL;
+
+    // search the last object that starts before the address
+    for (int word = index / 64; word >= 0; word--) {
+        uint64_t bits = __atomic_load_n(self->starts + word, __ATOMIC_ACQUIRE);
+        if (word == index / 64 && index % 64 != 63) bits &= ((uint64_t)1 << (index % 64 + 1)) - 1;
+
+        if (bits != 0) {
+            Object *object = MediumBlock_granule(self, word * 64 + 63 - __builtin_clzll(bits));
+            size_t size = Object_loadSize(object);
+
+            if ((char *)pointer < (char *)object + size) return object;
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+// Frees the unmarked objects, or every object when the block isn't marked.
+// Returns the number of freed granules.
+static inline int MediumBlock_sweep(MediumBlock *self) {
+    int free_granules = self->free_granules;
+
+    if (!MediumBlock_isMarked(self)) {
+        MediumBlock_init(self);
+    } else {
+        for (int i = MediumBlock_nextObject(self, 1); i < MEDIUM_GRANULE_COUNT; i = MediumBlock_nextObject(self, i + 1)) {
+            Object *object = MediumBlock_granule(self, i);
+            if (!Object_isMarked(object)) MediumBlock_deallocate(self, object);
+        }
+        self->largest_run = (int16_t)MediumBlock_findLargestRun(self);
+    }
+    return self->free_granules - free_granules;
+}
+
+static inline void MediumBlockList_clear(MediumBlockList *self) {
+    self->first = NULL;
+    self->last = NULL;
+    self->size = 0;
+}
+
+static inline void MediumBlockList_push(MediumBlockList *self, MediumBlock *block) {
+    block->next = NULL;
+    block->listed = 1;
+
+    if (self->first == NULL) {
+        self->first = block;
+    } else {
+        self->last->next = block;
+    }
+    self->last = block;
+    self->size++;
+}
+
+// Removes the block that follows previous (or the first block when previous
+// is NULL) from the list.
+static inline void MediumBlockList_remove(MediumBlockList *self, MediumBlock *previous, MediumBlock *block) {
+    if (previous == NULL) {
+        self->first = block->next;
+    } else {
+        previous->next = block->next;
+    }
+    if (self->last == block) {
+        self->last = previous;
+    }
+    block->next = NULL;
+    block->listed = 0;
+    self->size--;
+}
+
+#endif
@@ -9,6 +9,7 @@
 #include <sys/mman.h>
 #include <unistd.h>
 #include "constants.h"
+#include "utils.h"
 
 #define MEM_PROT (PROT_READ | PROT_WRITE)
 #define MEM_FLAGS (MAP_NORESERVE | MAP_PRIVATE | MAP_ANONYMOUS)
@@ -24,16 +25,25 @@ static inline void *GC_map(size_t memory_limit) {
     return addr;
 }
 
+// Maps memory_limit bytes starting at a multiple of alignment_size (a power of
+// 2). Reserves a little more, so the aligned range is always mapped.
 static inline void *GC_mapAndAlign(size_t memory_limit, size_t alignment_size) {
-    void *start = GC_map(memory_limit);
-    size_t alignment_mask = ~(alignment_size - 1);
+    void *start = GC_map(memory_limit + alignment_size);
+    return (void *)ROUND_TO_NEXT_MULTIPLE((uintptr_t)start, alignment_size);
+}
 
-    if (((uintptr_t)start & alignment_mask) != (uintptr_t)start) {
-        void* previous_block = (void*)((uintptr_t)start & BLOCK_SIZE_IN_BYTES_INVERSE_MASK);
-        start = (char*)previous_block + BLOCK_SIZE;
-    }
+static inline size_t GC_getPageSize() {
+    return (size_t)sysconf(_SC_PAGESIZE);
+}
 
-    return start;
+// Hands the pages back to the kernel, that reclaims them lazily (MADV_FREE),
+// or immediately on systems without MADV_FREE. The pages stay mapped, and read
+// either their previous contents or zeroes.
+static inline void GC_release(void *start, size_t size) {
+#ifdef MADV_FREE
+    if (madvise(start, size, MADV_FREE) == 0) return;
+#endif
+    madvise(start, size, MADV_DONTNEED);
 }
 
 static inline size_t GC_getMemoryLimit() {
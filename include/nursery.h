@@ -0,0 +1,92 @@
+#ifndef GC_NURSERY_H
+#define GC_NURSERY_H
+
+#include <pthread.h>
+#include "block_list.h"
+#include "global_allocator.h"
+#include "roots.h"
+#include "stack.h"
+
+// Thread-local nursery: a few free blocks that a single thread allocates its
+// small objects into. The objects are local to the thread until they escape
+// (see Nursery_publish), so the thread can collect its nursery without
+// stopping the other threads: the roots are the current stack (the thread
+// stack, or a fiber stack, see GC_set_stackbottom), the DATA and BSS sections,
+// the objects that escaped and the roots of global collections (the other
+// stacks, extra roots and pinned roots, see GC_nursery_roots).
+//
+// A global collection releases the nursery blocks into the shared heap. An
+// unproductive nursery collection (most objects survived) also releases the
+// nursery, then starts a new one.
+typedef struct GC_Nursery {
+    GlobalAllocator *global_allocator;
+
+    BlockList blocks;
+    Block *current;
+    size_t block_limit;
+
+    // a global collection must wait for a nursery collection to complete
+    pthread_mutex_t mutex;
+
+    // the thread stack (unknown when NULL)
+    char *stack_start;
+    char *stack_stop;
+
+    // the bottom of the stack the thread switched to, for example a fiber
+    // stack (see GC_set_stackbottom)
+    char *stack_bottom;
+
+    // mark stack of nursery collections, also used to publish objects
+    Stack stack;
+    size_t stack_capacity;
+
+    size_t collections;
+    uint64_t nanoseconds;
+    size_t freed_bytes;
+    size_t published_bytes;
+    size_t released_blocks;
+} Nursery;
+
+void GC_Nursery_init(Nursery *self, GlobalAllocator *global_allocator, size_t size);
+void GC_Nursery_deinit(Nursery *self);
+void GC_Nursery_reset(Nursery *self);
+Block *GC_Nursery_nextBlock(Nursery *self);
+void GC_Nursery_publish(Nursery *self, Object *object);
+void GC_Nursery_publishReferences(Nursery *self, Object *object);
+
+// Defined by the GC (see immix.c): registers the roots of global collections
+// into the collector (see Collector_addNurseryRoots) and returns them. The
+// caller must hold GC_lock and clear the roots once scanned.
+Roots *GC_nursery_roots();
+
+#define Nursery_init GC_Nursery_init
+#define Nursery_deinit GC_Nursery_deinit
+#define Nursery_reset GC_Nursery_reset
+#define Nursery_nextBlock GC_Nursery_nextBlock
+#define Nursery_publish GC_Nursery_publish
+#define Nursery_publishReferences GC_Nursery_publishReferences
+
+static inline int Nursery_isEnabled(Nursery *self) {
+    return self->block_limit > 0;
+}
+
+// Returns true if the pointer points into a block of the nursery.
+static inline int Nursery_contains(Nursery *self, void *pointer) {
+    return GlobalAllocator_inSmallHeap(self->global_allocator, pointer) &&
+        Block_from(pointer)->owner == self;
+}
+
+// Returns true if the object was allocated in the nursery and didn't escape.
+static inline int Nursery_isLocal(Nursery *self, Object *object) {
+    return Nursery_contains(self, object) && !Object_isShared(object);
+}
+
+static inline void Nursery_lock(Nursery *self) {
+    pthread_mutex_lock(&self->mutex);
+}
+
+static inline void Nursery_unlock(Nursery *self) {
+    pthread_mutex_unlock(&self->mutex);
+}
+
+#endif
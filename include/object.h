@@ -4,10 +4,29 @@
 #include <stddef.h>
 #include <stdint.h>
 
+// Object flags, that are rarely set (see Object_setFlag).
+#define OBJECT_FLAG_BASE_ONLY 0x1
+#define OBJECT_FLAG_SHARED 0x2
+#define OBJECT_FLAG_PINNED 0x4
+#define OBJECT_FLAG_FORWARDED 0x8
+#define OBJECT_FLAG_FINALIZER 0x10
+#define OBJECT_FLAG_LARGE 0x20
+#define OBJECT_FLAG_ALIGNED 0x40
+#define OBJECT_FLAG_PINNED_ROOT 0x80
+
+// The flags are all taken: fillers are tagged in the atomic byte instead (see
+// Object_allocateFiller).
+#define OBJECT_FILLER 2
+
+// The object header is 8 bytes. Small and medium objects are smaller than
+// 4GB; large objects keep their size in the chunk header, right before the
+// object header (see Chunk and Object_size).
 typedef struct {
-    size_t size;
+    uint32_t size;
     uint8_t marked;
     uint8_t atomic;
+    uint8_t dirty;
+    uint8_t flags;
 } Object;
 
 //static inline void Object_init(Object* object) {
@@ -17,24 +36,90 @@ typedef struct {
 //}
 
 static inline void Object_allocate(Object* object, size_t size, int atomic) {
-    object->size = size;
+    object->marked = 0;
     object->atomic = atomic;
+    object->dirty = 0;
+    object->flags = 0;
+
+    // publish the object to concurrent markers (see Object_loadSize)
+    __atomic_store_n(&object->size, (uint32_t)size, __ATOMIC_RELEASE);
 }
 
-static inline void* Object_mutatorAddress(Object* object) {
-    return (char *)object + sizeof(Object);
+// A dead atomic object that holds no program data: the padding before an
+// aligned object (see LocalAllocator_fill) or a freed object (see GC_free).
+// It's never scanned, and the next collection frees it.
+static inline void Object_allocateFiller(Object* object, size_t size) {
+    Object_allocate(object, size, OBJECT_FILLER);
 }
 
-// Returns the mutator size, not counting the object metadata.
-static inline size_t Object_mutatorSize(Object* object) {
-    return object->size - sizeof(Object);
+static inline int Object_isFiller(Object* object) {
+    return object->atomic == OBJECT_FILLER;
+}
+
+// Loads the size of a small or medium object when the object may be
+// concurrently allocated, for example when a background thread is marking.
+static inline size_t Object_loadSize(Object* object) {
+    return __atomic_load_n(&object->size, __ATOMIC_ACQUIRE);
+}
+
+// GC workers may set flags of different objects in parallel (e.g. pinning), and
+// the program may set flags while a background thread is marking, hence the
+// atomics.
+static inline void Object_setFlag(Object* object, uint8_t flag) {
+    __atomic_fetch_or(&object->flags, flag, __ATOMIC_RELAXED);
+}
+
+static inline void Object_clearFlag(Object* object, uint8_t flag) {
+    __atomic_fetch_and(&object->flags, (uint8_t)~flag, __ATOMIC_RELAXED);
+}
+
+static inline int Object_hasFlag(Object* object, uint8_t flag) {
+    return (object->flags & flag) != 0;
+}
+
+// Only pointers to the start of the object (or a registered displacement) will
+// keep the object alive, interior pointers will be ignored.
+static inline void Object_setBaseOnly(Object* object) {
+    Object_setFlag(object, OBJECT_FLAG_BASE_ONLY);
+}
+
+static inline int Object_isBaseOnly(Object* object) {
+    return Object_hasFlag(object, OBJECT_FLAG_BASE_ONLY);
+}
+
+// The object has a finalizer, so we don't search the finalizers of the
+// objects that don't.
+static inline void Object_setFinalizer(Object* object) {
+    Object_setFlag(object, OBJECT_FLAG_FINALIZER);
+}
+
+static inline int Object_hasFinalizer(Object* object) {
+    return Object_hasFlag(object, OBJECT_FLAG_FINALIZER);
+}
+
+static inline void Object_clearFinalizer(Object* object) {
+    Object_clearFlag(object, OBJECT_FLAG_FINALIZER);
+}
+
+static inline int Object_isLarge(Object* object) {
+    return Object_hasFlag(object, OBJECT_FLAG_LARGE);
+}
+
+static inline void* Object_mutatorAddress(Object* object) {
+    return (char *)object + sizeof(Object);
 }
 
 // Returns the object size, counting the object metadata and the mutator size.
 static inline size_t Object_size(Object* object) {
+    if (Object_isLarge(object)) return ((size_t *)object)[-1];
     return object->size;
 }
 
+// Returns the mutator size, not counting the object metadata.
+static inline size_t Object_mutatorSize(Object* object) {
+    return Object_size(object) - sizeof(Object);
+}
+
 static inline size_t Object_isMarked(Object* object) {
     return object->marked == 1;
 }
@@ -43,13 +128,100 @@ static inline size_t Object_mark(Object* object) {
     return object->marked = 1;
 }
 
+// Marks the object. Returns true if the object wasn't marked yet, false if it
+// was already marked (e.g. by another marker thread).
+static inline int Object_tryMark(Object* object) {
+    return __atomic_exchange_n(&object->marked, 1, __ATOMIC_RELAXED) == 0;
+}
+
 static inline size_t Object_unmark(Object* object) {
     return object->marked = 0;
 }
 
+// Write barrier: the object was modified while the collector was marking, and
+// must be scanned again before the collection completes.
+static inline void Object_setDirty(Object* object) {
+    object->dirty = 1;
+}
+
+static inline int Object_isDirty(Object* object) {
+    return object->dirty;
+}
+
+static inline void Object_clearDirty(Object* object) {
+    object->dirty = 0;
+}
+
+// Thread-local nursery: the object escaped the thread that allocated it (see
+// Nursery_publish) and can only be collected by a global collection.
+static inline void Object_setShared(Object* object) {
+    Object_setFlag(object, OBJECT_FLAG_SHARED);
+}
+
+static inline int Object_isShared(Object* object) {
+    return Object_hasFlag(object, OBJECT_FLAG_SHARED);
+}
+
+// Evacuation: the object is referenced from a conservative root (stack, DATA
+// or BSS section) and can't be moved. Called by GC workers during marking.
+static inline void Object_pin(Object* object) {
+    Object_setFlag(object, OBJECT_FLAG_PINNED);
+}
+
+static inline int Object_isPinned(Object* object) {
+    return Object_hasFlag(object, OBJECT_FLAG_PINNED);
+}
+
+static inline void Object_unpin(Object* object) {
+    Object_clearFlag(object, OBJECT_FLAG_PINNED);
+}
+
+// The program pinned the object (see GC_pin): the object is a root until it's
+// unpinned, and never moves.
+static inline void Object_setPinnedRoot(Object* object) {
+    Object_setFlag(object, OBJECT_FLAG_PINNED_ROOT);
+}
+
+static inline int Object_isPinnedRoot(Object* object) {
+    return Object_hasFlag(object, OBJECT_FLAG_PINNED_ROOT);
+}
+
+static inline void Object_clearPinnedRoot(Object* object) {
+    Object_clearFlag(object, OBJECT_FLAG_PINNED_ROOT);
+}
+
+// The mutator address was allocated with an alignment (see GC_memalign), so
+// evacuation never moves the object.
+static inline void Object_setAligned(Object* object) {
+    Object_setFlag(object, OBJECT_FLAG_ALIGNED);
+}
+
+static inline int Object_isAligned(Object* object) {
+    return Object_hasFlag(object, OBJECT_FLAG_ALIGNED);
+}
+
+// Evacuation: the object was copied; the first word of the mutator holds the
+// address of the copy until the collection completes.
+static inline void Object_forward(Object* object, Object* copy) {
+    Object_setFlag(object, OBJECT_FLAG_FORWARDED);
+    *(Object **)Object_mutatorAddress(object) = copy;
+}
+
+static inline int Object_isForwarded(Object* object) {
+    return Object_hasFlag(object, OBJECT_FLAG_FORWARDED);
+}
+
+static inline Object *Object_forwardee(Object* object) {
+    return *(Object **)Object_mutatorAddress(object);
+}
+
+static inline void Object_clearForwarded(Object* object) {
+    Object_clearFlag(object, OBJECT_FLAG_FORWARDED);
+}
+
 static inline size_t Object_contains(Object* object, char *pointer) {
     return pointer >= (char *)Object_mutatorAddress(object) &&
-        pointer < (char *)object + object->size;
+        pointer < (char *)object + Object_size(object);
 }
 
 #endif
@@ -67,4 +67,58 @@ static inline size_t GC_freeSpaceDivisor() {
     return GC_getIntegerFromEnvironmentVariable("GC_FREE_SPACE_DIVISOR", GC_FREE_SPACE_DIVISOR);
 }
 
+static inline int GC_workers() {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count < 1) count = 1;
+
+    count = GC_getIntegerFromEnvironmentVariable("GC_WORKERS", count);
+    if (count < 1) count = 1;
+
+    return (int)count;
+}
+
+static inline int GC_interiorPointers() {
+    return GC_getIntegerFromEnvironmentVariable("GC_INTERIOR_POINTERS", GC_INTERIOR_POINTERS) != 0;
+}
+
+static inline int GC_incremental() {
+    return GC_getIntegerFromEnvironmentVariable("GC_INCREMENTAL", GC_INCREMENTAL) != 0;
+}
+
+static inline int GC_concurrent() {
+    return GC_getIntegerFromEnvironmentVariable("GC_CONCURRENT", GC_CONCURRENT) != 0;
+}
+
+static inline int GC_generational() {
+    return GC_getIntegerFromEnvironmentVariable("GC_GENERATIONAL", GC_GENERATIONAL) != 0;
+}
+
+static inline size_t GC_incrementalStep() {
+    return GC_getSizeFromEnvironmentVariable("GC_INCREMENTAL_STEP", GC_INCREMENTAL_STEP);
+}
+
+static inline size_t GC_nurserySize() {
+    return GC_getSizeFromEnvironmentVariable("GC_NURSERY_SIZE", GC_NURSERY_SIZE);
+}
+
+static inline int GC_evacuate() {
+    return GC_getIntegerFromEnvironmentVariable("GC_EVACUATE", GC_EVACUATE) != 0;
+}
+
+static inline int GC_lazySweep() {
+    return GC_getIntegerFromEnvironmentVariable("GC_LAZY_SWEEP", GC_LAZY_SWEEP) != 0;
+}
+
+static inline int GC_exactLineMarking() {
+    return GC_getIntegerFromEnvironmentVariable("GC_EXACT_LINE_MARKING", GC_EXACT_LINE_MARKING) != 0;
+}
+
+static inline int GC_concurrentSweep() {
+    return GC_getIntegerFromEnvironmentVariable("GC_CONCURRENT_SWEEP", GC_CONCURRENT_SWEEP) != 0;
+}
+
+static inline int GC_printStats() {
+    return GC_getIntegerFromEnvironmentVariable("GC_PRINT_STATS", 0) != 0;
+}
+
 #endif
@@ -0,0 +1,82 @@
+#ifndef GC_ROOT_SOURCES_H
+#define GC_ROOT_SOURCES_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define ROOT_SOURCES_MAX 16
+
+// Statistics about scanned root regions, aggregated by source (e.g. ".data",
+// ".bss", "fiber").
+typedef struct {
+    const char *name;
+    size_t count;
+    size_t bytes;
+    uint64_t nanoseconds;
+} RootSource;
+
+// The last entry is reserved to aggregate the sources that don't fit (and the
+// "other" source): size counts the other entries.
+typedef struct {
+    RootSource entries[ROOT_SOURCES_MAX];
+    int size;
+} RootSources;
+
+static inline void RootSource_init(RootSource *self, const char *name) {
+    self->name = name;
+    self->count = 0;
+    self->bytes = 0;
+    self->nanoseconds = 0;
+}
+
+static inline void RootSources_clear(RootSources *self) {
+    self->size = 0;
+    RootSource_init(self->entries + ROOT_SOURCES_MAX - 1, "other");
+}
+
+static inline RootSource *RootSources_other(RootSources *self) {
+    return self->entries + ROOT_SOURCES_MAX - 1;
+}
+
+static inline RootSource *RootSources_find(RootSources *self, const char *name) {
+    if (name == NULL) {
+        name = "unknown";
+    }
+
+    for (int i = 0; i < self->size; i++) {
+        RootSource *entry = self->entries + i;
+        if (entry->name == name || strcmp(entry->name, name) == 0) {
+            return entry;
+        }
+    }
+
+    // too many sources: aggregate into the reserved entry
+    if (self->size == ROOT_SOURCES_MAX - 1 || strcmp(name, "other") == 0) {
+        return RootSources_other(self);
+    }
+
+    RootSource *entry = self->entries + self->size++;
+    RootSource_init(entry, name);
+    return entry;
+}
+
+static inline void RootSources_add(RootSources *self, const char *name, size_t count, size_t bytes, uint64_t nanoseconds) {
+    RootSource *entry = RootSources_find(self, name);
+    entry->count += count;
+    entry->bytes += bytes;
+    entry->nanoseconds += nanoseconds;
+}
+
+static inline void RootSources_merge(RootSources *self, RootSources *other) {
+    for (int i = 0; i < other->size; i++) {
+        RootSource *entry = other->entries + i;
+        RootSources_add(self, entry->name, entry->count, entry->bytes, entry->nanoseconds);
+    }
+
+    RootSource *entry = RootSources_other(other);
+    if (entry->count > 0) {
+        RootSources_add(self, entry->name, entry->count, entry->bytes, entry->nanoseconds);
+    }
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef GC_ROOTS_H
+#define GC_ROOTS_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "stack_roots.h"
+
+// A region of memory to scan for pointers into the HEAP, for example a fiber
+// stack or the DATA section. Pointers found while scanning the region are
+// recorded into `stack_roots` when set.
+typedef struct {
+    void *top;
+    void *bottom;
+    const char *source;
+    StackRoots *stack_roots;
+} Root;
+
+// List of root regions registered for a collection. Regions are claimed one at
+// a time by the markers, which allows to scan them in parallel. The list
+// grows as needed: there can be as many regions as fibers.
+typedef struct {
+    Root *buffer;
+    Root *cursor;
+    Root *limit;
+    size_t next;
+} Roots;
+
+static inline void Roots_resize(Roots *self, size_t capacity) {
+    size_t size = self->cursor - self->buffer;
+
+    self->buffer = realloc(self->buffer, sizeof(Root) * capacity);
+    if (self->buffer == NULL) {
+        perror("GC: realloc");
+        abort();
+    }
+    self->cursor = self->buffer + size;
+    self->limit = self->buffer + capacity;
+}
+
+static inline void Roots_init(Roots *self, size_t capacity) {
+    self->buffer = NULL;
+    self->cursor = NULL;
+    Roots_resize(self, capacity);
+    self->next = 0;
+}
+
+static inline size_t Roots_size(Roots *self) {
+    return self->cursor - self->buffer;
+}
+
+static inline int Roots_isEmpty(Roots *self) {
+    return self->cursor == self->buffer;
+}
+
+// Regions are pushed before the markers start claiming them (the buffer may
+// move).
+static inline void Roots_push(Roots *self, void *top, void *bottom, const char *source, StackRoots *stack_roots) {
+    if (self->cursor == self->limit) {
+        Roots_resize(self, (self->limit - self->buffer) * 2);
+    }
+    self->cursor->top = top;
+    self->cursor->bottom = bottom;
+    self->cursor->source = source;
+    self->cursor->stack_roots = stack_roots;
+    self->cursor++;
+}
+
+// Returns the next unclaimed region, or NULL when all regions have been
+// claimed. Safe to call concurrently.
+static inline Root *Roots_claim(Roots *self) {
+    size_t index = __atomic_fetch_add(&self->next, 1, __ATOMIC_RELAXED);
+    if (index < Roots_size(self)) {
+        return self->buffer + index;
+    }
+    return NULL;
+}
+
+static inline void Roots_clear(Roots *self) {
+    self->cursor = self->buffer;
+    self->next = 0;
+}
+
+#endif
@@ -1,21 +1,27 @@
 #ifndef GC_STACK_H
 #define GC_STACK_H
 
+#include <assert.h>
+#include <string.h>
 #include "memory.h"
 
 typedef struct {
     void **buffer;
     void **cursor;
+    void **limit;
 } Stack;
 
 static void Stack_init(Stack *, size_t) __attribute__((__unused__));
 static void Stack_push(Stack *, void *, void *) __attribute__((__unused__));
 static int Stack_pop(Stack *, void **, void **) __attribute__((__unused__));
 static size_t Stack_size(Stack *) __attribute__((__unused__));
+static int Stack_isFull(Stack *) __attribute__((__unused__));
+static size_t Stack_transfer(Stack *, Stack *, size_t) __attribute__((__unused__));
 
 static void Stack_init(Stack *self, size_t capacity) {
     self->buffer = GC_map(sizeof(void *) * capacity * 2);
     self->cursor = self->buffer;
+    self->limit = self->buffer + capacity * 2;
 }
 
 static size_t Stack_size(Stack *self) {
@@ -26,7 +32,12 @@ static int Stack_isEmpty(Stack *self) {
     return self->cursor == self->buffer;
 }
 
+static int Stack_isFull(Stack *self) {
+    return self->cursor == self->limit;
+}
+
 static void Stack_push(Stack *self, void *sp, void *bottom) {
+    assert(!Stack_isFull(self));
     self->cursor[0] = sp;
     self->cursor[1] = bottom;
     self->cursor += 2;
@@ -44,4 +55,17 @@ static int Stack_pop(Stack *self, void **sp, void **bottom) {
     return 1;
 }
 
+// Moves up to `count` regions from the top of the stack to the other stack,
+// as many as it can hold. Returns the number of regions moved.
+static size_t Stack_transfer(Stack *self, Stack *other, size_t count) {
+    size_t available = (other->limit - other->cursor) / 2;
+    if (count > available) count = available;
+    if (count > Stack_size(self)) count = Stack_size(self);
+
+    self->cursor -= count * 2;
+    memcpy(other->cursor, self->cursor, sizeof(void *) * count * 2);
+    other->cursor += count * 2;
+    return count;
+}
+
 #endif
@@ -0,0 +1,62 @@
+#ifndef GC_STACK_ROOTS_H
+#define GC_STACK_ROOTS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "array.h"
+
+// Records the HEAP pointers found when scanning a fiber stack. As long as the
+// fiber didn't run (same epoch, same stack top) and the HEAP didn't grow since
+// the last collection, the stack can't reference anything else, and marking
+// the recorded pointers is equivalent to scanning the whole stack again.
+typedef struct {
+    void *top;
+    size_t epoch;
+    size_t heap_size;
+    int seen;
+    Array pointers;
+} StackRoots;
+
+static inline void StackRoots_reset(StackRoots *self, void *top, size_t epoch, size_t heap_size) {
+    self->top = top;
+    self->epoch = epoch;
+    self->heap_size = heap_size;
+    Array_clear(&self->pointers);
+}
+
+static inline StackRoots *StackRoots_create(void *top, size_t epoch, size_t heap_size) {
+    StackRoots *self = malloc(sizeof(StackRoots));
+    if (self == NULL) {
+        fprintf(stderr, "GC: malloc failed\n");
+        abort();
+    }
+    self->seen = 0;
+    Array_init(&self->pointers, 16l);
+    StackRoots_reset(self, top, epoch, heap_size);
+    return self;
+}
+
+static inline void StackRoots_free(StackRoots *self) {
+    free(self->pointers.buffer);
+    free(self);
+}
+
+static inline int StackRoots_isValid(StackRoots *self, void *top, size_t epoch, size_t heap_size) {
+    return self->top == top && self->epoch == epoch && self->heap_size == heap_size;
+}
+
+static inline void StackRoots_record(StackRoots *self, void *pointer) {
+    Array_push(&self->pointers, pointer);
+}
+
+// Returns the recorded pointers as a region that can be scanned as any other
+// root region.
+static inline void **StackRoots_start(StackRoots *self) {
+    return self->pointers.buffer;
+}
+
+static inline void **StackRoots_stop(StackRoots *self) {
+    return self->pointers.cursor;
+}
+
+#endif
@@ -1,9 +1,26 @@
 #ifndef GC_UTILS_H
 #define GC_UTILS_H
 
+#include <stdint.h>
+#include <time.h>
+
 #define ROUND_TO_NEXT_MULTIPLE(size, multiple) \
     (((size) + (multiple) - 1) / (multiple) * (multiple))
 
+#define IS_POWER_OF_TWO(value) \
+    ((value) != 0 && ((value) & ((value) - 1)) == 0)
+
+// Fails to compile when the condition is false (C99 has no _Static_assert).
+#define GC_STATIC_ASSERT(condition, name) \
+    typedef char GC_static_assert_##name[(condition) ? 1 : -1]
+
+// Returns a monotonic time in nanoseconds.
+static inline uint64_t GC_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
 #ifdef GC_DEBUG
 #define DEBUG(...) fprintf(stderr, __VA_ARGS__)
 #else
@@ -0,0 +1,37 @@
+#ifndef GC_WORKERS_H
+#define GC_WORKERS_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+typedef void (*worker_task_t)(void *data, int index);
+
+// A pool of GC threads. Running a task executes it once for each worker index,
+// the calling thread acting as the worker 0, and returns once all workers are
+// done. Threads are started on the first run.
+typedef struct GC_Workers {
+    int count;
+    int started;
+    pthread_t *threads;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t start;
+    pthread_cond_t done;
+
+    worker_task_t task;
+    void *data;
+    size_t generation;
+    int pending;
+} Workers;
+
+void GC_Workers_init(Workers *self, int count);
+void GC_Workers_run(Workers *self, worker_task_t task, void *data);
+
+static inline int Workers_count(Workers *self) {
+    return self->count;
+}
+
+#define Workers_init GC_Workers_init
+#define Workers_run GC_Workers_run
+
+#endif
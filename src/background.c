@@ -0,0 +1,97 @@
+#include "config.h"
+
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "background.h"
+
+static Background *GC_background;
+
+static void *Background_loop(void *data) {
+    Background *self = data;
+
+    pthread_mutex_lock(&self->mutex);
+
+    while (1) {
+        while (!self->running) {
+            pthread_cond_wait(&self->cond, &self->mutex);
+        }
+
+        pthread_mutex_unlock(&self->mutex);
+        self->task(self->data);
+        pthread_mutex_lock(&self->mutex);
+
+        __atomic_store_n(&self->running, 0, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&self->cond);
+    }
+
+    return NULL;
+}
+
+static void Background_start(Background *self) {
+    // GC threads must never handle signals (see Workers_start):
+    sigset_t set, previous;
+    sigfillset(&set);
+    pthread_sigmask(SIG_SETMASK, &set, &previous);
+
+    int err = pthread_create(&self->thread, NULL, Background_loop, self);
+    if (err) {
+        fprintf(stderr, "GC: pthread_create failed: %s\n", strerror(err));
+        abort();
+    }
+
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    self->started = 1;
+}
+
+// The thread doesn't survive fork(2): the child process will start a new
+// thread if it ever needs it.
+static void Background_atforkChild() {
+    Background *self = GC_background;
+    pthread_mutex_init(&self->mutex, NULL);
+    pthread_cond_init(&self->cond, NULL);
+    self->running = 0;
+    self->stopping = 0;
+    self->started = 0;
+}
+
+void GC_Background_init(Background *self) {
+    self->started = 0;
+
+    pthread_mutex_init(&self->mutex, NULL);
+    pthread_cond_init(&self->cond, NULL);
+
+    self->task = NULL;
+    self->data = NULL;
+    self->running = 0;
+    self->stopping = 0;
+
+    GC_background = self;
+    pthread_atfork(NULL, NULL, Background_atforkChild);
+}
+
+void GC_Background_run(Background *self, background_task_t task, void *data) {
+    if (!self->started) {
+        Background_start(self);
+    }
+
+    pthread_mutex_lock(&self->mutex);
+    self->task = task;
+    self->data = data;
+    __atomic_store_n(&self->stopping, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&self->running, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&self->cond);
+    pthread_mutex_unlock(&self->mutex);
+}
+
+// Asks the task to stop, and waits for it to return.
+void GC_Background_stop(Background *self) {
+    pthread_mutex_lock(&self->mutex);
+    __atomic_store_n(&self->stopping, 1, __ATOMIC_RELEASE);
+
+    while (self->running) {
+        pthread_cond_wait(&self->cond, &self->mutex);
+    }
+    pthread_mutex_unlock(&self->mutex);
+}
@@ -2,24 +2,79 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "collector.h"
 #include "line_header.h"
 #include "memory.h"
+#include "options.h"
+#include "stack_roots.h"
 #include "utils.h"
 
-void GC_Collector_init(Collector *self, GlobalAllocator *allocator) {
+void GC_Collector_init(Collector *self, GlobalAllocator *allocator, int workers, int interior_pointers, int concurrent) {
     self->global_allocator = allocator;
     self->collect_callback = NULL;
-    Stack_init(&self->roots, GC_getMemoryLimit());
+    Roots_init(&self->roots, 64);
+    self->stack_roots = Hash_create(64);
+    self->nursery_roots = 0;
+    Array_init(&self->pinned_roots, 16l);
+
+    Workers_init(&self->workers, workers);
+    self->markers = calloc(workers, sizeof(Marker));
+    if (self->markers == NULL) {
+        fprintf(stderr, "GC: calloc failed\n");
+        abort();
+    }
+    for (int i = 0; i < workers; i++) {
+        Marker *marker = self->markers + i;
+        marker->collector = self;
+        marker->global_allocator = allocator;
+        Stack_init(&marker->stack, MARK_STACK_CAPACITY);
+        RootSources_clear(&marker->sources);
+    }
+    Stack_init(&self->overflow_stack, GC_getMemoryLimit() / sizeof(Object));
+    pthread_mutex_init(&self->overflow_mutex, NULL);
+    RootSources_clear(&self->sources);
+    self->heap_nanoseconds = 0;
+    self->mark_nanoseconds = 0;
+    self->ignored_pointers = 0;
+    self->marked_bytes = 0;
+    self->minor = 0;
+
+    self->interior_pointers = interior_pointers;
+    self->displacement_count = 0;
+
+    self->incremental_step = GC_incrementalStep();
+    self->concurrent = concurrent;
+    Background_init(&self->background);
+    self->background_nanoseconds = 0;
+    self->step_count = 0;
+    self->step_max_nanoseconds = 0;
+    self->final_nanoseconds = 0;
+
+    self->evacuation_cursor = NULL;
+    self->evacuation_limit = NULL;
+    self->evacuation_candidates = 0;
+    self->evacuated_objects = 0;
+    self->evacuated_bytes = 0;
+    self->pinned_objects = 0;
+    self->evacuation_nanoseconds = 0;
+    self->sweep_nanoseconds = 0;
+    self->sweepers = NULL;
+    self->sweeper_capacity = 0;
+    self->sweep_range_count = 0;
+    self->next_sweep_range = 0;
+
     self->is_collecting = 0;
 }
 
 static inline void Collector_unmarkSmallObjects(Collector *self) {
-    Block *block = self->global_allocator->small_heap_start;
-    Block *stop = self->global_allocator->small_heap_stop;
+    Block *block = Block_first(self->global_allocator->small_heap_start);
+    Block *stop = Block_from(self->global_allocator->small_heap_stop);
 
     while (block < stop) {
         Block_unmark(block);
+        Block_clearBlacklist(block);
+        Block_clearDirty(block);
 
         char *line_headers = Block_lineHeaders(block);
 
@@ -36,13 +91,30 @@ static inline void Collector_unmarkSmallObjects(Collector *self) {
                     if (object->size == 0) break;
 
                     Object_unmark(object);
+                    Object_clearDirty(object);
 
                     offset = offset + object->size;
                 }
             }
         }
 
-        block = (Block *)((char *)block + BLOCK_SIZE);
+        block = Block_next(block);
+    }
+}
+
+static inline void Collector_unmarkMediumObjects(Collector *self) {
+    MediumBlock *block = self->global_allocator->medium_heap_start;
+    MediumBlock *stop = self->global_allocator->medium_heap_stop;
+
+    for (; block < stop; block = (MediumBlock *)((char *)block + MEDIUM_BLOCK_SIZE)) {
+        MediumBlock_unmark(block);
+        MediumBlock_clearDirty(block);
+
+        for (int i = MediumBlock_nextObject(block, 1); i < MEDIUM_GRANULE_COUNT; i = MediumBlock_nextObject(block, i + 1)) {
+            Object *object = MediumBlock_granule(block, i);
+            Object_unmark(object);
+            Object_clearDirty(object);
+        }
     }
 }
 
@@ -50,38 +122,164 @@ static inline void Collector_unmarkLargeObjects(Collector *self) {
     Chunk *chunk = self->global_allocator->large_chunk_list.first;
     while (chunk != NULL) {
         Chunk_unmark(chunk);
+        Object_clearDirty(&chunk->object);
         chunk = chunk->next;
     }
 }
 
-static inline void Collector_scanObject(Collector *self, Object *object) {
+// Full mark stack (e.g. an array with lots of references): moves half the
+// stack to the overflow stack, where workers take regions from once their
+// own stack is empty.
+static inline void Marker_push(Marker *self, void *sp, void *bottom) {
+    if (Stack_isFull(&self->stack)) {
+        Collector *collector = self->collector;
+        pthread_mutex_lock(&collector->overflow_mutex);
+        Stack_transfer(&self->stack, &collector->overflow_stack, MARK_STACK_CAPACITY / 2);
+        pthread_mutex_unlock(&collector->overflow_mutex);
+    }
+    Stack_push(&self->stack, sp, bottom);
+}
+
+// Refills an empty mark stack from the overflow stack. Returns false when
+// there is nothing left to scan.
+static inline int Marker_refill(Marker *self) {
+    if (Stack_isEmpty(&self->stack)) {
+        Collector *collector = self->collector;
+        pthread_mutex_lock(&collector->overflow_mutex);
+        Stack_transfer(&collector->overflow_stack, &self->stack, MARK_STACK_CAPACITY / 2);
+        pthread_mutex_unlock(&collector->overflow_mutex);
+    }
+    return !Stack_isEmpty(&self->stack);
+}
+
+static inline int Marker_pop(Marker *self, void **sp, void **bottom) {
+    return Marker_refill(self) && Stack_pop(&self->stack, sp, bottom);
+}
+
+static inline void Marker_scanObject(Marker *self, Object *object) {
     DEBUG("GC: mark ptr=%p size=%zu atomic=%d\n",
-            Object_mutatorAddress(object), object->size, object->atomic);
+            Object_mutatorAddress(object), Object_size(object), object->atomic);
 
     if (!object->atomic) {
         void *sp = Object_mutatorAddress(object);
-        void *bottom = (char*)object + object->size;
-        Stack_push(&self->roots, sp, bottom);
+        void *bottom = (char*)object + Object_size(object);
+        Marker_push(self, sp, bottom);
     }
 }
 
-static inline void Collector_markChunk(Collector *self, Chunk *chunk) {
-    if (chunk != NULL && Chunk_isAllocated(chunk)) {
-        Object *object = &chunk->object;
+// Interior pointers to objects allocated with GC_malloc_base_only (or to any
+// object when interior pointers are disabled) don't keep the object alive.
+static inline int Marker_isValidPointer(Marker *self, Object *object, void *pointer) {
+    Collector *collector = self->collector;
 
-        if (!Object_isMarked(object)) {
-            Object_mark(object);
-            Collector_scanObject(self, object);
+    if (collector->interior_pointers && !Object_isBaseOnly(object)) {
+        return 1;
+    }
+    if (Collector_isBasePointer(collector, object, pointer)) {
+        return 1;
+    }
+    self->ignored_pointers++;
+    return 0;
+}
+
+static inline void Marker_markChunk(Marker *self, Chunk *chunk, void *pointer) {
+    if (chunk == NULL) return;
+
+    if (!Chunk_isAllocated(chunk)) {
+        // false pointer into a free chunk
+        GlobalAllocator_blacklistLarge(self->global_allocator, pointer);
+        return;
+    }
+
+    Object *object = &chunk->object;
+
+    if (!Marker_isValidPointer(self, object, pointer)) return;
+
+    if (Object_tryMark(object)) {
+        self->marked_bytes += Object_size(object);
+        Marker_scanObject(self, object);
+    }
+}
+
+// Medium objects are found with the granule bitmaps, without locking: an
+// allocator publishes an object after it initialized it (see
+// MediumBlock_publish).
+static inline void Marker_findAndMarkMediumObject(Marker *self, void *pointer) {
+    MediumBlock *block = MediumBlock_from(pointer);
+    Object *object = MediumBlock_findObject(block, pointer);
+
+    if (object == NULL || (char *)pointer < (char *)Object_mutatorAddress(object)) {
+        self->ignored_pointers++;
+        return;
+    }
+    if (!Marker_isValidPointer(self, object, pointer)) return;
+
+    if (Object_tryMark(object)) {
+        self->marked_bytes += object->size;
+        MediumBlock_mark(block);
+        Marker_scanObject(self, object);
+    }
+}
+
+// False pointer into a free line of the small object space (the pointer didn't
+// resolve to any object).
+static inline void Marker_blacklist(Block *block, void *pointer) {
+    int line_index = Block_lineIndex(block, pointer);
+    if (line_index >= 0) Block_blacklistLine(block, line_index);
+}
+
+static inline void Marker_markSmallObject(Marker *self, Block *block, Object *object) {
+    // evacuation: objects referenced from the roots can't be moved, even when
+    // they're already marked
+    if (self->pinning && Block_isEvacuating(block)) {
+        Object_pin(object);
+    }
+
+    if (Object_tryMark(object)) {
+        self->marked_bytes += object->size;
+        Block_mark(block);
+        Block_markObjectLines(block, object, self->global_allocator->exact_line_marking);
+        Marker_scanObject(self, object);
+    }
+}
+
+// Base pointers only: the object header must be right before the pointer (or
+// the pointer minus a registered displacement), so we only have to walk the
+// objects of a single line, instead of searching previous lines.
+static inline void Marker_findAndMarkSmallObjectFromBase(Marker *self, void *pointer) {
+    Collector *collector = self->collector;
+    Block *block = Block_from(pointer);
+
+    for (int i = -1; i < collector->displacement_count; i++) {
+        size_t displacement = i < 0 ? 0 : collector->displacements[i];
+        char *address = (char *)pointer - displacement - sizeof(Object);
+        Object *object = Block_findObject(block, address);
+        if (object != NULL) {
+            Marker_markSmallObject(self, block, object);
+            return;
         }
     }
+    self->ignored_pointers++;
+
+    // we can't tell whether the pointer is an interior pointer or a false
+    // pointer, unless the line doesn't start any object:
+    int line_index = Block_lineIndex(block, pointer);
+    if (line_index >= 0 && !LineHeader_containsObject(Block_lineHeader(block, line_index))) {
+        Block_blacklistLine(block, line_index);
+    }
 }
 
-static inline void Collector_findAndMarkSmallObject(Collector *self, void *pointer) {
+static inline void Marker_findAndMarkSmallObject(Marker *self, void *pointer) {
+    if (!self->collector->interior_pointers) {
+        Marker_findAndMarkSmallObjectFromBase(self, pointer);
+        return;
+    }
+
     Block *block = Block_from(pointer);
 
     int line_index = Block_lineIndex(block, pointer);
 
-    // invalid: pointer to block metadata
+    // invalid: pointer to region metadata
     if (line_index < 0) return;
 
     char *line_header = Block_lineHeader(block, line_index);
@@ -96,7 +294,8 @@ static inline void Collector_findAndMarkSmallObject(Collector *self, void *point
             line_index--;
         }
 
-        // invalid: pointer to block metadata
+        // invalid: pointer before the first object of the block (objects
+        // don't span blocks)
         if (line_index < 0) return;
     }
 
@@ -112,123 +311,876 @@ static inline void Collector_findAndMarkSmallObject(Collector *self, void *point
             // done: crossed line (warning: didn't find object)
             while (offset < LINE_SIZE) {
                 Object *object = (Object*)(line + offset);
+                size_t size = Object_loadSize(object);
 
                 // done: no more object in line (warning: didn't find object)
-                if (object->size == 0) return;
+                if (size == 0) {
+                    Marker_blacklist(block, pointer);
+                    return;
+                }
 
 #ifndef NDEBUG
-                if (object->size > LARGE_OBJECT_SIZE) {
+                if (size > LARGE_OBJECT_SIZE) {
                     fprintf(stderr, "GC: invalid small object size %zu (maximum is %zu) line=%p offset=%d\n",
-                            object->size, LARGE_OBJECT_SIZE, (void *)line, offset);
+                            size, LARGE_OBJECT_SIZE, (void *)line, offset);
                     abort();
                 }
 #endif
 
                 if (Object_contains(object, pointer)) {
-                    if (!Object_isMarked(object)) {
-                        Object_mark(object);
-                        Block_mark(block);
-
-                        // conservative marking (immix page 5): small objects
-                        // (smaller than LINE_SIZE) are more common than medium
-                        // objects (larger than LINE_SIZE) and we can speed up
-                        // marking by only marking the starting line.
-                        if (object->size <= LINE_SIZE) {
-                            // small object: only mark the starting line
-                            // DEBUG("GC: mark line=%p\n", (void *)line);
-                            LineHeader_mark(line_header);
-                        } else {
-                            // medium object: mark all lines exactly
-                            char *limit = (char *)object + object->size;
-                            do {
-                                // DEBUG("GC: mark line=%p\n", (void *)line);
-                                LineHeader_mark(line_header);
-                                line += LINE_SIZE;
-                                line_header++;
-                            } while (line < limit);
-                        }
-
-                        Collector_scanObject(self, object);
+                    if (Marker_isValidPointer(self, object, pointer)) {
+                        Marker_markSmallObject(self, block, object);
                     }
                     return;
                 }
 
-                offset += object->size;
+                offset += size;
             }
 
             // should be unreachable (warning: didn't find object)
+            Marker_blacklist(block, pointer);
             return;
         }
     }
+
+    // no object before the pointer in the block
+    Marker_blacklist(block, pointer);
 }
 
-void GC_Collector_addRoots(Collector *self, void *top, void *bottom, __attribute__((__unused__)) const char *source) {
+void GC_Collector_addRoots(Collector *self, void *top, void *bottom, const char *source) {
     DEBUG("GC: mark region top=%p bottom=%p source=%s\n", top, bottom, source);
     assert(top <= bottom);
-    Stack_push(&self->roots, top, bottom);
+    Roots_push(&self->roots, top, bottom, source, NULL);
+}
+
+void GC_Collector_addCachedRoots(Collector *self, void *top, void *bottom, const char *source, size_t epoch) {
+    GlobalAllocator *global_allocator = self->global_allocator;
+    size_t heap_size = GlobalAllocator_heapSize(global_allocator);
+    StackRoots *stack_roots = Hash_search(self->stack_roots, bottom);
+
+    if (self->nursery_roots) {
+        // nursery collection: scans the recorded pointers if they're still
+        // valid, but never records anything (see Collector_addNurseryRoots)
+        if (stack_roots != NULL && StackRoots_isValid(stack_roots, top, epoch, heap_size)) {
+            Collector_addRoots(self, StackRoots_start(stack_roots), StackRoots_stop(stack_roots), source);
+        } else {
+            Collector_addRoots(self, top, bottom, source);
+        }
+        return;
+    }
+
+    if (stack_roots == NULL) {
+        stack_roots = StackRoots_create(top, epoch, heap_size);
+        Hash_insert(self->stack_roots, bottom, stack_roots);
+    } else if (StackRoots_isValid(stack_roots, top, epoch, heap_size)) {
+        // the fiber didn't run since the last collection: reuse the recorded
+        // pointers instead of scanning the whole stack again
+        DEBUG("GC: cached region top=%p bottom=%p source=%s pointers=%ld\n",
+                top, bottom, source, Array_size(&stack_roots->pointers));
+        stack_roots->seen = 1;
+        Collector_addRoots(self, StackRoots_start(stack_roots), StackRoots_stop(stack_roots), source);
+        return;
+    } else if (stack_roots->seen) {
+        // the same stack was already recorded for the current collection (the
+        // recorded region is still to be scanned): don't cache it
+        Collector_addRoots(self, top, bottom, source);
+        return;
+    } else {
+        StackRoots_reset(stack_roots, top, epoch, heap_size);
+    }
+
+    // scan the whole stack, recording the pointers found into the HEAP:
+    DEBUG("GC: mark and record region top=%p bottom=%p source=%s\n", top, bottom, source);
+    assert(top <= bottom);
+    stack_roots->seen = 1;
+    Roots_push(&self->roots, top, bottom, source, stack_roots);
+}
+
+// Forgets about stacks that weren't registered during the last collection
+// (e.g. terminated fibers).
+static int Collector_evictStackRoots(__attribute__((__unused__)) void *bottom, StackRoots *stack_roots) {
+    if (stack_roots->seen) {
+        stack_roots->seen = 0;
+        return 0;
+    }
+    StackRoots_free(stack_roots);
+    return 1;
+}
+
+static inline void Marker_scan(Marker *self, void *sp, void *bottom, StackRoots *stack_roots) {
+    GlobalAllocator *global_allocator = self->global_allocator;
+
+    while (sp < bottom) {
+        // dereference stack pointer's value as heap pointer:
+        void *pointer = (void *)(*(uintptr_t *)(sp));
+
+        // search chunk for pointer (may be inner pointer):
+        if (GlobalAllocator_inSmallHeap(global_allocator, pointer)) {
+            if (stack_roots != NULL) StackRoots_record(stack_roots, pointer);
+            Marker_findAndMarkSmallObject(self, pointer);
+        } else if (GlobalAllocator_inMediumHeap(global_allocator, pointer)) {
+            if (stack_roots != NULL) StackRoots_record(stack_roots, pointer);
+            Marker_findAndMarkMediumObject(self, pointer);
+        } else if (GlobalAllocator_inLargeHeap(global_allocator, pointer)) {
+            if (stack_roots != NULL) StackRoots_record(stack_roots, pointer);
+
+            // the program may be allocating large objects concurrently
+            if (self->concurrent) GlobalAllocator_lockLarge(global_allocator);
+            Chunk *chunk = ChunkList_find(&global_allocator->large_chunk_list, pointer);
+            Marker_markChunk(self, chunk, pointer);
+            if (self->concurrent) GlobalAllocator_unlockLarge(global_allocator);
+        }
+
+        // try next stack pointer
+        sp = (char*)sp + sizeof(void *);
+    }
+}
+
+static inline void Marker_drain(Marker *self) {
+    void *sp;
+    void *bottom;
+
+    while (Marker_pop(self, &sp, &bottom)) {
+        Marker_scan(self, sp, bottom, NULL);
+    }
+}
+
+// Each worker claims root regions until there are none left, then marks
+// everything reachable from the region using its own mark stack.
+static void Collector_markTask(Collector *self, int index) {
+    Marker *marker = self->markers + index;
+    Root *root;
+
+    while ((root = Roots_claim(&self->roots)) != NULL) {
+        uint64_t start = GC_now();
+        marker->pinning = 1;
+        Marker_scan(marker, root->top, root->bottom, root->stack_roots);
+        marker->pinning = 0;
+
+        uint64_t stop = GC_now();
+        size_t bytes = (char *)root->bottom - (char *)root->top;
+        RootSources_add(&marker->sources, root->source, 1, bytes, stop - start);
+
+        Marker_drain(marker);
+        marker->heap_nanoseconds += GC_now() - stop;
+    }
+
+    // incremental marking: objects left to scan by the last step
+    Marker_drain(marker);
 }
 
 void GC_Collector_mark(Collector *self) {
-    Chunk *chunk;
-    ChunkList *large_chunk_list = &self->global_allocator->large_chunk_list;
+    int count = Workers_count(&self->workers);
+    uint64_t start = GC_now();
+
+    for (int i = 0; i < count; i++) {
+        RootSources_clear(&self->markers[i].sources);
+        self->markers[i].heap_nanoseconds = 0;
+        self->markers[i].ignored_pointers = 0;
+        self->markers[i].marked_bytes = 0;
+    }
+
+    Workers_run(&self->workers, (worker_task_t)Collector_markTask, self);
+    Roots_clear(&self->roots);
 
+    RootSources_clear(&self->sources);
+    self->heap_nanoseconds = 0;
+    self->ignored_pointers = 0;
+    self->marked_bytes = 0;
+
+    for (int i = 0; i < count; i++) {
+        RootSources_merge(&self->sources, &self->markers[i].sources);
+        self->heap_nanoseconds += self->markers[i].heap_nanoseconds;
+        self->ignored_pointers += self->markers[i].ignored_pointers;
+        self->marked_bytes += self->markers[i].marked_bytes;
+    }
+    self->mark_nanoseconds = GC_now() - start;
+}
+
+// Pops and scans regions from the mark stack until we scanned at least `budget`
+// bytes. Returns true if there are regions left to scan.
+static inline int Marker_drainSome(Marker *self, size_t budget) {
     void *sp;
     void *bottom;
+    size_t scanned = 0;
+
+    while (scanned < budget) {
+        if (!Marker_pop(self, &sp, &bottom)) {
+            return 0;
+        }
+        Marker_scan(self, sp, bottom, NULL);
+        scanned += (char *)bottom - (char *)sp;
+    }
+    return Marker_refill(self);
+}
+
+static inline void Collector_recordStep(Collector *self, uint64_t start) {
+    uint64_t duration = GC_now() - start;
+    self->step_count++;
+
+    if (duration > self->step_max_nanoseconds) {
+        self->step_max_nanoseconds = duration;
+    }
+}
+
+// Generational: minor collections don't unmark objects, but must still forget
+// about blacklisted addresses.
+static inline void Collector_clearBlacklists(Collector *self) {
+    Block *block = Block_first(self->global_allocator->small_heap_start);
+    Block *stop = Block_from(self->global_allocator->small_heap_stop);
+
+    while (block < stop) {
+        Block_clearBlacklist(block);
+        block = Block_next(block);
+    }
+    GlobalAllocator_clearLargeBlacklist(self->global_allocator);
+}
+
+static inline void Collector_unmark(Collector *self) {
+    Collector_unmarkSmallObjects(self);
+    Collector_unmarkMediumObjects(self);
+    Collector_unmarkLargeObjects(self);
+    GlobalAllocator_clearLargeBlacklist(self->global_allocator);
+}
+
+// Opportunistic evacuation (immix, page 6): selects the recyclable blocks with
+// few live lines (as counted by the last sweep) as candidates, as long as the
+// free blocks can hold their objects. Nursery blocks are never evacuated.
+static inline void Collector_selectEvacuationCandidates(Collector *self) {
+    GlobalAllocator *global_allocator = self->global_allocator;
+
+    self->evacuation_candidates = 0;
+    self->evacuated_objects = 0;
+    self->evacuated_bytes = 0;
+    self->pinned_objects = 0;
+    self->evacuation_nanoseconds = 0;
+
+    if (!global_allocator->evacuate) return;
+
+    size_t threshold = LINE_COUNT * GC_EVACUATION_THRESHOLD / 100;
+    size_t available = global_allocator->free_list.size * LINE_COUNT;
+
+    Block *block = Block_first(global_allocator->small_heap_start);
+    Block *stop = Block_from(global_allocator->small_heap_stop);
+
+    while (block < stop) {
+        size_t live_lines = (size_t)block->live_lines;
+
+        if (Block_isRecyclable(block) && block->owner == NULL && live_lines <= threshold && live_lines < available) {
+            Block_setEvacuate(block);
+            available -= live_lines;
+            self->evacuation_candidates++;
+        }
+        block = Block_next(block);
+    }
+
+    DEBUG("GC: evacuation candidates=%zu\n", self->evacuation_candidates);
+}
+
+// Calls the iterator for each object in the block.
+static inline void Collector_eachObject(Collector *self, Block *block, void (*iterator)(Collector *, Block *, Object *)) {
+    char *line_headers = Block_lineHeaders(block);
+
+    for (int line_index = 0; line_index < LINE_COUNT; line_index++) {
+        char *line_header = line_headers + line_index;
+        if (!LineHeader_containsObject(line_header)) continue;
+
+        char *line = Block_line(block, line_index);
+        int offset = LineHeader_getOffset(line_header);
+
+        while (offset < LINE_SIZE) {
+            Object *object = (Object *)(line + offset);
+            if (object->size == 0) break;
+
+            iterator(self, block, object);
+            offset = offset + object->size;
+        }
+    }
+}
+
+// Bump allocates into the free blocks that allocators left for evacuation
+// (see GlobalAllocator_shiftFreeBlock). Returns NULL when there are no free
+// blocks left.
+static inline Object *Collector_evacuationAllocate(Collector *self, size_t size) {
+    char *cursor = self->evacuation_cursor;
+
+    if (cursor == NULL || cursor + size > self->evacuation_limit) {
+        Block *block = BlockList_shift(&self->global_allocator->free_list);
+        if (block == NULL) return NULL;
+
+        cursor = Block_start(block);
+        self->evacuation_limit = Block_stop(block);
+    }
+
+    char *stop = cursor + size;
+
+    // clear the size of the next object in line (see
+    // LocalAllocator_tryAllocateSmall)
+    if (stop < self->evacuation_limit) {
+        ((Object *)stop)->size = 0;
+    }
+    self->evacuation_cursor = stop;
+
+    return (Object *)cursor;
+}
+
+// Copies a marked object into a free block, unless it's pinned (by a root or
+// the program), aligned, has a finalizer (registered by address) or is too
+// small to hold the forwarding address.
+static void Collector_evacuateObject(Collector *self, __attribute__((__unused__)) Block *block, Object *object) {
+    if (!Object_isMarked(object)) return;
+
+    if (Object_isPinned(object) ||
+            Object_isPinnedRoot(object) ||
+            Object_isAligned(object) ||
+            Object_mutatorSize(object) < WORD_SIZE ||
+            Object_hasFinalizer(object)) {
+        self->pinned_objects++;
+        return;
+    }
+
+    Object *copy = Collector_evacuationAllocate(self, object->size);
+    if (copy == NULL) {
+        self->pinned_objects++;
+        return;
+    }
+
+    memcpy(copy, object, object->size);
+
+    Block *target = Block_from(copy);
+    Line_update(target, copy);
+    Block_mark(target);
+    Block_markObjectLines(target, copy, self->global_allocator->exact_line_marking);
+
+    Object_forward(object, copy);
+
+    self->evacuated_objects++;
+    self->evacuated_bytes += object->size;
+}
+
+// Updates the pointers to evacuated objects in a marked object. Objects are
+// scanned conservatively: any word that is an address within an evacuated
+// object is rewritten, including integers (see GC_EVACUATE).
+static inline void Collector_updateReferences(Collector *self, Object *object) {
+    GlobalAllocator *global_allocator = self->global_allocator;
+
+    if (object->atomic) return;
+
+    char **slot = Object_mutatorAddress(object);
+    char **stop = (char **)((char *)object + Object_size(object));
 
-    while (Stack_pop(&self->roots, &sp, &bottom)) {
-        while (sp < bottom) {
-            // dereference stack pointer's value as heap pointer:
-            void *pointer = (void *)(*(uintptr_t *)(sp));
-
-            // search chunk for pointer (may be inner pointer):
-            if (GlobalAllocator_inSmallHeap(self->global_allocator, pointer)) {
-                Collector_findAndMarkSmallObject(self, pointer);
-            } else if (GlobalAllocator_inLargeHeap(self->global_allocator, pointer)) {
-                chunk = ChunkList_find(large_chunk_list, pointer);
-                Collector_markChunk(self, chunk);
+    for (; slot < stop; slot++) {
+        char *pointer = *slot;
+
+        if (!GlobalAllocator_inSmallHeap(global_allocator, pointer)) continue;
+
+        Block *block = Block_from(pointer);
+        if (!Block_isEvacuating(block)) continue;
+
+        Object *referent = Block_findObjectContaining(block, pointer);
+
+        if (referent != NULL && Object_isForwarded(referent)) {
+            *slot = (char *)Object_forwardee(referent) + (pointer - (char *)referent);
+        }
+    }
+}
+
+static void Collector_updateObjectReferences(Collector *self, __attribute__((__unused__)) Block *block, Object *object) {
+    if (Object_isMarked(object) && !Object_isForwarded(object)) {
+        Collector_updateReferences(self, object);
+    }
+}
+
+// Evacuated objects are dead: only the objects left in the block mark it and
+// its lines.
+static void Collector_remarkObject(Collector *self, Block *block, Object *object) {
+    Object_unpin(object);
+
+    if (Object_isForwarded(object)) {
+        Object_clearForwarded(object);
+        Object_unmark(object);
+    } else if (Object_isMarked(object)) {
+        Block_mark(block);
+        Block_markObjectLines(block, object, self->global_allocator->exact_line_marking);
+    }
+}
+
+static inline void Collector_remarkBlock(Collector *self, Block *block) {
+    char *line_headers = Block_lineHeaders(block);
+
+    Block_clearEvacuate(block);
+    Block_unmark(block);
+
+    for (int line_index = 0; line_index < LINE_COUNT; line_index++) {
+        LineHeader_unmark(line_headers + line_index);
+    }
+    Collector_eachObject(self, block, Collector_remarkObject);
+}
+
+// Evacuation: moves the marked objects out of the candidate blocks, then
+// updates the pointers to the moved objects in every marked object. Pointers
+// from the roots can't be updated: the objects they reference were pinned
+// while marking. The candidate blocks are then swept as usual, and become
+// free when all their objects moved.
+static void Collector_evacuate(Collector *self) {
+    GlobalAllocator *global_allocator = self->global_allocator;
+    Block *start = Block_first(global_allocator->small_heap_start);
+    Block *stop = Block_from(global_allocator->small_heap_stop);
+    Block *block;
+    uint64_t time = GC_now();
+
+    DEBUG("GC: evacuate start\n");
+
+    // 1. copy objects (and leave forwarding addresses)
+    self->evacuation_cursor = NULL;
+    self->evacuation_limit = NULL;
+
+    for (block = start; block < stop; block = Block_next(block)) {
+        if (Block_isEvacuating(block)) {
+            Collector_eachObject(self, block, Collector_evacuateObject);
+        }
+    }
+
+    // 2. update references (including into the copies); atomic blocks don't
+    //    have any
+    for (block = start; block < stop; block = Block_next(block)) {
+        if (Block_isMarked(block) && !Block_isAtomic(block)) {
+            Collector_eachObject(self, block, Collector_updateObjectReferences);
+        }
+    }
+
+    MediumBlock *medium = global_allocator->medium_heap_start;
+    for (; (void *)medium < global_allocator->medium_heap_stop; medium = (MediumBlock *)((char *)medium + MEDIUM_BLOCK_SIZE)) {
+        if (!MediumBlock_isMarked(medium)) continue;
+
+        for (int i = MediumBlock_nextObject(medium, 1); i < MEDIUM_GRANULE_COUNT; i = MediumBlock_nextObject(medium, i + 1)) {
+            Object *object = MediumBlock_granule(medium, i);
+            if (Object_isMarked(object)) Collector_updateReferences(self, object);
+        }
+    }
+
+    Chunk *chunk = global_allocator->large_chunk_list.first;
+    while (chunk != NULL) {
+        if (Chunk_isAllocated(chunk) && Chunk_isMarked(chunk)) {
+            Collector_updateReferences(self, &chunk->object);
+        }
+        chunk = chunk->next;
+    }
+
+    // 3. forget evacuated objects
+    for (block = start; block < stop; block = Block_next(block)) {
+        if (Block_isEvacuating(block)) {
+            Collector_remarkBlock(self, block);
+        }
+    }
+
+    self->evacuation_nanoseconds = GC_now() - time;
+    DEBUG("GC: evacuate end objects=%zu bytes=%zu pinned=%zu\n",
+            self->evacuated_objects, self->evacuated_bytes, self->pinned_objects);
+}
+
+// Lazy and concurrent sweeping: the HEAP must be swept before marks change.
+// The background thread may still be sweeping the large object space (unless
+// it's marking).
+static inline void Collector_finishSweeping(Collector *self) {
+    if (self->global_allocator->concurrent_sweep && !Collector_isMarking(self)) {
+        Background_stop(&self->background);
+    }
+    GlobalAllocator_finishSweeping(self->global_allocator);
+}
+
+static inline void Collector_addAllRoots(Collector *self) {
+    Collector_addRoots(self, GC_DATA_START, GC_DATA_END, ".data");
+    Collector_addRoots(self, GC_BSS_START, GC_BSS_END, ".bss");
+
+    if (!Array_isEmpty(&self->pinned_roots)) {
+        Collector_addRoots(self, self->pinned_roots.buffer, self->pinned_roots.cursor, "pinned");
+    }
+    Collector_callCollectCallback(self);
+}
+
+// Nursery collections: registers the roots of global collections, except for
+// the DATA and BSS sections (see Nursery_collect), so the nursery also marks
+// from the other stacks of the thread (e.g. suspended fibers), the extra roots
+// and the pinned roots. The stack roots cache is left untouched: only global
+// collections record pointers.
+void GC_Collector_addNurseryRoots(Collector *self) {
+    if (!Array_isEmpty(&self->pinned_roots)) {
+        Collector_addRoots(self, self->pinned_roots.buffer, self->pinned_roots.cursor, "pinned");
+    }
+    self->nursery_roots = 1;
+    Collector_callCollectCallback(self);
+    self->nursery_roots = 0;
+}
+
+// Concurrent marking: marks everything reachable from the roots on the
+// background thread, while the program is running, until there is nothing
+// left to mark or the collection must complete.
+static void Collector_backgroundMark(Collector *self) {
+    Marker *marker = self->markers;
+    uint64_t start = GC_now();
+
+    marker->concurrent = 1;
+
+    while (!Background_isStopping(&self->background)) {
+        if (!Marker_drainSome(marker, self->incremental_step)) break;
+    }
+
+    marker->concurrent = 0;
+    self->background_nanoseconds = GC_now() - start;
+}
+
+// Incremental marking: unmarks all objects and scans the roots, but doesn't
+// mark anything reachable from the roots yet, see GC_Collector_markStep.
+// Objects are allocated black until the collection completes.
+void GC_Collector_startMarking(Collector *self) {
+    DEBUG("GC: start marking\n");
+
+    uint64_t start = GC_now();
+    Marker *marker = self->markers;
+    Root *root;
+
+    self->step_count = 0;
+    self->step_max_nanoseconds = 0;
+
+    Collector_finishSweeping(self);
+    Collector_unmark(self);
+    Collector_selectEvacuationCandidates(self);
+    GlobalAllocator_setMarking(self->global_allocator, 1);
+
+    Collector_addAllRoots(self);
+
+    marker->pinning = 1;
+    while ((root = Roots_claim(&self->roots)) != NULL) {
+        Marker_scan(marker, root->top, root->bottom, root->stack_roots);
+    }
+    marker->pinning = 0;
+    Roots_clear(&self->roots);
+
+    Collector_recordStep(self, start);
+
+    if (self->concurrent) {
+        self->background_nanoseconds = 0;
+        Background_run(&self->background, (background_task_t)Collector_backgroundMark, self);
+    }
+}
+
+// Incremental marking: scans about GC_INCREMENTAL_STEP bytes of objects.
+// Returns true if there are objects left to scan.
+//
+// Concurrent marking: doesn't scan anything but returns true until the
+// background thread is done.
+int GC_Collector_markStep(Collector *self) {
+    if (self->concurrent) {
+        return Background_isRunning(&self->background);
+    }
+
+    uint64_t start = GC_now();
+    int more = Marker_drainSome(self->markers, self->incremental_step);
+    Collector_recordStep(self, start);
+    return more;
+}
+
+// Incremental marking: objects modified while marking (or allocated while
+// marking) must be scanned again, since they may now reference objects that
+// haven't been marked.
+static inline void Collector_rescanDirtyObjects(Collector *self) {
+    Marker *marker = self->markers;
+    Block *block = Block_first(self->global_allocator->small_heap_start);
+    Block *stop = Block_from(self->global_allocator->small_heap_stop);
+
+    while (block < stop) {
+        if (Block_isDirty(block)) {
+            Block_clearDirty(block);
+
+            char *line_headers = Block_lineHeaders(block);
+
+            for (int line_index = 0; line_index < LINE_COUNT; line_index++) {
+                char *line_header = line_headers + line_index;
+
+                if (LineHeader_containsObject(line_header)) {
+                    char *line = Block_line(block, line_index);
+                    int offset = LineHeader_getOffset(line_header);
+
+                    while (offset < LINE_SIZE) {
+                        Object *object = (Object *)(line + offset);
+                        if (object->size == 0) break;
+
+                        if (Object_isDirty(object)) {
+                            Object_clearDirty(object);
+                            if (Object_isMarked(object)) Marker_scanObject(marker, object);
+                        }
+                        offset = offset + object->size;
+                    }
+                }
+            }
+        }
+        block = Block_next(block);
+    }
+
+    MediumBlock *medium = self->global_allocator->medium_heap_start;
+    for (; (void *)medium < self->global_allocator->medium_heap_stop; medium = (MediumBlock *)((char *)medium + MEDIUM_BLOCK_SIZE)) {
+        if (!MediumBlock_isDirty(medium)) continue;
+        MediumBlock_clearDirty(medium);
+
+        for (int i = MediumBlock_nextObject(medium, 1); i < MEDIUM_GRANULE_COUNT; i = MediumBlock_nextObject(medium, i + 1)) {
+            Object *object = MediumBlock_granule(medium, i);
+
+            if (Object_isDirty(object)) {
+                Object_clearDirty(object);
+                if (Object_isMarked(object)) Marker_scanObject(marker, object);
             }
+        }
+    }
+
+    Chunk *chunk = self->global_allocator->large_chunk_list.first;
+    while (chunk != NULL) {
+        if (Chunk_isAllocated(chunk) && Object_isDirty(&chunk->object)) {
+            Object_clearDirty(&chunk->object);
+            if (Chunk_isMarked(chunk)) Marker_scanObject(marker, &chunk->object);
+        }
+        chunk = chunk->next;
+    }
+}
+
+static void Collector_printRootSource(RootSource *entry) {
+    fprintf(stderr, "GC: roots source=%s count=%zu bytes=%zu time=%luus\n",
+            entry->name, entry->count, entry->bytes,
+            (unsigned long)(entry->nanoseconds / 1000));
+}
+
+void GC_Collector_printStats(Collector *self) {
+    fprintf(stderr, "GC: mark workers=%d time=%luus heap=%luus interior_pointers=%d ignored_pointers=%zu\n",
+            Workers_count(&self->workers),
+            (unsigned long)(self->mark_nanoseconds / 1000),
+            (unsigned long)(self->heap_nanoseconds / 1000),
+            self->interior_pointers,
+            self->ignored_pointers);
+
+    fprintf(stderr, "GC: sweep lazy=%d concurrent=%d time=%luus\n",
+            self->global_allocator->lazy_sweep,
+            self->global_allocator->concurrent_sweep,
+            (unsigned long)(self->sweep_nanoseconds / 1000));
+
+    // lazy sweeping: the last complete sweep is the one that ended before this
+    // collection
+    LineStats *line_stats = &self->global_allocator->swept_line_stats;
+    fprintf(stderr, "GC: lines exact=%d recyclable_blocks=%zu holes=%zu holes_per_block=%.1f hole_lines=%zu %s_lines=%zu blacklisted_lines=%zu\n",
+            self->global_allocator->exact_line_marking,
+            line_stats->recyclable_blocks,
+            line_stats->holes,
+            line_stats->recyclable_blocks == 0 ? 0.0 : (double)line_stats->holes / line_stats->recyclable_blocks,
+            line_stats->hole_lines,
+            self->global_allocator->exact_line_marking ? "recovered" : "skipped",
+            line_stats->skipped_lines,
+            line_stats->blacklisted_lines);
+
+    for (int i = 0; i < self->sources.size; i++) {
+        Collector_printRootSource(self->sources.entries + i);
+    }
+    if (RootSources_other(&self->sources)->count > 0) {
+        Collector_printRootSource(RootSources_other(&self->sources));
+    }
+
+    if (self->global_allocator->generational) {
+        fprintf(stderr, "GC: generational collection=%s marked_bytes=%zu survival_rate=%zu%% promoted_bytes=%zu\n",
+                self->minor ? "minor" : "full",
+                self->marked_bytes,
+                self->global_allocator->survival_rate,
+                self->global_allocator->promoted_bytes);
+    }
+
+    if (self->global_allocator->evacuate) {
+        fprintf(stderr, "GC: evacuation candidates=%zu objects=%zu bytes=%zu pinned=%zu time=%luus\n",
+                self->evacuation_candidates,
+                self->evacuated_objects,
+                self->evacuated_bytes,
+                self->pinned_objects,
+                (unsigned long)(self->evacuation_nanoseconds / 1000));
+    }
+
+    if (self->concurrent) {
+        fprintf(stderr, "GC: concurrent mark time=%luus start_pause=%luus final_pause=%luus\n",
+                (unsigned long)(self->background_nanoseconds / 1000),
+                (unsigned long)(self->step_max_nanoseconds / 1000),
+                (unsigned long)(self->final_nanoseconds / 1000));
+    } else if (self->global_allocator->incremental) {
+        fprintf(stderr, "GC: incremental steps=%zu max_step_pause=%luus final_pause=%luus\n",
+                self->step_count,
+                (unsigned long)(self->step_max_nanoseconds / 1000),
+                (unsigned long)(self->final_nanoseconds / 1000));
+    }
+}
+
+void GC_Collector_registerDisplacement(Collector *self, size_t offset) {
+    if (offset == 0) return;
+
+    for (int i = 0; i < self->displacement_count; i++) {
+        if (self->displacements[i] == offset) return;
+    }
 
-            // try next stack pointer
-            sp = (char*)sp + sizeof(void *);
+    if (self->displacement_count == DISPLACEMENTS_MAX) {
+        fprintf(stderr, "GC: can't register more than %d displacements\n", DISPLACEMENTS_MAX);
+        abort();
+    }
+    self->displacements[self->displacement_count++] = offset;
+}
+
+// Generational: the survival rate of young objects decides whether the next
+// collection can be a minor collection (see GlobalAllocator_tryCollect).
+static inline void Collector_updateSurvivalRate(Collector *self) {
+    GlobalAllocator *global_allocator = self->global_allocator;
+
+    if (self->minor) {
+        size_t allocated = GlobalAllocator_allocatedBytesSinceCollect(global_allocator);
+        global_allocator->survival_rate = allocated == 0 ? 0 : self->marked_bytes * 100 / allocated;
+        global_allocator->promoted_bytes += self->marked_bytes;
+    } else {
+        global_allocator->survival_rate = 0;
+        global_allocator->promoted_bytes = 0;
+    }
+}
+
+// Eager sweeping: workers claim ranges of blocks until there are none left,
+// while the first worker starts with the large object space (unless it's swept
+// concurrently).
+static void Collector_sweepTask(Collector *self, int index) {
+    GlobalAllocator *global_allocator = self->global_allocator;
+    size_t range;
+
+    if (index == 0 && !global_allocator->concurrent_sweep) {
+        ChunkList_sweep(&global_allocator->large_chunk_list);
+    }
+
+    while ((range = __atomic_fetch_add(&self->next_sweep_range, 1, __ATOMIC_RELAXED)) < self->sweep_range_count) {
+        char *start = (char *)global_allocator->small_heap_start + range * SWEEP_RANGE_BLOCKS * BLOCK_SIZE;
+        char *stop = start + SWEEP_RANGE_BLOCKS * BLOCK_SIZE;
+
+        if ((void *)stop > global_allocator->small_heap_stop) {
+            stop = global_allocator->small_heap_stop;
+        }
+        GlobalAllocator_sweepBlocks(global_allocator, self->sweepers + range, Block_first(start), Block_from(stop));
+    }
+}
+
+static inline void Collector_parallelSweep(Collector *self) {
+    GlobalAllocator *global_allocator = self->global_allocator;
+    size_t block_count = global_allocator->small_heap_size / BLOCK_SIZE;
+    size_t count = (block_count + SWEEP_RANGE_BLOCKS - 1) / SWEEP_RANGE_BLOCKS;
+
+    if (count > self->sweeper_capacity) {
+        self->sweepers = realloc(self->sweepers, count * sizeof(Sweeper));
+        if (self->sweepers == NULL) {
+            fprintf(stderr, "GC: realloc failed\n");
+            abort();
         }
+        self->sweeper_capacity = count;
+    }
+    self->sweep_range_count = count;
+    self->next_sweep_range = 0;
+
+    Workers_run(&self->workers, (worker_task_t)Collector_sweepTask, self);
+
+    GlobalAllocator_recycleSweptBlocks(global_allocator, self->sweepers, count);
+}
+
+// Concurrent sweeping: sweeps the large object space on the background
+// thread, a few chunks at a time, so large allocations can search the swept
+// chunks in between, or help sweep.
+static void Collector_backgroundSweep(Collector *self) {
+    while (!Background_isStopping(&self->background)) {
+        if (!GlobalAllocator_sweepLarge(self->global_allocator, LARGE_SWEEP_STEP)) break;
     }
 }
 
 static inline void Collector_sweep(Collector *self) {
-    // small objects
-    GlobalAllocator_recycleBlocks(self->global_allocator);
+    GlobalAllocator *global_allocator = self->global_allocator;
+    uint64_t start = GC_now();
+
+    if (global_allocator->lazy_sweep) {
+        // small objects (swept as allocators need blocks)
+        GlobalAllocator_recycleBlocks(global_allocator);
+
+        // large objects
+        if (!global_allocator->concurrent_sweep) {
+            ChunkList_sweep(&global_allocator->large_chunk_list);
+        }
+    } else {
+        Collector_parallelSweep(self);
+    }
 
-    // large objects
-    ChunkList_sweep(&self->global_allocator->large_chunk_list);
+    // medium objects (granule bitmaps are quick to sweep)
+    GlobalAllocator_sweepMedium(global_allocator);
 //#ifndef NDEBUG
 //    ChunkList_validate(&self->global_allocator->large_chunk_list, self->global_allocator->large_heap_stop);
 //#endif
+
+    if (global_allocator->concurrent_sweep) {
+        GlobalAllocator_startSweepingLarge(global_allocator);
+        Background_run(&self->background, (background_task_t)Collector_backgroundSweep, self);
+    }
+
+    self->sweep_nanoseconds = GC_now() - start;
 }
 
 void GC_Collector_collect(Collector *self) {
     DEBUG("GC: collect start\n");
+    GlobalAllocator *global_allocator = self->global_allocator;
+    uint64_t start = GC_now();
+    int incremental = Collector_isMarking(self);
 
-    // 1. unmark all objects
-    Collector_unmarkSmallObjects(self);
-    Collector_unmarkLargeObjects(self);
+    self->minor = !incremental && global_allocator->minor;
+    global_allocator->minor = 0;
 
-    // 2. collect stack roots
-    Collector_addRoots(self, GC_DATA_START, GC_DATA_END, ".data");
-    Collector_addRoots(self, GC_BSS_START, GC_BSS_END, ".bss");
-    Collector_callCollectCallback(self);
+    // lazy sweeping: blocks must be swept before their marks change
+    Collector_finishSweeping(self);
+
+    if (incremental) {
+        // 1. incremental marking: objects are already unmarked, and we
+        //    already marked part of the HEAP; rescan modified objects
+        if (self->concurrent) Background_stop(&self->background);
+        Collector_rescanDirtyObjects(self);
+        GlobalAllocator_setMarking(global_allocator, 0);
+    } else if (self->minor) {
+        // 1. minor collection: marked objects are old and stay marked (sticky
+        //    mark bits); rescan old objects modified since the last collection
+        //    (they may reference young objects)
+        Collector_clearBlacklists(self);
+        Collector_rescanDirtyObjects(self);
+    } else {
+        // 1. unmark all objects (and forget about blacklisted addresses), then
+        //    select fragmented blocks to evacuate
+        Collector_unmark(self);
+        Collector_selectEvacuationCandidates(self);
+    }
+
+    // 2. collect stack roots (again for incremental marking: stacks aren't
+    //    protected by the write barrier)
+    Collector_addAllRoots(self);
 
     // 3. search reachable objects to mark (recursively)
     Collector_mark(self);
+    Hash_deleteIf(self->stack_roots, (hash_iterator_t)Collector_evictStackRoots);
+    Collector_updateSurvivalRate(self);
     GlobalAllocator_resetCounters(self->global_allocator);
 
-    // 4. finalize unreachable objects
+    // 4. move objects out of fragmented blocks (full collections only)
+    if (!self->minor && self->evacuation_candidates > 0) {
+        Collector_evacuate(self);
+    }
+
+    // 5. finalize unreachable objects
     GlobalAllocator_finalizeObjects(self->global_allocator);
 
-    // 5. cleanup
+    // 6. cleanup
     Collector_sweep(self);
 
     // TODO: reset local allocators (block = cursor = limit = NULL)
     //       this is done in GC_collect_once for the time being
 
+    if (incremental) {
+        self->final_nanoseconds = GC_now() - start;
+    }
+
     DEBUG("GC: collect end\n");
 }
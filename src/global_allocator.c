@@ -11,33 +11,50 @@
 #include "options.h"
 
 void GC_GlobalAllocator_init(GlobalAllocator *self, size_t initial_size) {
-    assert(initial_size >= BLOCK_SIZE * 2);
+    assert(initial_size >= BLOCK_SIZE * (REGION_METADATA_BLOCKS + 2));
     assert(initial_size % BLOCK_SIZE == 0);
 
     self->memory_limit = GC_maximumHeapSize();
     self->free_space_divisor = GC_freeSpaceDivisor();
+    self->incremental = GC_incremental() || GC_concurrent();
+    self->marking = 0;
+    self->generational = GC_generational();
+    self->minor = 0;
+    self->survival_rate = 0;
+    self->promoted_bytes = 0;
+    self->evacuate = GC_evacuate();
+    self->lazy_sweep = GC_lazySweep();
+    self->concurrent_sweep = GC_concurrentSweep();
     self->allocated_bytes_since_collect = 0;
     self->total_allocated_bytes = 0;
 
-    // small object space (immix)
-    void *heap_start = GC_mapAndAlign(self->memory_limit, initial_size);
+    // small object space (immix), the block metadata are at the start of each
+    // region
+    void *heap_start = GC_mapAndAlign(self->memory_limit, REGION_SIZE);
     self->small_heap_size = initial_size;
     self->small_heap_start = heap_start;
     self->small_heap_stop = (char *)heap_start + initial_size;
 
     BlockList_clear(&self->free_list);
-    BlockList_clear(&self->recyclable_list);
+    GlobalAllocator_clearRecyclableLists(self->recyclable_lists);
+    self->sweep_cursor = NULL;
+    self->sweep_stop = NULL;
 
-    Block *block = (Block *)self->small_heap_start;
-    Block *stop = (Block *)self->small_heap_stop;
-    while (block < stop) {
+    Block *stop = Block_from(self->small_heap_stop);
+    for (Block *block = Block_first(self->small_heap_start); block < stop; block = Block_next(block)) {
         Block_init(block);
         BlockList_push(&self->free_list, block);
-        block = (Block *)((char *)block + BLOCK_SIZE);
     }
 
+    // medium object space (granules), grown on the first medium allocation
+    void *medium_start = GC_mapAndAlign(self->memory_limit, MEDIUM_BLOCK_SIZE);
+    self->medium_heap_size = 0;
+    self->medium_heap_start = medium_start;
+    self->medium_heap_stop = medium_start;
+    MediumBlockList_clear(&self->medium_list);
+
     // large objects space (linked list)
-    void *large_start = GC_mapAndAlign(self->memory_limit, initial_size);
+    void *large_start = GC_mapAndAlign(self->memory_limit, BLOCK_SIZE);
     self->large_heap_size = initial_size;
     self->large_heap_start = large_start;
     self->large_heap_stop = (char *)large_start + initial_size;
@@ -47,6 +64,15 @@ void GC_GlobalAllocator_init(GlobalAllocator *self, size_t initial_size) {
 
     ChunkList_clear(&self->large_chunk_list);
     ChunkList_push(&self->large_chunk_list, large_chunk);
+    pthread_mutex_init(&self->large_mutex, NULL);
+    self->large_sweep_cursor = NULL;
+
+    self->large_blacklist_size = 0;
+    self->blacklisted_bytes = 0;
+
+    self->exact_line_marking = GC_exactLineMarking();
+    LineStats_clear(&self->line_stats);
+    LineStats_clear(&self->swept_line_stats);
 
     self->finalizers = Hash_create(8);
 
@@ -58,20 +84,25 @@ static inline void GlobalAllocator_growSmall(GlobalAllocator *self) {
     size_t increment = self->small_heap_size * GROWTH_RATE / 100;
     increment = ROUND_TO_NEXT_MULTIPLE(increment, BLOCK_SIZE);
 
-    if (self->small_heap_size + self->large_heap_size + increment > self->memory_limit) {
+    // don't stop into the metadata of a new region: add at least one block
+    Block *last = Block_from((char *)self->small_heap_stop + increment - BLOCK_SIZE);
+    if (Block_isMetadata(last)) {
+        increment += (REGION_METADATA_BLOCKS - Block_index(last)) * BLOCK_SIZE;
+    }
+
+    if (GlobalAllocator_heapSize(self) + increment > self->memory_limit) {
         fprintf(stderr, "GC: out of memory\n");
         abort();
     }
 
     DEBUG("GC: grow small heap by %zu bytes to %zu bytes\n", increment, self->small_heap_size + increment);
 
-    char *cursor = self->small_heap_stop;
+    Block *block = Block_first(self->small_heap_stop);
     self->small_heap_stop = (char *)(self->small_heap_stop) + increment;
     self->small_heap_size = self->small_heap_size + increment;
 
-    int count = increment / BLOCK_SIZE;
-    for (int i = 0; i < count; i++) {
-        Block *block = (Block*)(cursor + i * BLOCK_SIZE);
+    Block *stop = Block_from(self->small_heap_stop);
+    for (; block < stop; block = Block_next(block)) {
         Block_init(block);
         BlockList_push(&self->free_list, block);
     }
@@ -81,7 +112,7 @@ static inline void GlobalAllocator_growLarge(GlobalAllocator *self, size_t incre
     size_t size = (size_t)1 << (size_t)ceil(log2((double)increment));
     size = ROUND_TO_NEXT_MULTIPLE(size, BLOCK_SIZE);
 
-    if (self->small_heap_size + self->large_heap_size + size > self->memory_limit) {
+    if (GlobalAllocator_heapSize(self) + size > self->memory_limit) {
         fprintf(stderr, "GC: out of memory\n");
         abort();
     }
@@ -95,31 +126,254 @@ static inline void GlobalAllocator_growLarge(GlobalAllocator *self, size_t incre
     Chunk *chunk = (Chunk *)cursor;
     Chunk_init(chunk, size - CHUNK_HEADER_SIZE);
 
+    GlobalAllocator_lockLarge(self);
     ChunkList_push(&self->large_chunk_list, chunk);
+    GlobalAllocator_unlockLarge(self);
 //#ifndef NDEBUG
 //    ChunkList_validate(&self->large_chunk_list, self->large_heap_stop);
 //#endif
 }
 
-static inline void *GlobalAllocator_tryAllocateLarge(GlobalAllocator *self, size_t size, int atomic) {
-    size_t object_size = size + sizeof(Object);
+static inline void GlobalAllocator_growMedium(GlobalAllocator *self) {
+    size_t increment = self->medium_heap_size * GROWTH_RATE / 100;
+    increment = ROUND_TO_NEXT_MULTIPLE(increment, MEDIUM_BLOCK_SIZE);
+    if (increment == 0) increment = MEDIUM_BLOCK_SIZE;
 
-    // simply iterate again from the start (happens to be faster?!):
-    Chunk *chunk = self->large_chunk_list.first;
+    if (GlobalAllocator_heapSize(self) + increment > self->memory_limit) {
+        fprintf(stderr, "GC: out of memory\n");
+        abort();
+    }
+
+    DEBUG("GC: grow medium heap by %zu bytes to %zu bytes\n", increment, self->medium_heap_size + increment);
+
+    char *cursor = self->medium_heap_stop;
+    self->medium_heap_stop = (char *)(self->medium_heap_stop) + increment;
+    self->medium_heap_size = self->medium_heap_size + increment;
+
+    for (size_t offset = 0; offset < increment; offset += MEDIUM_BLOCK_SIZE) {
+        MediumBlock *block = (MediumBlock *)(cursor + offset);
+        MediumBlock_init(block);
+        MediumBlockList_push(&self->medium_list, block);
+    }
+}
+
+// Returns the recyclable list for blocks whose largest hole has that many
+// lines: the bucket of the highest power of 2 that isn't larger.
+static inline int GlobalAllocator_recyclableBucket(int lines) {
+    if (lines <= 1) return 0;
+    int bucket = 31 - __builtin_clz((unsigned)lines);
+    return bucket < RECYCLABLE_BUCKETS ? bucket : RECYCLABLE_BUCKETS - 1;
+}
+
+// Sweeps a block, then pushes it to the free list, or the recyclable list for
+// the size of its largest hole, unless the block is unavailable.
+static inline void GlobalAllocator_sweepBlock(Block *block, int exact, BlockList *free_list, BlockList *recyclable_lists, LineStats *line_stats) {
+    if (!Block_isMarked(block) && !Block_hasBlacklistedLines(block)) {
+        // free block
+        Block_setFree(block);
+        DEBUG("GC: free block=%p\n", (void *)block);
+        BlockList_push(free_list, block);
+    } else {
+        // nursery blocks are released into the shared heap
+        block->owner = NULL;
+
+        // try to recycle block (find unmarked lines)
+        int first_free_line_index = Block_sweepLines(block, exact, line_stats);
+
+        // at least 1 free line? recycle block; otherwise block is unavailable
+        if (first_free_line_index == INVALID_LINE_INDEX) {
+            DEBUG("GC: unavailable block=%p\n", (void *)block);
+            Block_setUnavailable(block);
+        } else {
+            DEBUG("GC: recyclable block=%p first_free_line_index=%d\n",
+                    (void *)block, first_free_line_index);
+            Block_setRecyclable(block, first_free_line_index);
+            BlockList_push(recyclable_lists + GlobalAllocator_recyclableBucket(block->largest_hole), block);
+
+//#ifdef GC_DEBUG
+//            char *start, *limit;
+//            int line_index = first_free_line_index;
+//            while ((line_index = Block_nextHole(block, line_index, &start, &limit)) != INVALID_LINE_INDEX) {
+//                fprintf(stderr, "GC: hole start=%p limit=%p size=%ld\n",
+//                        (void *)start, (void *)limit, (long)(limit - start));
+//            }
+//#endif
+        }
+    }
+}
+
+// Sweeps the next block that wasn't swept since the last collection.
+static inline void GlobalAllocator_sweepNextBlock(GlobalAllocator *self) {
+    Block *block = self->sweep_cursor;
+    self->sweep_cursor = Block_next(block);
+    GlobalAllocator_sweepBlock(block, self->exact_line_marking, &self->free_list, self->recyclable_lists, &self->line_stats);
+
+    if (!GlobalAllocator_isSweeping(self)) {
+        self->swept_line_stats = self->line_stats;
+    }
+}
+
+// Evacuation: the number of free blocks kept for the objects evacuated by the
+// next collection.
+static inline size_t GlobalAllocator_evacuationReserve(GlobalAllocator *self) {
+    if (!self->evacuate) return 0;
+
+    size_t reserve = self->small_heap_size / BLOCK_SIZE * GC_EVACUATION_RESERVE / 100;
+    return reserve > 0 ? reserve : 1;
+}
+
+// Returns true if there are free blocks left, besides the evacuation reserve.
+static inline int GlobalAllocator_hasFreeBlocks(GlobalAllocator *self) {
+    return self->free_list.size > GlobalAllocator_evacuationReserve(self);
+}
+
+// Shifts a free block, unless only the evacuation reserve is left. Lazy
+// sweeping: sweeps blocks until a free block is found.
+static inline Block *GlobalAllocator_shiftFreeBlock(GlobalAllocator *self) {
+    while (!GlobalAllocator_hasFreeBlocks(self) && GlobalAllocator_isSweeping(self)) {
+        GlobalAllocator_sweepNextBlock(self);
+    }
+    if (!GlobalAllocator_hasFreeBlocks(self)) return NULL;
+    return BlockList_shift(&self->free_list);
+}
+
+// Removes the first block after the previous block (or from the start of the
+// list if previous is NULL) whose largest hole has that many lines.
+static inline Block *GlobalAllocator_removeFittingBlock(BlockList *list, Block *previous, int lines) {
+    Block *block = previous == NULL ? list->first : previous->next;
+
+    for (; block != NULL; previous = block, block = block->next) {
+        if (block->largest_hole >= lines) {
+            return BlockList_removeNext(list, previous);
+        }
+    }
+    return NULL;
+}
 
-    while (chunk != NULL) {
+// Shifts a recyclable block whose largest hole has that many lines: from the
+// buckets of larger holes first, otherwise searches the bucket of that size
+// (its holes may be smaller) after the previous block.
+static inline Block *GlobalAllocator_shiftRecyclableBlockFrom(GlobalAllocator *self, int lines, Block *previous) {
+    int bucket = GlobalAllocator_recyclableBucket(lines);
+
+    for (int b = RECYCLABLE_BUCKETS - 1; b > bucket; b--) {
+        Block *block = BlockList_shift(self->recyclable_lists + b);
+        if (block != NULL) return block;
+    }
+    return GlobalAllocator_removeFittingBlock(self->recyclable_lists + bucket, previous, lines);
+}
+
+// Shifts a recyclable block for an allocation that didn't fit the holes of the
+// previous block: blocks with large holes first, so allocators don't refill
+// from many nearly full blocks in a row, and medium objects only go to blocks
+// whose largest hole can fit them. Lazy sweeping: sweeps blocks until such a
+// recyclable block is found, or a free block, so we don't sweep the whole
+// HEAP when most blocks are free.
+static inline Block *GlobalAllocator_shiftRecyclableBlock(GlobalAllocator *self, size_t size) {
+    // allocations that fit a line can try any hole
+    int lines = size > LINE_SIZE ? (int)((size + LINE_SIZE - 1) / LINE_SIZE) : 0;
+    BlockList *list = self->recyclable_lists + GlobalAllocator_recyclableBucket(lines);
+
+    Block *block = GlobalAllocator_shiftRecyclableBlockFrom(self, lines, NULL);
+
+    while (block == NULL && GlobalAllocator_isSweeping(self)) {
+        // the blocks already in the list don't fit: only search the newly
+        // swept block (pushed to the end)
+        Block *last = BlockList_isEmpty(list) ? NULL : list->last;
+        GlobalAllocator_sweepNextBlock(self);
+
+        block = GlobalAllocator_shiftRecyclableBlockFrom(self, lines, last);
+        if (block == NULL && GlobalAllocator_hasFreeBlocks(self)) {
+            block = BlockList_shift(&self->free_list);
+        }
+    }
+    return block;
+}
+
+// Returns the highest blacklisted address in the [start, stop) range, or NULL.
+static inline char *GlobalAllocator_findLargeBlacklisted(GlobalAllocator *self, char *start, char *stop) {
+    size_t count = GlobalAllocator_largeBlacklistSize(self);
+    char *found = NULL;
+
+    for (size_t i = 0; i < count; i++) {
+        char *address = self->large_blacklist[i];
+
+        if (address >= start && address < stop && address > found) {
+            found = address;
+        }
+    }
+    return found;
+}
+
+// Aligned allocations: returns how many bytes to leave free at the start of
+// the chunk, so the mutator address of the chunk that follows is aligned. The
+// free bytes must hold a chunk (see ChunkList_split).
+static inline size_t GlobalAllocator_largeAlignmentSkip(Chunk *chunk, size_t alignment) {
+    uintptr_t mutator = (uintptr_t)Chunk_mutatorAddress(chunk);
+    uintptr_t aligned = ROUND_TO_NEXT_MULTIPLE(mutator, alignment);
+
+    while (aligned != mutator && aligned - mutator < sizeof(Chunk)) {
+        aligned += alignment;
+    }
+    return aligned - mutator;
+}
+
+// Searches a free chunk from the given chunk on. Concurrent sweeping: stops
+// on the first chunk that wasn't swept yet.
+static inline void *GlobalAllocator_tryAllocateLargeUnlocked(GlobalAllocator *self, Chunk *chunk, size_t size, size_t alignment, int atomic) {
+    size_t object_size = size + sizeof(Object);
+
+    while (chunk != NULL && chunk != self->large_sweep_cursor) {
         assert((void *)chunk >= self->large_heap_start);
         assert((void *)chunk < self->large_heap_stop);
 
         if (!chunk->allocated) {
-            size_t available = chunk->object.size;
+            size_t available = chunk->size;
+
+            if (alignment > WORD_SIZE) {
+                size_t skip = GlobalAllocator_largeAlignmentSkip(chunk, alignment);
+
+                if (skip > 0) {
+                    // leave the start of the chunk free, and allocate into
+                    // the aligned chunk that follows
+                    if (skip + object_size <= available) {
+                        ChunkList_split(&self->large_chunk_list, chunk, skip - CHUNK_HEADER_SIZE);
+                    }
+                    chunk = chunk->next;
+                    continue;
+                }
+            }
 
             if (object_size <= available) {
+                char *stop = (char *)chunk + CHUNK_HEADER_SIZE + object_size;
+                char *blacklisted = GlobalAllocator_findLargeBlacklisted(self, (char *)chunk, stop);
+
+                if (blacklisted != NULL) {
+                    // a false pointer would retain the allocation: leave the
+                    // start of the chunk free and try again past the pointer
+                    size_t skip = ROUND_TO_NEXT_MULTIPLE((size_t)(blacklisted - (char *)chunk) + 1, WORD_SIZE);
+                    skip = skip < sizeof(Chunk) ? sizeof(Object) : skip - CHUNK_HEADER_SIZE;
+
+                    if (ChunkList_split(&self->large_chunk_list, chunk, skip) != NULL) {
+                        self->blacklisted_bytes += skip + CHUNK_HEADER_SIZE;
+                    } else {
+                        self->blacklisted_bytes += Chunk_size(chunk);
+                    }
+                    chunk = chunk->next;
+                    continue;
+                }
+
                 ChunkList_split(&self->large_chunk_list, chunk, object_size);
 //#ifndef NDEBUG
 //                ChunkList_validate(&self->large_chunk_list, self->large_heap_stop);
 //#endif
                 Chunk_allocate(chunk, atomic);
+
+                if (GlobalAllocator_isMarking(self)) {
+                    // allocate black (see LocalAllocator_allocateSmall)
+                    Chunk_mark(chunk);
+                    if (!atomic) Object_setDirty(&chunk->object);
+                }
                 GlobalAllocator_incrementCounters(self, size);
                 return Chunk_mutatorAddress(chunk);
             }
@@ -133,13 +387,49 @@ static inline void *GlobalAllocator_tryAllocateLarge(GlobalAllocator *self, size
     return NULL;
 }
 
+static inline void *GlobalAllocator_tryAllocateLarge(GlobalAllocator *self, size_t size, size_t alignment, int atomic) {
+    GlobalAllocator_lockLarge(self);
+
+    // simply iterate again from the start (happens to be faster?!):
+    void *mutator = GlobalAllocator_tryAllocateLargeUnlocked(self, self->large_chunk_list.first, size, alignment, atomic);
+
+    // concurrent sweeping: help the background thread sweep the next chunks,
+    // then search the freshly swept chunks
+    while (mutator == NULL && self->large_sweep_cursor != NULL) {
+        Chunk *chunk = self->large_sweep_cursor;
+        self->large_sweep_cursor = ChunkList_sweepSome(&self->large_chunk_list, chunk, LARGE_SWEEP_STEP);
+        mutator = GlobalAllocator_tryAllocateLargeUnlocked(self, chunk, size, alignment, atomic);
+    }
+
+    GlobalAllocator_unlockLarge(self);
+    return mutator;
+}
+
+// Generational: a minor collection is enough, unless the last minor
+// collection wasn't productive (too many young objects survived) or the old
+// generation grew too much since the last full collection.
+static inline int GlobalAllocator_shouldCollectMinor(GlobalAllocator *self) {
+    if (!self->generational) return 0;
+    if (self->survival_rate > GC_MAXIMUM_SURVIVAL_RATE) return 0;
+    return self->promoted_bytes < GlobalAllocator_heapSize(self) / self->free_space_divisor;
+}
+
 // Collects memory if we allocated at least 1/Nth of the HEAP memory since the
 // last collection. Returns immediately if we're already collecting.
+//
+// In incremental mode, starts marking instead, and returns false because no
+// memory has been reclaimed yet. If we run out of memory before marking
+// completes, finishes the collection immediately.
 static int GlobalAllocator_tryCollect(GlobalAllocator *self) {
     if (GC_is_collecting()) {
         return 0;
     }
 
+    if (GlobalAllocator_isMarking(self)) {
+        GC_collect();
+        return 1;
+    }
+
     size_t allocated = GlobalAllocator_allocatedBytesSinceCollect(self);
     size_t total = GlobalAllocator_heapSize(self);
 
@@ -148,24 +438,41 @@ static int GlobalAllocator_tryCollect(GlobalAllocator *self) {
         return 0;
     }
 
+    if (GlobalAllocator_shouldCollectMinor(self)) {
+        self->minor = 1;
+        GC_collect();
+        return 1;
+    }
+
+    if (self->incremental) {
+        GC_collect_a_little();
+        return 0;
+    }
+
     GC_collect();
     return 1;
 }
 
-Block *GC_GlobalAllocator_nextBlock(GlobalAllocator *self) {
+// Returns a recyclable or free block for an allocation of the given size.
+Block *GC_GlobalAllocator_nextBlock(GlobalAllocator *self, size_t size) {
     Block *block;
 
     GC_lock();
 
-    // 1. exhaust recyclable list:
-    block = BlockList_shift(&self->recyclable_list);
+    // 0. incremental marking in progress: mark a little
+    if (GlobalAllocator_isMarking(self)) {
+        GC_collect_a_little();
+    }
+
+    // 1. exhaust recyclable lists:
+    block = GlobalAllocator_shiftRecyclableBlock(self, size);
     if (block != NULL) {
         GC_unlock();
         return block;
     }
 
     // 2. exhaust free list:
-    block = BlockList_shift(&self->free_list);
+    block = GlobalAllocator_shiftFreeBlock(self);
     if (block != NULL) {
         GC_unlock();
         return block;
@@ -173,8 +480,8 @@ Block *GC_GlobalAllocator_nextBlock(GlobalAllocator *self) {
 
     // 3. no block? allocated enough since last collect? collect!
     if (GlobalAllocator_tryCollect(self)) {
-        // 4. exhaust freshly recycled list:
-        block = BlockList_shift(&self->recyclable_list);
+        // 4. exhaust freshly recycled lists:
+        block = GlobalAllocator_shiftRecyclableBlock(self, size);
         if (block != NULL) {
             GC_unlock();
             return block;
@@ -182,7 +489,7 @@ Block *GC_GlobalAllocator_nextBlock(GlobalAllocator *self) {
     }
 
     // 5. no free blocks? grow!
-    if (BlockList_isEmpty(&self->free_list)) {
+    if (!GlobalAllocator_hasFreeBlocks(self)) {
         GlobalAllocator_growSmall(self);
     }
 
@@ -204,7 +511,7 @@ Block *GC_GlobalAllocator_nextFreeBlock(GlobalAllocator *self) {
     GC_lock();
 
     // 1. exhaust free list:
-    block = BlockList_shift(&self->free_list);
+    block = GlobalAllocator_shiftFreeBlock(self);
     if (block != NULL) {
         GC_unlock();
         return block;
@@ -213,7 +520,7 @@ Block *GC_GlobalAllocator_nextFreeBlock(GlobalAllocator *self) {
     // 2. no block? collect!
     if (GlobalAllocator_tryCollect(self)) {
         // 2a. still no free blocks? grow!
-        if (BlockList_isEmpty(&self->free_list)) {
+        if (!GlobalAllocator_hasFreeBlocks(self)) {
             GlobalAllocator_growSmall(self);
         }
     } else {
@@ -233,14 +540,22 @@ Block *GC_GlobalAllocator_nextFreeBlock(GlobalAllocator *self) {
     abort();
 }
 
-void *GC_GlobalAllocator_allocateLarge(GlobalAllocator *self, size_t size, int atomic) {
-    size_t rsize = ROUND_TO_NEXT_MULTIPLE(size, WORD_SIZE);
+// The mutator address is aligned on a power of two (WORD_SIZE for unaligned
+// allocations).
+void *GC_GlobalAllocator_allocateLarge(GlobalAllocator *self, size_t size, size_t alignment, int atomic) {
+    // zero-sized objects get a word (see LocalAllocator_allocateSmallObject)
+    size_t rsize = ROUND_TO_NEXT_MULTIPLE(size == 0 ? 1 : size, WORD_SIZE);
     void *mutator;
 
     GC_lock();
 
+    // 0. incremental marking in progress: mark a little
+    if (GlobalAllocator_isMarking(self)) {
+        GC_collect_a_little();
+    }
+
     // 1. try to allocate
-    mutator = GlobalAllocator_tryAllocateLarge(self, rsize, atomic);
+    mutator = GlobalAllocator_tryAllocateLarge(self, rsize, alignment, atomic);
     if (mutator != NULL) {
         GC_unlock();
         return mutator;
@@ -249,18 +564,19 @@ void *GC_GlobalAllocator_allocateLarge(GlobalAllocator *self, size_t size, int a
     // 2. collect memory
     if (GlobalAllocator_tryCollect(self)) {
         // 2a. try to allocate (again)
-        mutator = GlobalAllocator_tryAllocateLarge(self, rsize, atomic);
+        mutator = GlobalAllocator_tryAllocateLarge(self, rsize, alignment, atomic);
         if (mutator != NULL) {
             GC_unlock();
             return mutator;
         }
     }
 
-    // 3. grow memory
-    GlobalAllocator_growLarge(self, rsize + sizeof(Chunk));
+    // 3. grow memory (aligned allocations may leave a free chunk before the
+    // object)
+    GlobalAllocator_growLarge(self, rsize + sizeof(Chunk) + (alignment > WORD_SIZE ? alignment + sizeof(Chunk) : 0));
 
     // 4. allocate!
-    mutator = GlobalAllocator_tryAllocateLarge(self, rsize, atomic);
+    mutator = GlobalAllocator_tryAllocateLarge(self, rsize, alignment, atomic);
     if (mutator != NULL) {
         GC_unlock();
         return mutator;
@@ -279,125 +595,198 @@ void GC_GlobalAllocator_deallocateLarge(__attribute__((__unused__)) GlobalAlloca
 
     GC_lock();
 
-    finalizer_t finalizer = GlobalAllocator_deleteFinalizer(self, &chunk->object);
-    if (finalizer != NULL) {
-        finalizer(Chunk_mutatorAddress(chunk));
-    }
+    // the finalizer is dropped, not called
+    GlobalAllocator_deleteFinalizer(self, &chunk->object);
 
+    GlobalAllocator_lockLarge(self);
     chunk->allocated = (uint8_t)0;
+    GlobalAllocator_unlockLarge(self);
 
     // TODO: merge with next free chunks (?)
 
     GC_unlock();
 }
 
+// Shifts the first block whose largest run of free granules can fit count
+// granules.
+static inline MediumBlock *GlobalAllocator_shiftMediumBlock(GlobalAllocator *self, int count) {
+    MediumBlock *previous = NULL;
+    MediumBlock *block = self->medium_list.first;
+
+    while (block != NULL) {
+        if (block->largest_run >= count) {
+            MediumBlockList_remove(&self->medium_list, previous, block);
+            return block;
+        }
+        previous = block;
+        block = block->next;
+    }
+    return NULL;
+}
+
+// Returns a medium block with a run of at least count free granules. The
+// previous block of the allocator (that couldn't fit the allocation) goes back
+// to the list, unless it can't fit any medium object anymore. Blocks are owned
+// by a single allocator until it releases them, or a collection resets
+// allocators.
+MediumBlock *GC_GlobalAllocator_nextMediumBlock(GlobalAllocator *self, MediumBlock *previous, int count) {
+    MediumBlock *block;
+
+    GC_lock();
+
+    // a collection may have listed the previous block already
+    if (previous != NULL && !previous->listed) {
+        previous->largest_run = (int16_t)MediumBlock_findLargestRun(previous);
+
+        if (previous->largest_run >= MEDIUM_MINIMUM_GRANULES) {
+            MediumBlockList_push(&self->medium_list, previous);
+        }
+    }
+
+    // 0. incremental marking in progress: mark a little
+    if (GlobalAllocator_isMarking(self)) {
+        GC_collect_a_little();
+    }
+
+    // 1. exhaust medium list:
+    block = GlobalAllocator_shiftMediumBlock(self, count);
+    if (block != NULL) {
+        GC_unlock();
+        return block;
+    }
+
+    // 2. no block? allocated enough since last collect? collect!
+    if (GlobalAllocator_tryCollect(self)) {
+        block = GlobalAllocator_shiftMediumBlock(self, count);
+        if (block != NULL) {
+            GC_unlock();
+            return block;
+        }
+    }
+
+    // 3. grow!
+    GlobalAllocator_growMedium(self);
+
+    block = GlobalAllocator_shiftMediumBlock(self, count);
+    if (block != NULL) {
+        GC_unlock();
+        return block;
+    }
+
+    // 4. seriously, no luck
+    fprintf(stderr, "GC: failed to allocate medium object granules=%d\n", count);
+    abort();
+}
+
+void GC_GlobalAllocator_deallocateMedium(GlobalAllocator *self, void *pointer) {
+    MediumBlock *block = MediumBlock_from(pointer);
+    Object *object = (Object *)pointer - 1;
+
+    GC_lock();
+
+    // not an allocated object (e.g. freed twice)
+    if (MediumBlock_findObject(block, object) != object) {
+        GC_unlock();
+        return;
+    }
+
+    // the finalizer is dropped, not called
+    GlobalAllocator_deleteFinalizer(self, object);
+
+    MediumBlock_deallocate(block, object);
+
+    // blocks owned by an allocator (or too full to be listed) are updated when
+    // they're released (or swept)
+    if (block->listed) {
+        block->largest_run = (int16_t)MediumBlock_findLargestRun(block);
+    }
+
+    GC_unlock();
+}
+
+// Sweeps the medium object space during the collection: frees the unmarked
+// objects in the granule bitmaps, then lists the blocks that can fit a medium
+// object (in address order).
+void GC_GlobalAllocator_sweepMedium(GlobalAllocator *self) {
+    MediumBlock *block = self->medium_heap_start;
+    MediumBlock *stop = self->medium_heap_stop;
+
+    MediumBlockList_clear(&self->medium_list);
+
+    for (; block < stop; block = (MediumBlock *)((char *)block + MEDIUM_BLOCK_SIZE)) {
+        MediumBlock_sweep(block);
+        block->listed = 0;
+
+        if (block->largest_run >= MEDIUM_MINIMUM_GRANULES) {
+            MediumBlockList_push(&self->medium_list, block);
+        }
+    }
+}
+
+// Lazy sweeping: the collection only resets the lists, blocks are swept (in
+// address order) as allocators need them, see GlobalAllocator_shiftFreeBlock
+// and GlobalAllocator_shiftRecyclableBlock.
 void GC_GlobalAllocator_recycleBlocks(GlobalAllocator *self) {
     BlockList_clear(&self->free_list);
-    BlockList_clear(&self->recyclable_list);
+    GlobalAllocator_clearRecyclableLists(self->recyclable_lists);
 
-    Block *block = self->small_heap_start;
-    Block *stop = self->small_heap_stop;
+    LineStats_clear(&self->line_stats);
 
-    while (block < stop) {
-        if (!Block_isMarked(block)) {
-            // free block
-            Block_setFree(block);
-            DEBUG("GC: free block=%p\n", (void *)block);
-            BlockList_push(&self->free_list, block);
-        } else {
-            // try to recycle block (find unmarked lines)
-            char *line_headers = block->line_headers;
-
-            int first_free_line_index = INVALID_LINE_INDEX;
-
-            // we determine, link and record holes (free lines) in a recycled
-            // block while sweeping (so allocating doesn't have to do it):
-            Hole *hole = NULL;
-            Hole *previous_hole = NULL;
-
-            // conservative marking (immix page 5): requires that we skip a free
-            // line (see below), and iterate free lines by 2, so we iterate up
-            // to N-1 only:
-            for (int line_index = 0; line_index < LINE_COUNT; line_index++) {
-                char *line_header = line_headers + line_index;
-
-                if (LineHeader_isMarked(line_header)) {
-                    if (hole != NULL) {
-                        //DEBUG("GC: line=%d marked=1 stop=%p\n", line_index, (void *)Block_line(block, line_index));
-                        hole->limit = Block_line(block, line_index);
-                        previous_hole = hole;
-                        hole = NULL;
-                    } else {
-                        //DEBUG("GC: line=%d marked=1\n", line_index);
-                    }
-                } else {
-                    //if (hole == NULL) {
-                    //    DEBUG("GC: line=%d marked=0 skip\n", line_index);
-                    //} else {
-                    //    DEBUG("GC: line=%d marked=0\n", line_index);
-                    //}
-                    LineHeader_clear(line_header);
-
-                    if (hole == NULL && line_index != LINE_COUNT - 1) {
-                        // conservative marking (immix page 5): the collector only
-                        // marked the starting line for small objects (smaller than
-                        // LINE_SIZE), but small objects may span a line, so we skip
-                        // a free line when determining holes:
-                        if (!LineHeader_isMarked(line_header + 1)) {
-                            line_index++;
-                            line_header++;
-
-                            LineHeader_clear(line_header);
-//#ifndef NDEBUG
-//                            // clear free lines: if marking was wrong it will
-//                            // corrupt allocations, causing a rapid segfault!
-//                            memset(Block_line(block, line_index), 0, LINE_SIZE);
-//#endif
-                            if (first_free_line_index == INVALID_LINE_INDEX) {
-                                first_free_line_index = line_index;
-                            }
-                            if (hole == NULL) {
-                                //DEBUG("GC: line=%d marked=0 start=%p\n", line_index, (void *)Block_line(block, line_index));
-                                hole = (Hole *)Block_line(block, line_index);
-                                Hole_init(hole);
-                            //} else {
-                            //    DEBUG("GC: line=%d marked=0\n", line_index);
-                            }
-                            if (previous_hole != NULL) {
-                                previous_hole->next = hole;
-                            }
-                        }
-                    }
-                }
-            }
+    self->sweep_cursor = Block_first(self->small_heap_start);
+    self->sweep_stop = Block_from(self->small_heap_stop);
+}
 
-            if (hole != NULL && hole->limit == NULL) {
-                //DEBUG("GC: line=126 marked=0 stop=%p\n", (void *)Block_stop(block));
-                hole->limit = Block_stop(block);
-            }
+void GC_GlobalAllocator_finishSweeping(GlobalAllocator *self) {
+    while (GlobalAllocator_isSweeping(self)) {
+        GlobalAllocator_sweepNextBlock(self);
+    }
+    while (GlobalAllocator_sweepLarge(self, SIZE_MAX));
+}
 
-            // at least 1 free line? recycle block; otherwise block is unavailable
-            if (first_free_line_index == INVALID_LINE_INDEX) {
-                DEBUG("GC: unavailable block=%p\n", (void *)block);
-                Block_setUnavailable(block);
-            } else {
-                DEBUG("GC: recyclable block=%p first_free_line_index=%d\n",
-                        (void *)block, first_free_line_index);
-                Block_setRecyclable(block, first_free_line_index);
-                BlockList_push(&self->recyclable_list, block);
+// Eager sweeping: sweeps the [start, stop) range of blocks. GC workers may
+// sweep different ranges in parallel, each with its own sweeper.
+void GC_GlobalAllocator_sweepBlocks(GlobalAllocator *self, Sweeper *sweeper, Block *start, Block *stop) {
+    BlockList_clear(&sweeper->free_list);
+    GlobalAllocator_clearRecyclableLists(sweeper->recyclable_lists);
+    LineStats_clear(&sweeper->line_stats);
 
-//#ifdef GC_DEBUG
-//                hole = (Hole *)Block_firstFreeLine(block);
-//                while (hole != NULL) {
-//                    intptr_t size = hole->limit - (char *)hole;
-//                    fprintf(stderr, "GC: hole start=%p limit=%p size=%ld next=%p\n",
-//                            (void *)hole, (void *)hole->limit, size, (void *)hole->next);
-//                    hole = hole->next;
-//                }
-//#endif
-            }
+    for (Block *block = start; block < stop; block = Block_next(block)) {
+        GlobalAllocator_sweepBlock(block, self->exact_line_marking, &sweeper->free_list, sweeper->recyclable_lists, &sweeper->line_stats);
+    }
+}
+
+// Eager sweeping: the sweepers swept consecutive ranges covering the whole
+// small object space; concatenates their lists (in address order).
+void GC_GlobalAllocator_recycleSweptBlocks(GlobalAllocator *self, Sweeper *sweepers, size_t count) {
+    BlockList_clear(&self->free_list);
+    GlobalAllocator_clearRecyclableLists(self->recyclable_lists);
+
+    LineStats_clear(&self->line_stats);
+    self->sweep_cursor = NULL;
+    self->sweep_stop = NULL;
+
+    for (size_t i = 0; i < count; i++) {
+        BlockList_append(&self->free_list, &sweepers[i].free_list);
+        for (int bucket = 0; bucket < RECYCLABLE_BUCKETS; bucket++) {
+            BlockList_append(self->recyclable_lists + bucket, sweepers[i].recyclable_lists + bucket);
         }
+        LineStats_add(&self->line_stats, &sweepers[i].line_stats);
+    }
+    self->swept_line_stats = self->line_stats;
+}
 
-        block = (Block *)((char *)block + BLOCK_SIZE);
+// Concurrent sweeping: sweeps at least count chunks of the large chunk list
+// (see ChunkList_sweepSome). Called by the background thread after each
+// collection, and by the program when it needs the whole HEAP to be swept.
+// Returns true if there are chunks left to sweep.
+int GC_GlobalAllocator_sweepLarge(GlobalAllocator *self, size_t count) {
+    GlobalAllocator_lockLarge(self);
+
+    if (self->large_sweep_cursor != NULL) {
+        self->large_sweep_cursor = ChunkList_sweepSome(&self->large_chunk_list, self->large_sweep_cursor, count);
     }
+    int more = self->large_sweep_cursor != NULL;
+
+    GlobalAllocator_unlockLarge(self);
+    return more;
 }
@@ -10,6 +10,7 @@
 #include "global_allocator.h"
 #include "local_allocator.h"
 #include "immix.h"
+#include "stack_roots.h"
 #include "utils.h"
 #include "options.h"
 
@@ -24,6 +25,17 @@ static Collector *GC_collector;
 
 static pthread_mutex_t *GC_mutex;
 
+static int GC_print_stats_after_collect;
+
+static size_t GC_nursery_size;
+
+// Incremental marking: the program stops the world when it calls
+// GC_collect_once (see GC_collect), so GC_collect_a_little takes the root
+// snapshot through GC_collect. The other threads must see that we're marking
+// (and the unmarked HEAP) once they resume, otherwise they would allocate white
+// objects or skip the write barrier.
+static int GC_start_marking;
+
 static inline void setLocalAllocator(LocalAllocator *local_allocator) {
   int err = pthread_setspecific(GC_local_allocator_key, local_allocator);
   if (err) {
@@ -80,13 +92,24 @@ void GC_init() {
         fprintf(stderr, "malloc failed: %s\n", strerror(errno));
         abort();
     }
-    Collector_init(collector, global_allocator);
+    Collector_init(collector, global_allocator, GC_workers(), GC_interiorPointers(), GC_concurrent());
+
+    GC_print_stats_after_collect = GC_printStats();
+    GC_nursery_size = GC_nurserySize();
 
     // Last but not least: initialize the current thread!
     GC_init_thread();
 }
 
+static int freeStackRoots(__attribute__((__unused__)) void *bottom, StackRoots *stack_roots) {
+    StackRoots_free(stack_roots);
+    return 1;
+}
+
 void GC_deinit() {
+    Hash_deleteIf(collector->stack_roots, (hash_iterator_t)freeStackRoots);
+    Hash_free(collector->stack_roots);
+    free(collector->pinned_roots.buffer);
     free(collector);
     collector = NULL;
 
@@ -110,7 +133,7 @@ void GC_init_thread() {
         fprintf(stderr, "malloc failed %s\n", strerror(errno));
         abort();
     }
-    LocalAllocator_init((LocalAllocator *)local_allocator, global_allocator);
+    LocalAllocator_init((LocalAllocator *)local_allocator, global_allocator, GC_nursery_size);
     setLocalAllocator((LocalAllocator *)local_allocator);
 
     GC_lock();
@@ -121,6 +144,8 @@ void GC_init_thread() {
 void GC_deinit_thread(void *local_allocator) {
     GC_lock();
     Array_delete(GC_local_allocators, local_allocator);
+    LocalAllocator_releaseIoPool((LocalAllocator *)local_allocator);
+    Nursery_deinit(&((LocalAllocator *)local_allocator)->nursery);
     GC_unlock();
 
     free(local_allocator);
@@ -155,18 +180,76 @@ static inline void *GC_malloc_with_atomic(size_t size, int atomic) {
         DEBUG("GC: malloc object=%p size=%zu actual=%zu atomic=%d ptr=%p\n",
                 (void *)((Object *)pointer - 1),
                 size,
-                ((Object *)pointer - 1)->size,
+                Object_size((Object *)pointer - 1),
+                atomic, pointer);
+    } else if (size <= MEDIUM_OBJECT_SIZE - sizeof(Object)) {
+        pointer = LocalAllocator_allocateMedium(getLocalAllocator(), size, atomic);
+
+        DEBUG("GC: malloc medium object=%p size=%zu actual=%zu atomic=%d ptr=%p\n",
+                (void *)((Object *)pointer - 1),
+                size,
+                Object_size((Object *)pointer - 1),
                 atomic, pointer);
     } else {
-        pointer = GlobalAllocator_allocateLarge(global_allocator, size, atomic);
+        pointer = GlobalAllocator_allocateLarge(global_allocator, size, WORD_SIZE, atomic);
 
         DEBUG("GC: malloc chunk=%p size=%zu actual=%zu atomic=%d ptr=%p\n",
                 (void *)((Chunk *)pointer - 1),
                 size,
-                ((Chunk *)pointer - 1)->object.size + CHUNK_HEADER_SIZE,
+                ((Chunk *)pointer - 1)->size + CHUNK_HEADER_SIZE,
                 atomic, pointer);
     }
 
+    // evacuation: words the program never writes (e.g. padding) mustn't hold
+    // stale pointers, that the collector would update
+    if (global_allocator->evacuate && !atomic) {
+        memset(pointer, 0, Object_mutatorSize((Object *)pointer - 1));
+    }
+
+    return pointer;
+}
+
+// Small objects are aligned by padding the cursor (see
+// LocalAllocator_allocateSmallAligned). Medium objects start on a granule, so
+// aligned objects that aren't small are allocated to the large object space,
+// whose free chunks are split on the alignment.
+static inline void *GC_memalign_with_atomic(size_t alignment, size_t size, int atomic) {
+    void *pointer;
+
+    if (!IS_POWER_OF_TWO(alignment)) {
+        fprintf(stderr, "GC: invalid alignment %zu (must be a power of two)\n", alignment);
+        abort();
+    }
+
+    if (alignment <= WORD_SIZE) {
+        return GC_malloc_with_atomic(size, atomic);
+    }
+
+    if (alignment <= LINE_SIZE && size <= LARGE_OBJECT_SIZE - sizeof(Object) - alignment) {
+        pointer = LocalAllocator_allocateSmallAligned(getLocalAllocator(), size, alignment, atomic);
+
+        DEBUG("GC: memalign object=%p size=%zu actual=%zu alignment=%zu atomic=%d ptr=%p\n",
+                (void *)((Object *)pointer - 1),
+                size,
+                Object_size((Object *)pointer - 1),
+                alignment, atomic, pointer);
+    } else {
+        pointer = GlobalAllocator_allocateLarge(global_allocator, size, alignment, atomic);
+
+        DEBUG("GC: memalign chunk=%p size=%zu actual=%zu alignment=%zu atomic=%d ptr=%p\n",
+                (void *)((Chunk *)pointer - 1),
+                size,
+                ((Chunk *)pointer - 1)->size + CHUNK_HEADER_SIZE,
+                alignment, atomic, pointer);
+    }
+
+    assert((uintptr_t)pointer % alignment == 0);
+
+    // see GC_malloc_with_atomic
+    if (global_allocator->evacuate && !atomic) {
+        memset(pointer, 0, Object_mutatorSize((Object *)pointer - 1));
+    }
+
     return pointer;
 }
 
@@ -178,6 +261,43 @@ void* GC_malloc_atomic(size_t size) {
     return GC_malloc_with_atomic(size, 1);
 }
 
+void* GC_memalign(size_t alignment, size_t size) {
+    return GC_memalign_with_atomic(alignment, size, 0);
+}
+
+void* GC_memalign_atomic(size_t alignment, size_t size) {
+    return GC_memalign_with_atomic(alignment, size, 1);
+}
+
+void* GC_malloc_io(size_t size) {
+    void *pointer = LocalAllocator_allocateIo(getLocalAllocator(), size);
+    DEBUG("GC: malloc_io size=%zu ptr=%p\n", size, pointer);
+    return pointer;
+}
+
+void GC_free_io(void *pointer) {
+    DEBUG("GC: free_io ptr=%p\n", pointer);
+    LocalAllocator_freeIo(getLocalAllocator(), pointer);
+}
+
+void* GC_malloc_base_only(size_t size) {
+    void *pointer = GC_malloc_with_atomic(size, 0);
+    Object_setBaseOnly((Object *)pointer - 1);
+    return pointer;
+}
+
+void* GC_malloc_atomic_base_only(size_t size) {
+    void *pointer = GC_malloc_with_atomic(size, 1);
+    Object_setBaseOnly((Object *)pointer - 1);
+    return pointer;
+}
+
+void GC_register_displacement(size_t offset) {
+    GC_lock();
+    Collector_registerDisplacement(collector, offset);
+    GC_unlock();
+}
+
 void* GC_realloc(void *pointer, size_t size) {
     // realloc(3) compatibility
     if (pointer == NULL) {
@@ -202,6 +322,10 @@ void* GC_realloc(void *pointer, size_t size) {
     void *new_pointer = GC_malloc_with_atomic(size, object->atomic);
     memcpy(new_pointer, pointer, available);
 
+    if (Object_isBaseOnly(object)) {
+        Object_setBaseOnly((Object *)new_pointer - 1);
+    }
+
     finalizer_t finalizer = GlobalAllocator_deleteFinalizer(global_allocator, object);
     if (finalizer != NULL) {
         Object *new_object = (Object *)((char *)new_pointer - sizeof(Object));
@@ -217,23 +341,154 @@ void* GC_realloc(void *pointer, size_t size) {
 void GC_free(void *pointer) {
     DEBUG("GC: free ptr=%p\n", pointer);
 
-    if (GlobalAllocator_inLargeHeap(global_allocator, pointer)) {
+    // freeing resets the object flags: drop the pins, so the pinned roots
+    // don't keep the address
+    Object *object = GlobalAllocator_findObject(global_allocator, pointer, 0);
+    if (object == NULL) return;
+
+    if (Object_isPinnedRoot(object)) {
+        GC_lock();
+        Collector_unpinAll(collector, pointer);
+        GC_unlock();
+    }
+
+    if (GlobalAllocator_inSmallHeap(global_allocator, pointer)) {
+        LocalAllocator_deallocateSmall(getLocalAllocator(), pointer);
+    } else if (GlobalAllocator_inMediumHeap(global_allocator, pointer)) {
+        GlobalAllocator_deallocateMedium(global_allocator, pointer);
+    } else if (GlobalAllocator_inLargeHeap(global_allocator, pointer)) {
         GlobalAllocator_deallocateLarge(global_allocator, pointer);
     }
 }
 
 void GC_register_finalizer(void *pointer, finalizer_t callback) {
     Object *object = (Object *)pointer - 1;
+
+    // only global collections run finalizers
+    if (GC_nursery_size) {
+        Nursery_publish(&getLocalAllocator()->nursery, object);
+    }
     GlobalAllocator_registerFinalizer(global_allocator, object, callback);
 }
 
-void GC_collect_once() {
+void GC_pin(void *pointer) {
+    GC_lock();
+    Collector_pin(collector, pointer);
+    GC_unlock();
+}
+
+void GC_unpin(void *pointer) {
+    GC_lock();
+    Collector_unpin(collector, pointer);
+    GC_unlock();
+}
+
+Roots *GC_nursery_roots() {
+    Collector_addNurseryRoots(collector);
+    return &collector->roots;
+}
+
+static void lockNursery(LocalAllocator *local_allocator) {
+    Nursery_lock(&local_allocator->nursery);
+}
+
+static void unlockNursery(LocalAllocator *local_allocator) {
+    Nursery_unlock(&local_allocator->nursery);
+}
+
+static void resetNursery(LocalAllocator *local_allocator) {
+    Nursery_reset(&local_allocator->nursery);
+}
+
+static void collectHeap() {
     Collector_setCollecting(collector, 1);
     Collector_collect(collector);
+
+    // release all nurseries before allocators sweep blocks
+    if (GC_nursery_size) {
+        Array_each(GC_local_allocators, (Array_iterator_t)resetNursery);
+    }
     Array_each(GC_local_allocators, (Array_iterator_t)LocalAllocator_reset);
     Collector_setCollecting(collector, 0);
 }
 
+void GC_collect_once() {
+    int start_marking = GC_start_marking && !Collector_isMarking(collector);
+    GC_start_marking = 0;
+
+    // wait for running nursery collections to complete
+    if (GC_nursery_size) {
+        Array_each(GC_local_allocators, (Array_iterator_t)lockNursery);
+    }
+
+    // the collector doesn't mark pooled IO buffers
+    Array_each(GC_local_allocators, (Array_iterator_t)LocalAllocator_releaseIoPool);
+
+    if (start_marking) {
+        Collector_startMarking(collector);
+    } else {
+        collectHeap();
+    }
+
+    if (GC_nursery_size) {
+        Array_each(GC_local_allocators, (Array_iterator_t)unlockNursery);
+    }
+
+    if (GC_print_stats_after_collect && !start_marking) {
+        GC_print_stats();
+    }
+}
+
+int GC_collect_a_little() {
+    int more = 0;
+
+    GC_lock();
+
+    if (!Collector_isCollecting(collector)) {
+        if (!Collector_isMarking(collector)) {
+            // the program may not collect right away (e.g. it's already
+            // collecting), then we'll try again on the next step
+            GC_start_marking = 1;
+            GC_collect();
+            GC_start_marking = 0;
+            more = 1;
+        } else if (Collector_markStep(collector)) {
+            more = 1;
+        } else {
+            // marking completed: remark & sweep
+            GC_collect();
+        }
+    }
+
+    GC_unlock();
+    return more;
+}
+
+void GC_write_barrier(void *pointer) {
+    if (!GC_nursery_size && !GlobalAllocator_needsWriteBarrier(global_allocator)) return;
+
+    // any pointer into the object (or no object at all)
+    Object *object = GlobalAllocator_findObject(global_allocator, pointer, 1);
+    if (object == NULL) return;
+
+    if (GC_nursery_size) {
+        Nursery_publishReferences(&getLocalAllocator()->nursery, object);
+    }
+    GlobalAllocator_writeBarrier(global_allocator, object);
+}
+
+void GC_publish(void *pointer) {
+    if (GC_nursery_size) {
+        Nursery_publish(&getLocalAllocator()->nursery, (Object *)pointer - 1);
+    }
+}
+
+void GC_set_stackbottom(void *stack_bottom) {
+    if (GC_nursery_size) {
+        getLocalAllocator()->nursery.stack_bottom = stack_bottom;
+    }
+}
+
 void GC_register_collect_callback(collect_callback_t collect_callback) {
     Collector_registerCollectCallback(collector, collect_callback);
 }
@@ -246,12 +501,22 @@ void GC_add_roots(void *stack_pointer, void *stack_bottom, const char *source) {
     Collector_addRoots(collector, stack_pointer, stack_bottom, source);
 }
 
+void GC_add_cached_roots(void *stack_pointer, void *stack_bottom, const char *source, size_t epoch) {
+    Collector_addCachedRoots(collector, stack_pointer, stack_bottom, source, epoch);
+}
+
 void GC_small_heap_stats(size_t *count, size_t *bytes) {
     *count = 0;
     *bytes = 0;
 
-    Block *block = global_allocator->small_heap_start;
-    Block *stop = global_allocator->small_heap_stop;
+    // lazy and concurrent sweeping: blocks and chunks that weren't swept yet
+    // still contain dead objects
+    GC_lock();
+    GlobalAllocator_finishSweeping(global_allocator);
+    GC_unlock();
+
+    Block *block = Block_first(global_allocator->small_heap_start);
+    Block *stop = Block_from(global_allocator->small_heap_stop);
 
     while (block < stop) {
         char *line_headers = Block_lineHeaders(block);
@@ -267,15 +532,33 @@ void GC_small_heap_stats(size_t *count, size_t *bytes) {
                     Object *object = (Object *)(line + offset);
                     if (object->size == 0) break;
 
-                    *count += 1;
-                    *bytes += object->size - sizeof(Object);
+                    // alignment padding and freed objects aren't allocations
+                    if (!Object_isFiller(object)) {
+                        *count += 1;
+                        *bytes += object->size - sizeof(Object);
+                    }
 
                     offset = offset + object->size;
                 }
             }
         }
 
-        block = (Block *)((char *)block + BLOCK_SIZE);
+        block = Block_next(block);
+    }
+}
+
+void GC_medium_heap_stats(size_t *count, size_t *bytes) {
+    *count = 0;
+    *bytes = 0;
+
+    MediumBlock *block = global_allocator->medium_heap_start;
+    MediumBlock *stop = global_allocator->medium_heap_stop;
+
+    for (; block < stop; block = (MediumBlock *)((char *)block + MEDIUM_BLOCK_SIZE)) {
+        for (int i = MediumBlock_nextObject(block, 1); i < MEDIUM_GRANULE_COUNT; i = MediumBlock_nextObject(block, i + 1)) {
+            *count += 1;
+            *bytes += MediumBlock_granule(block, i)->size - sizeof(Object);
+        }
     }
 }
 
@@ -283,37 +566,83 @@ void GC_large_heap_stats(size_t *count, size_t *bytes) {
     *count = 0;
     *bytes = 0;
 
+    GC_lock();
+    GlobalAllocator_finishSweeping(global_allocator);
+    GC_unlock();
+
     Chunk *chunk = global_allocator->large_chunk_list.first;
     while (chunk != NULL) {
         if (chunk->allocated) {
             *count += 1;
-            *bytes += chunk->object.size - sizeof(Object);
+            *bytes += chunk->size - sizeof(Object);
         }
         chunk = chunk->next;
     }
 }
 
+void GC_blacklist_stats(size_t *lines, size_t *addresses, size_t *bytes) {
+    *lines = global_allocator->line_stats.blacklisted_lines;
+    *addresses = GlobalAllocator_largeBlacklistSize(global_allocator);
+    *bytes = global_allocator->blacklisted_bytes;
+}
+
 size_t GC_get_memory_use() {
     return GlobalAllocator_heapSize(global_allocator);
 }
 
 size_t GC_get_heap_usage() {
     size_t small_count, small_bytes;
+    size_t medium_count, medium_bytes;
     size_t large_count, large_bytes;
 
     GC_small_heap_stats(&small_count, &small_bytes);
+    GC_medium_heap_stats(&medium_count, &medium_bytes);
     GC_large_heap_stats(&large_count, &large_bytes);
 
-    return small_bytes + large_bytes;
+    return small_bytes + medium_bytes + large_bytes;
 }
 
-//void GC_print_stats() {
-//    size_t small_count, small_bytes;
-//    size_t large_count, large_bytes;
-//
-//    GC_small_heap_stats(&small_count, &small_bytes);
-//    GC_large_heap_stats(&large_count, &large_bytes);
-//
-//    fprintf(stderr, "\nGC: small: count=%zu bytes=%zu; large: count=%zu bytes=%zu\n; total count=%zu bytes=%zu\n",
-//            small_count, small_bytes, large_count, large_bytes, small_count + large_count, small_bytes + large_bytes);
-//}
+static void printNurseryStats() {
+    size_t collections = 0, freed_bytes = 0, published_bytes = 0, released_blocks = 0;
+    uint64_t nanoseconds = 0;
+
+    GC_lock();
+    for (long i = 0; i < Array_size(GC_local_allocators); i++) {
+        Nursery *nursery = &((LocalAllocator *)GC_local_allocators->buffer[i])->nursery;
+        collections += nursery->collections;
+        nanoseconds += nursery->nanoseconds;
+        freed_bytes += nursery->freed_bytes;
+        published_bytes += nursery->published_bytes;
+        released_blocks += nursery->released_blocks;
+    }
+    GC_unlock();
+
+    fprintf(stderr, "GC: nursery threads=%ld collections=%zu time=%luus freed_bytes=%zu published_bytes=%zu released_blocks=%zu\n",
+            Array_size(GC_local_allocators), collections, (unsigned long)(nanoseconds / 1000),
+            freed_bytes, published_bytes, released_blocks);
+}
+
+void GC_print_stats() {
+    size_t small_count, small_bytes;
+    size_t medium_count, medium_bytes;
+    size_t large_count, large_bytes;
+
+    GC_small_heap_stats(&small_count, &small_bytes);
+    GC_medium_heap_stats(&medium_count, &medium_bytes);
+    GC_large_heap_stats(&large_count, &large_bytes);
+
+    fprintf(stderr, "GC: small: count=%zu bytes=%zu; medium: count=%zu bytes=%zu; large: count=%zu bytes=%zu; total count=%zu bytes=%zu\n",
+            small_count, small_bytes, medium_count, medium_bytes, large_count, large_bytes,
+            small_count + medium_count + large_count, small_bytes + medium_bytes + large_bytes);
+
+    size_t lines, addresses, bytes;
+    GC_blacklist_stats(&lines, &addresses, &bytes);
+    fprintf(stderr, "GC: blacklist lines=%zu large_addresses=%zu large_skipped_bytes=%zu\n",
+            lines, addresses, bytes);
+
+    if (GC_nursery_size) {
+        printNurseryStats();
+    }
+
+    Collector_printStats(collector);
+}
@@ -3,23 +3,45 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "local_allocator.h"
+#include "immix.h"
 #include "line_header.h"
+#include "memory.h"
 
-static inline void LocalAllocator_initCursor(LocalAllocator *self) {
-    self->block = GlobalAllocator_nextBlock(self->global_allocator);
+static inline Block *LocalAllocator_nextBlock(LocalAllocator *self, size_t size) {
+    // objects allocated while marking are allocated black into the shared
+    // heap (and allocating takes marking steps)
+    if (Nursery_isEnabled(&self->nursery) && !GlobalAllocator_isMarking(self->global_allocator)) {
+        return Nursery_nextBlock(&self->nursery);
+    }
+    return GlobalAllocator_nextBlock(self->global_allocator, size);
+}
+
+// Atomic objects are allocated into atomic blocks, and other objects into
+// blocks that may contain pointers. Recyclable blocks are shared: an atomic
+// block recycled for other objects loses its flag, while atomic objects may be
+// allocated into blocks that aren't atomic. The size is the allocation that
+// didn't fit the previous block (see GlobalAllocator_shiftRecyclableBlock).
+static inline void LocalAllocator_initCursor(LocalAllocator *self, Cursor *cursor, size_t size, int atomic) {
+    Block *block = LocalAllocator_nextBlock(self, size);
+    cursor->block = block;
 
-    if (Block_isFree(self->block)) {
-        self->cursor = Block_start(self->block);
-        self->limit = Block_stop(self->block);
+    if (!atomic) {
+        Block_clearAtomic(block);
+    } else if (Block_isFree(block)) {
+        Block_setAtomic(block);
+    }
+
+    if (Block_isFree(block)) {
+        cursor->cursor = Block_start(block);
+        cursor->limit = Block_stop(block);
+        cursor->next_line_index = INVALID_LINE_INDEX;
         return;
     }
 
-    if (Block_isRecyclable(self->block)) {
-         self->cursor = Block_firstFreeLine(self->block);
-         Hole *hole = (Hole *)self->cursor;
-         self->limit = hole->limit;
-         self->next = hole->next;
+    if (Block_isRecyclable(block)) {
+         cursor->next_line_index = Block_nextHole(block, block->first_free_line_index, &cursor->cursor, &cursor->limit);
          return;
     }
 
@@ -27,14 +49,18 @@ static inline void LocalAllocator_initCursor(LocalAllocator *self) {
     abort();
 }
 
-static inline int LocalAllocator_findNextHole(LocalAllocator *self) {
-    if (self->next) {
-        self->cursor = (char *)self->next;
-        self->limit = self->next->limit;
-        self->next = self->next->next;
-        return 1;
-    }
-    return 0;
+static inline void LocalAllocator_clearCursor(Cursor *cursor) {
+    cursor->block = NULL;
+    cursor->cursor = NULL;
+    cursor->limit = NULL;
+    cursor->next_line_index = INVALID_LINE_INDEX;
+}
+
+static inline int LocalAllocator_findNextHole(Cursor *cursor) {
+    if (cursor->next_line_index == INVALID_LINE_INDEX) return 0;
+
+    cursor->next_line_index = Block_nextHole(cursor->block, cursor->next_line_index, &cursor->cursor, &cursor->limit);
+    return cursor->next_line_index != INVALID_LINE_INDEX;
 }
 
 static inline void LocalAllocator_initOverflowCursor(LocalAllocator *self) {
@@ -43,12 +69,37 @@ static inline void LocalAllocator_initOverflowCursor(LocalAllocator *self) {
     self->overflow_limit = Block_stop(self->overflow_block);
 }
 
+// Returns the pages of an IO buffer to the kernel. Holds the large chunk list
+// lock: the background thread may be sweeping the chunks.
+static inline void LocalAllocator_releasePages(LocalAllocator *self, void *pointer) {
+    GlobalAllocator_lockLarge(self->global_allocator);
+    size_t size = Object_mutatorSize((Object *)pointer - 1);
+    GC_release(pointer, size & ~(GC_getPageSize() - 1));
+    GlobalAllocator_unlockLarge(self->global_allocator);
+}
+
 // TODO: Get 2 blocks from the global allocator at once, one that may be a
 //       recycled or free block, and another one that must be a free block for
 //       overflow allocations; then initialize cursors. That may allow the
 //       global allocator to decide better when and how much to grow the HEAP.
 void GC_LocalAllocator_reset(LocalAllocator *self) {
-    LocalAllocator_initCursor(self);
+    // the atomic cursor gets a block on the first atomic allocation, and the
+    // medium block on the first medium allocation (the collection swept the
+    // previous one)
+    LocalAllocator_clearCursor(&self->atomic);
+    self->medium_block = NULL;
+
+    if (Nursery_isEnabled(&self->nursery)) {
+        // a global collection released the nursery (see GC_collect_once);
+        // medium objects are always allocated into the nursery (no overflow
+        // block) because objects in the shared heap aren't local
+        self->overflow_block = NULL;
+        self->overflow_cursor = NULL;
+        self->overflow_limit = NULL;
+        LocalAllocator_initCursor(self, &self->small, sizeof(Object), 0);
+        return;
+    }
+    LocalAllocator_initCursor(self, &self->small, sizeof(Object), 0);
     LocalAllocator_initOverflowCursor(self);
 }
 
@@ -59,7 +110,6 @@ static inline Object *LocalAllocator_overflowAllocateSmall(LocalAllocator *self,
 
         if (stop <= self->overflow_limit) {
             Object *object = (Object *)cursor;
-            Line_update(self->overflow_block, object);
 
             // make sure to clear the size of next object in line, in order to
             // know when to stop iterating objects in the line; obviously we
@@ -79,25 +129,49 @@ static inline Object *LocalAllocator_overflowAllocateSmall(LocalAllocator *self,
     }
 }
 
-static inline Object *LocalAllocator_tryAllocateSmall(LocalAllocator *self, size_t size) {
+// Returns the address of the first object at or after the cursor whose mutator
+// address is aligned.
+static inline char *LocalAllocator_align(char *cursor, size_t alignment) {
+    if (alignment <= WORD_SIZE) return cursor;
+
+    uintptr_t mutator = ROUND_TO_NEXT_MULTIPLE((uintptr_t)cursor + sizeof(Object), alignment);
+    return (char *)(mutator - sizeof(Object));
+}
+
+// Aligned allocations: fills the gap before the aligned object with a filler,
+// so walking the objects of a line still works.
+static inline void LocalAllocator_fill(char *start, char *stop) {
+    // the filler is published before the object that follows is initialized:
+    // walkers must stop after the filler (a background thread may be marking)
+    ((Object *)stop)->size = 0;
+
+    Object *filler = (Object *)start;
+    Object_allocateFiller(filler, (size_t)(stop - start));
+    Line_update(Block_from(filler), filler);
+}
+
+static inline Object *LocalAllocator_tryAllocateSmall(LocalAllocator *self, Cursor *cursor, size_t size, size_t alignment) {
     while (1) {
-        char *cursor = self->cursor;
-        char *stop = cursor + size;
+        char *start = LocalAllocator_align(cursor->cursor, alignment);
+        char *stop = start + size;
 
         // object fits current hole
-        if (stop <= self->limit) {
-            Object *object = (Object *)cursor;
-            Line_update(self->block, object);
+        if (stop <= cursor->limit) {
+            Object *object = (Object *)start;
+
+            if (start > cursor->cursor) {
+                LocalAllocator_fill(cursor->cursor, start);
+            }
 
             // make sure to clear the size of next object in line, in order to
             // know when to stop iterating objects in the line; obviously we
             // don't clear if we'd cross the limit:
-            if (stop < self->limit) {
+            if (stop < cursor->limit) {
                 ((Object *)stop)->size = 0;
             }
 
             // update cursor
-            self->cursor = stop;
+            cursor->cursor = stop;
 
             return object;
         }
@@ -106,32 +180,237 @@ static inline Object *LocalAllocator_tryAllocateSmall(LocalAllocator *self, size
         // medium object into the current hole, but there are one or more
         // free lines available in the current hole, we allocate into an
         // overflow block, to avoid wasting holes for occasional medium sized
-        // objects:
-        if (size > LINE_SIZE && (self->limit - cursor) > LINE_SIZE) {
+        // objects (but not atomic or aligned objects: they'd end up in a block
+        // with pointers, or unaligned):
+        if (size > LINE_SIZE && (cursor->limit - start) > LINE_SIZE && self->overflow_block != NULL && cursor == &self->small && alignment <= WORD_SIZE) {
             return LocalAllocator_overflowAllocateSmall(self, size);
         }
 
         // reached end of block
-        if (!LocalAllocator_findNextHole(self)) {
+        if (!LocalAllocator_findNextHole(cursor)) {
             return NULL;
         }
     }
 }
 
+// Incremental marking: objects allocated while marking are marked (so they
+// survive the collection) and dirty, so the program doesn't have to call the
+// write barrier when initializing them (they're scanned when marking
+// completes).
+static inline void LocalAllocator_allocateBlack(LocalAllocator *self, Object *object, int atomic) {
+    Block *block = Block_from(object);
+
+    Object_mark(object);
+    Block_mark(block);
+    Block_markObjectLines(block, object, self->global_allocator->exact_line_marking);
+
+    if (!atomic) {
+        Object_setDirty(object);
+        Block_setDirty(block);
+    }
+}
+
+static inline void *LocalAllocator_allocateSmallObject(LocalAllocator *self, size_t size, size_t alignment, int atomic) {
+    // zero-sized objects get a word: the mutator address must be inside the
+    // object, otherwise it would point to the next object, and references
+    // wouldn't keep the object alive (see GC_free)
+    size_t rsize = ROUND_TO_NEXT_MULTIPLE((size == 0 ? 1 : size) + sizeof(Object), WORD_SIZE);
+    assert(rsize <= LARGE_OBJECT_SIZE);
+
+    // nursery blocks are shared by all the allocations of the thread: a
+    // nursery collection recycles the blocks that cursors point into
+    int segregate = atomic && !Nursery_isEnabled(&self->nursery);
+    Cursor *cursor = segregate ? &self->atomic : &self->small;
+
+    while (1) {
+        Object *object = LocalAllocator_tryAllocateSmall(self, cursor, rsize, alignment);
+
+        if (object != NULL) {
+            // initialize the object before we update the line header: a
+            // background thread may be marking
+            Object_allocate(object, rsize, atomic);
+            if (alignment > WORD_SIZE) Object_setAligned(object);
+            Line_update(Block_from(object), object);
+
+            if (GlobalAllocator_isMarking(self->global_allocator)) {
+                LocalAllocator_allocateBlack(self, object, atomic);
+            }
+            if (Nursery_contains(&self->nursery, object)) {
+                GlobalAllocator_incrementTotalCounter(self->global_allocator, size);
+            } else {
+                GlobalAllocator_incrementCounters(self->global_allocator, size);
+            }
+            return Object_mutatorAddress(object);
+        }
+
+        // failed to allocate: get another block (with a hole that fits the
+        // alignment padding)
+        LocalAllocator_initCursor(self, cursor, alignment > WORD_SIZE ? rsize + alignment : rsize, segregate);
+    }
+}
+
 void *GC_LocalAllocator_allocateSmall(LocalAllocator *self, size_t size, int atomic) {
+    return LocalAllocator_allocateSmallObject(self, size, WORD_SIZE, atomic);
+}
+
+// The mutator address is aligned (a power of two of at most LINE_SIZE). The
+// object must fit a small object with the alignment padding.
+void *GC_LocalAllocator_allocateSmallAligned(LocalAllocator *self, size_t size, size_t alignment, int atomic) {
+    assert(alignment <= LINE_SIZE);
+    assert(size + sizeof(Object) + alignment <= LARGE_OBJECT_SIZE);
+    return LocalAllocator_allocateSmallObject(self, size, alignment, atomic);
+}
+
+// Pops the cursor back when the object is the last object allocated into the
+// cursor's block. The object must be in the same block: the previous block may
+// be owned by another allocator.
+static inline int LocalAllocator_popCursor(char **cursor, Block *block, Block *cursor_block, Object *object) {
+    if (block != cursor_block || (char *)object + object->size != *cursor) {
+        return 0;
+    }
+
+    // the next allocation starts here; walkers stop at the cleared size (see
+    // LocalAllocator_tryAllocateSmall)
+    __atomic_store_n(&object->size, 0, __ATOMIC_RELEASE);
+    *cursor = (char *)object;
+    return 1;
+}
+
+// The program frees an object (see GC_free): the space is reused immediately
+// when the object is the last allocation of one of our cursors, otherwise the
+// object becomes a filler that the next collection frees.
+// Ignores pointers that aren't the base address of an object, and objects
+// freed already. GC_free drops the pins of the object first (see
+// Collector_unpinAll).
+void GC_LocalAllocator_deallocateSmall(LocalAllocator *self, void *pointer) {
+    Block *block = Block_from((char *)pointer - sizeof(Object));
+    Object *object = Block_findObject(block, (char *)pointer - sizeof(Object));
+    if (object == NULL || Object_isFiller(object)) return;
+
+    size_t size = object->size;
+
+    assert(size > 0 && size <= LARGE_OBJECT_SIZE);
+
+    // the finalizer is dropped, not called
+    if (Object_hasFinalizer(object)) {
+        GC_lock();
+        GlobalAllocator_deleteFinalizer(self->global_allocator, object);
+        GC_unlock();
+    }
+
+    if (!LocalAllocator_popCursor(&self->small.cursor, block, self->small.block, object) &&
+            !LocalAllocator_popCursor(&self->atomic.cursor, block, self->atomic.block, object) &&
+            !LocalAllocator_popCursor(&self->overflow_cursor, block, self->overflow_block, object)) {
+        Object_allocateFiller(object, size);
+    }
+
+    // nursery objects only count once the nursery is released
+    if (block->owner == NULL) {
+        GlobalAllocator_decrementCollectCounter(self->global_allocator, size - sizeof(Object));
+    }
+}
+
+// Medium objects are allocated into the shared heap, even when nurseries are
+// enabled, like large objects.
+void *GC_LocalAllocator_allocateMedium(LocalAllocator *self, size_t size, int atomic) {
     size_t rsize = ROUND_TO_NEXT_MULTIPLE(size + sizeof(Object), WORD_SIZE);
-    assert(rsize <= LARGE_OBJECT_SIZE);
+    assert(rsize <= MEDIUM_OBJECT_SIZE);
+
+    int count = MediumBlock_granuleCount(rsize);
 
     while (1) {
-        Object *object = LocalAllocator_tryAllocateSmall(self, rsize);
+        MediumBlock *block = self->medium_block;
+        Object *object = block == NULL ? NULL : MediumBlock_allocate(block, count);
 
         if (object != NULL) {
+            // initialize the object before we publish it: a background thread
+            // may be marking
             Object_allocate(object, rsize, atomic);
+            MediumBlock_publish(block, object);
+
+            if (GlobalAllocator_isMarking(self->global_allocator)) {
+                // allocate black (see LocalAllocator_allocateBlack)
+                Object_mark(object);
+                MediumBlock_mark(block);
+
+                if (!atomic) {
+                    Object_setDirty(object);
+                    MediumBlock_setDirty(block);
+                }
+            }
             GlobalAllocator_incrementCounters(self->global_allocator, size);
             return Object_mutatorAddress(object);
         }
 
         // failed to allocate: get another block
-        LocalAllocator_initCursor(self);
+        self->medium_block = GlobalAllocator_nextMediumBlock(self->global_allocator, block, count);
+    }
+}
+
+// IO buffers are large objects covering whole pages: the chunk metadata is in
+// the page before the buffer (see GlobalAllocator_largeAlignmentSkip) and the
+// next chunk starts on the page that follows, so the buffer's pages only hold
+// the buffer. Freed buffers are recycled from the pool first, picking the
+// smallest one that fits and wastes less than half of its pages.
+void *GC_LocalAllocator_allocateIo(LocalAllocator *self, size_t size) {
+    size_t page_size = GC_getPageSize();
+    size_t rsize = ROUND_TO_NEXT_MULTIPLE(size == 0 ? 1 : size, page_size);
+    int found = -1;
+
+    for (int i = 0; i < self->io_pool_size; i++) {
+        size_t available = Object_mutatorSize((Object *)self->io_pool[i] - 1);
+
+        if (available >= rsize && available / 2 < rsize) {
+            if (found == -1 || available < Object_mutatorSize((Object *)self->io_pool[found] - 1)) {
+                found = i;
+            }
+        }
+    }
+
+    if (found == -1) {
+        void *pointer = GlobalAllocator_allocateLarge(self->global_allocator, rsize, page_size, 1);
+
+        GlobalAllocator_lockLarge(self->global_allocator);
+        ((Chunk *)pointer - 1)->io = 1;
+        GlobalAllocator_unlockLarge(self->global_allocator);
+        return pointer;
+    }
+
+    void *pointer = self->io_pool[found];
+    self->io_pool_size--;
+    memmove(self->io_pool + found, self->io_pool + found + 1, (size_t)(self->io_pool_size - found) * sizeof(void *));
+
+    if (GlobalAllocator_isMarking(self->global_allocator)) {
+        // allocate black (see GlobalAllocator_tryAllocateLargeUnlocked)
+        Chunk_mark((Chunk *)pointer - 1);
+    }
+    return pointer;
+}
+
+// Ignores pointers that aren't IO buffers, or that are already in the pool.
+void GC_LocalAllocator_freeIo(LocalAllocator *self, void *pointer) {
+    if (!GlobalAllocator_isIoBuffer(self->global_allocator, pointer)) return;
+
+    for (int i = 0; i < self->io_pool_size; i++) {
+        if (self->io_pool[i] == pointer) return;
+    }
+
+    if (self->io_pool_size == IO_POOL_SIZE) {
+        // release the oldest buffer
+        LocalAllocator_releasePages(self, self->io_pool[0]);
+        GlobalAllocator_deallocateLarge(self->global_allocator, self->io_pool[0]);
+        self->io_pool_size--;
+        memmove(self->io_pool, self->io_pool + 1, (size_t)self->io_pool_size * sizeof(void *));
+    }
+    self->io_pool[self->io_pool_size++] = pointer;
+}
+
+// The collector doesn't mark the pooled IO buffers: collections empty the pool
+// before they start marking, so the buffers are swept (unless a false pointer
+// retains them) after their pages were handed back to the kernel.
+void GC_LocalAllocator_releaseIoPool(LocalAllocator *self) {
+    for (int i = 0; i < self->io_pool_size; i++) {
+        LocalAllocator_releasePages(self, self->io_pool[i]);
     }
+    self->io_pool_size = 0;
 }
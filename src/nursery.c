@@ -0,0 +1,372 @@
+#define _GNU_SOURCE
+#include "config.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "immix.h"
+#include "nursery.h"
+#include "utils.h"
+
+// Finds the stack of the current thread. Nursery collections are disabled when
+// it can't be determined, unless the program tells the stack it switched to
+// (see GC_set_stackbottom).
+static void Nursery_findStack(Nursery *self) {
+    self->stack_start = NULL;
+    self->stack_stop = NULL;
+
+#if defined(__GLIBC__)
+    pthread_attr_t attr;
+    void *addr;
+    size_t size;
+
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+        if (pthread_attr_getstack(&attr, &addr, &size) == 0) {
+            self->stack_start = addr;
+            self->stack_stop = (char *)addr + size;
+        }
+        pthread_attr_destroy(&attr);
+    }
+#endif
+}
+
+void GC_Nursery_init(Nursery *self, GlobalAllocator *global_allocator, size_t size) {
+    self->global_allocator = global_allocator;
+    BlockList_clear(&self->blocks);
+    self->current = NULL;
+    self->block_limit = size / BLOCK_SIZE;
+
+    self->collections = 0;
+    self->nanoseconds = 0;
+    self->freed_bytes = 0;
+    self->published_bytes = 0;
+    self->released_blocks = 0;
+    self->stack_bottom = NULL;
+
+    if (!Nursery_isEnabled(self)) return;
+
+    pthread_mutex_init(&self->mutex, NULL);
+    Nursery_findStack(self);
+
+    // each object is pushed at most once (objects are at least as big as
+    // their header) plus the roots:
+    self->stack_capacity = self->block_limit * BLOCK_SIZE / sizeof(Object) + 16;
+    Stack_init(&self->stack, self->stack_capacity);
+}
+
+// Releases the nursery blocks into the shared heap: the objects they contain
+// are no longer local and will be collected by global collections.
+static void Nursery_release(Nursery *self) {
+    Block *block = self->blocks.first;
+
+    while (block != NULL) {
+        Block *next = block->next;
+        block->owner = NULL;
+        Block_setUnavailable(block);
+        block = next;
+    }
+
+    GlobalAllocator_incrementCollectCounter(self->global_allocator, self->blocks.size * BLOCK_SIZE);
+    self->released_blocks += self->blocks.size;
+
+    BlockList_clear(&self->blocks);
+    self->current = NULL;
+}
+
+void GC_Nursery_deinit(Nursery *self) {
+    if (!Nursery_isEnabled(self)) return;
+
+    Nursery_release(self);
+    munmap(self->stack.buffer, sizeof(void *) * self->stack_capacity * 2);
+    pthread_mutex_destroy(&self->mutex);
+}
+
+// A global collection released the nursery blocks into the shared heap. Must
+// be called before allocators sweep any block (lazy sweeping), so objects in
+// blocks that weren't swept yet aren't considered local.
+void GC_Nursery_reset(Nursery *self) {
+    for (Block *block = self->blocks.first; block != NULL; block = block->next) {
+        block->owner = NULL;
+    }
+    BlockList_clear(&self->blocks);
+    self->current = NULL;
+}
+
+static inline void Nursery_share(Nursery *self, Object *object) {
+    Object_setShared(object);
+    self->published_bytes += object->size;
+
+    if (!object->atomic) {
+        Stack_push(&self->stack, Object_mutatorAddress(object), (char *)object + object->size);
+    }
+}
+
+// Publishes the local objects referenced from the regions in the stack,
+// recursively.
+static void Nursery_drainPublish(Nursery *self) {
+    void *sp, *bottom;
+
+    while (Stack_pop(&self->stack, &sp, &bottom)) {
+        for (; sp < bottom; sp = (char *)sp + WORD_SIZE) {
+            void *pointer = *(void **)sp;
+            if (!Nursery_contains(self, pointer)) continue;
+
+            Object *object = Block_findObjectContaining(Block_from(pointer), pointer);
+            if (object != NULL && !Object_isShared(object)) {
+                Nursery_share(self, object);
+            }
+        }
+    }
+}
+
+static void Nursery_publishRegion(Nursery *self, void *start, void *stop) {
+    Stack_push(&self->stack, start, stop);
+    Nursery_drainPublish(self);
+}
+
+// The object escaped the thread (e.g. it's about to be referenced from
+// another thread): the object and the local objects it references, recursively,
+// won't be collected by nursery collections anymore.
+void GC_Nursery_publish(Nursery *self, Object *object) {
+    if (!Nursery_isLocal(self, object)) return;
+
+    Nursery_share(self, object);
+    Nursery_drainPublish(self);
+}
+
+// Write barrier: the object was modified, and it may be accessed by other
+// threads, unless it's a local object, so the local objects it references
+// escape.
+void GC_Nursery_publishReferences(Nursery *self, Object *object) {
+    if (self->blocks.size == 0) return;
+    if (object->atomic || Nursery_isLocal(self, object)) return;
+
+    Nursery_publishRegion(self, Object_mutatorAddress(object), (char *)object + Object_size(object));
+}
+
+static inline void Nursery_mark(Nursery *self, Block *block, Object *object) {
+    Object_mark(object);
+    Block_mark(block);
+    Block_markObjectLines(block, object, self->global_allocator->exact_line_marking);
+}
+
+// Calls the iterator for each object in the nursery.
+static inline void Nursery_eachObject(Nursery *self, void (*iterator)(Nursery *, Block *, Object *)) {
+    for (Block *block = self->blocks.first; block != NULL; block = block->next) {
+        for (int line_index = 0; line_index < LINE_COUNT; line_index++) {
+            char *line_header = Block_lineHeader(block, line_index);
+            if (!LineHeader_containsObject(line_header)) continue;
+
+            char *line = Block_line(block, line_index);
+            int offset = LineHeader_getOffset(line_header);
+
+            while (offset < LINE_SIZE) {
+                Object *object = (Object *)(line + offset);
+                if (object->size == 0) break;
+
+                iterator(self, block, object);
+                offset = offset + object->size;
+            }
+        }
+    }
+}
+
+static void Nursery_markShared(Nursery *self, Block *block, Object *object) {
+    if (Object_isShared(object)) {
+        Nursery_mark(self, block, object);
+    }
+}
+
+static void Nursery_unmarkObject(__attribute__((__unused__)) Nursery *self, __attribute__((__unused__)) Block *block, Object *object) {
+    Object_unmark(object);
+}
+
+// Marks the local objects reachable from the region, recursively.
+static void Nursery_markRegion(Nursery *self, void *start, void *stop) {
+    Stack_push(&self->stack, start, stop);
+
+    void *sp, *bottom;
+
+    while (Stack_pop(&self->stack, &sp, &bottom)) {
+        for (; sp < bottom; sp = (char *)sp + WORD_SIZE) {
+            void *pointer = *(void **)sp;
+            if (!Nursery_contains(self, pointer)) continue;
+
+            Block *block = Block_from(pointer);
+            Object *object = Block_findObjectContaining(block, pointer);
+
+            if (object != NULL && !Object_isMarked(object)) {
+                Nursery_mark(self, block, object);
+
+                if (!object->atomic) {
+                    Stack_push(&self->stack, Object_mutatorAddress(object), (char *)object + object->size);
+                }
+            }
+        }
+    }
+}
+
+// Recycles the nursery blocks (see GlobalAllocator_recycleBlocks) but keeps
+// them in the nursery. Returns how many bytes are free.
+static size_t Nursery_sweep(Nursery *self) {
+    size_t free_bytes = 0;
+    LineStats line_stats;
+    Block *block = self->blocks.first;
+
+    LineStats_clear(&line_stats);
+
+    while (block != NULL) {
+        Block *next = block->next;
+
+        if (!Block_isMarked(block)) {
+            Block_setFree(block);
+            block->owner = self;
+            block->next = next;
+            free_bytes += BLOCK_SIZE;
+        } else {
+            int first_free_line_index = Block_sweepLines(block, self->global_allocator->exact_line_marking, &line_stats);
+
+            if (first_free_line_index == INVALID_LINE_INDEX) {
+                Block_setUnavailable(block);
+            } else {
+                Block_setRecyclable(block, first_free_line_index);
+            }
+        }
+
+        block = next;
+    }
+
+    return free_bytes + line_stats.hole_lines * LINE_SIZE;
+}
+
+// Clears the marks, so nursery objects are always unmarked outside of nursery
+// collections, like any other young object.
+static void Nursery_unmark(Nursery *self) {
+    for (Block *block = self->blocks.first; block != NULL; block = block->next) {
+        Block_unmark(block);
+    }
+    Nursery_eachObject(self, Nursery_unmarkObject);
+
+    for (Block *block = self->blocks.first; block != NULL; block = block->next) {
+        char *line_headers = Block_lineHeaders(block);
+        for (int line_index = 0; line_index < LINE_COUNT; line_index++) {
+            LineHeader_unmark(line_headers + line_index);
+        }
+    }
+}
+
+// Collects the nursery: marks the local objects reachable from the roots and
+// the objects that escaped, then sweeps the nursery blocks. Returns true if the
+// collection freed enough memory.
+//
+// Must be called from a function that pushed the callee-saved registers on the
+// stack (see Nursery_nextBlock).
+static __attribute__((__noinline__)) int Nursery_collect(Nursery *self) {
+    char *sp = __builtin_frame_address(0);
+
+    // the collector is marking the HEAP: nursery objects may be marked, and we
+    // must not unmark them
+    if (GlobalAllocator_isMarking(self->global_allocator)) return 0;
+
+    // the thread stack, or the stack the thread switched to (e.g. a fiber)
+    char *bottom;
+    if (sp >= self->stack_start && sp < self->stack_stop) {
+        bottom = self->stack_stop;
+    } else if (sp < self->stack_bottom) {
+        bottom = self->stack_bottom;
+    } else {
+        // unknown stack
+        return 0;
+    }
+
+    DEBUG("GC: nursery collect start\n");
+    uint64_t start = GC_now();
+
+    // we scan the roots of global collections: no global collection can start
+    // (they lock the nurseries while holding GC_lock)
+    GC_lock();
+    Nursery_lock(self);
+
+    // marking started while we waited (see GC_collect_once), or we're
+    // allocating during a global collection (e.g. finalizers)
+    if (GlobalAllocator_isMarking(self->global_allocator) || GC_is_collecting()) {
+        Nursery_unlock(self);
+        GC_unlock();
+        return 0;
+    }
+
+    // 1. objects referenced from the DATA and BSS sections may be accessed by
+    //    any thread
+    Nursery_publishRegion(self, GC_DATA_START, GC_DATA_END);
+    Nursery_publishRegion(self, GC_BSS_START, GC_BSS_END);
+
+    // 2. objects that escaped are always reachable
+    Nursery_eachObject(self, Nursery_markShared);
+
+    // 3. mark local objects reachable from the current stack
+    Nursery_markRegion(self, sp, bottom);
+
+    // 4. mark local objects reachable from the other roots: the stacks of
+    //    suspended fibers, the extra roots and the pinned roots
+    Roots *roots = GC_nursery_roots();
+    for (Root *root = roots->buffer; root < roots->cursor; root++) {
+        Nursery_markRegion(self, root->top, root->bottom);
+    }
+    Roots_clear(roots);
+
+    // 5. recycle free lines, then forget marks
+    size_t free_bytes = Nursery_sweep(self);
+    Nursery_unmark(self);
+
+    Nursery_unlock(self);
+    GC_unlock();
+
+    self->collections++;
+    self->freed_bytes += free_bytes;
+    self->nanoseconds += GC_now() - start;
+    DEBUG("GC: nursery collect end free_bytes=%zu\n", free_bytes);
+
+    return free_bytes >= self->block_limit * BLOCK_SIZE / GC_NURSERY_MINIMUM_FREE_DIVISOR;
+}
+
+static Block *Nursery_acquireBlock(Nursery *self) {
+    // may run a global collection that resets the nursery
+    Block *block = GlobalAllocator_nextFreeBlock(self->global_allocator);
+
+    block->owner = self;
+    BlockList_push(&self->blocks, block);
+    return block;
+}
+
+Block *GC_Nursery_nextBlock(Nursery *self) {
+    while (1) {
+        // 1. blocks with free lines (after a nursery collection)
+        while (self->current != NULL) {
+            Block *block = self->current;
+            self->current = block->next;
+
+            if (Block_isFree(block) || Block_isRecyclable(block)) {
+                return block;
+            }
+        }
+
+        // 2. grow the nursery
+        if (self->blocks.size < self->block_limit) {
+            return Nursery_acquireBlock(self);
+        }
+
+        // 3. nursery is full: collect it (callee-saved registers may hold
+        //    pointers to local objects)
+        __builtin_unwind_init();
+
+        if (Nursery_collect(self)) {
+            self->current = self->blocks.first;
+            continue;
+        }
+
+        // 4. most objects survived: start a new nursery
+        Nursery_release(self);
+    }
+}
@@ -0,0 +1,137 @@
+#include "config.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "workers.h"
+#include "utils.h"
+
+typedef struct {
+    Workers *workers;
+    int index;
+} WorkerArgument;
+
+static Workers *GC_workers;
+
+static void *Workers_loop(void *data) {
+    WorkerArgument *argument = data;
+    Workers *self = argument->workers;
+    int index = argument->index;
+    size_t generation = 0;
+
+    free(argument);
+
+    pthread_mutex_lock(&self->mutex);
+
+    while (1) {
+        while (self->generation == generation) {
+            pthread_cond_wait(&self->start, &self->mutex);
+        }
+        generation = self->generation;
+
+        pthread_mutex_unlock(&self->mutex);
+        self->task(self->data, index);
+        pthread_mutex_lock(&self->mutex);
+
+        if (--self->pending == 0) {
+            pthread_cond_signal(&self->done);
+        }
+    }
+
+    return NULL;
+}
+
+static void Workers_start(Workers *self) {
+    // GC threads must never handle signals (the program may rely on signals
+    // being delivered to its own threads):
+    sigset_t set, previous;
+    sigfillset(&set);
+    pthread_sigmask(SIG_SETMASK, &set, &previous);
+
+    for (int index = 1; index < self->count; index++) {
+        WorkerArgument *argument = malloc(sizeof(WorkerArgument));
+        if (argument == NULL) {
+            fprintf(stderr, "GC: malloc failed\n");
+            abort();
+        }
+        argument->workers = self;
+        argument->index = index;
+
+        int err = pthread_create(self->threads + index, NULL, Workers_loop, argument);
+        if (err) {
+            fprintf(stderr, "GC: pthread_create failed: %s\n", strerror(err));
+            abort();
+        }
+    }
+
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    self->started = 1;
+}
+
+// Threads don't survive fork(2): the child process will start new threads if
+// it ever needs them.
+static void Workers_atforkChild() {
+    Workers *self = GC_workers;
+    pthread_mutex_init(&self->mutex, NULL);
+    pthread_cond_init(&self->start, NULL);
+    pthread_cond_init(&self->done, NULL);
+    self->generation = 0;
+    self->pending = 0;
+    self->started = 0;
+}
+
+void GC_Workers_init(Workers *self, int count) {
+    assert(count >= 1);
+
+    self->count = count;
+    self->started = 0;
+    self->threads = calloc(count, sizeof(pthread_t));
+    if (self->threads == NULL) {
+        fprintf(stderr, "GC: calloc failed\n");
+        abort();
+    }
+
+    pthread_mutex_init(&self->mutex, NULL);
+    pthread_cond_init(&self->start, NULL);
+    pthread_cond_init(&self->done, NULL);
+
+    self->task = NULL;
+    self->data = NULL;
+    self->generation = 0;
+    self->pending = 0;
+
+    if (count > 1) {
+        GC_workers = self;
+        pthread_atfork(NULL, NULL, Workers_atforkChild);
+    }
+}
+
+void GC_Workers_run(Workers *self, worker_task_t task, void *data) {
+    if (self->count == 1) {
+        task(data, 0);
+        return;
+    }
+
+    if (!self->started) {
+        Workers_start(self);
+    }
+
+    pthread_mutex_lock(&self->mutex);
+    self->task = task;
+    self->data = data;
+    self->pending = self->count - 1;
+    self->generation++;
+    pthread_cond_broadcast(&self->start);
+    pthread_mutex_unlock(&self->mutex);
+
+    task(data, 0);
+
+    pthread_mutex_lock(&self->mutex);
+    while (self->pending > 0) {
+        pthread_cond_wait(&self->done, &self->mutex);
+    }
+    pthread_mutex_unlock(&self->mutex);
+}
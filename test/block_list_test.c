@@ -98,8 +98,79 @@ TEST test_BlockList_shift() {
     PASS();
 }
 
+TEST test_BlockList_append() {
+    void *heap = GC_mapAndAlign(BLOCK_SIZE * 4, BLOCK_SIZE * 4);
+
+    BlockList list, other;
+    BlockList_clear(&list);
+    BlockList_clear(&other);
+
+    Block *block1 = (Block *)heap;
+    Block *block2 = (Block *)((char *)heap + BLOCK_SIZE);
+    Block *block3 = (Block *)((char *)heap + BLOCK_SIZE * 2);
+
+    // append to empty list
+    BlockList_push(&other, block1);
+    BlockList_append(&list, &other);
+    ASSERT_EQ(block1, list.first);
+    ASSERT_EQ(block1, list.last);
+    ASSERT_EQ(1, list.size);
+
+    // append empty list
+    BlockList_clear(&other);
+    BlockList_append(&list, &other);
+    ASSERT_EQ(1, list.size);
+
+    BlockList_push(&other, block2);
+    BlockList_push(&other, block3);
+    BlockList_append(&list, &other);
+    ASSERT_EQ(block1, list.first);
+    ASSERT_EQ(block3, list.last);
+    ASSERT_EQ(block2, block1->next);
+    ASSERT_EQ(3, list.size);
+
+    PASS();
+}
+
+TEST test_BlockList_removeNext() {
+    void *heap = GC_mapAndAlign(BLOCK_SIZE * 4, BLOCK_SIZE * 4);
+
+    BlockList list;
+    BlockList_clear(&list);
+
+    Block *block1 = (Block *)heap;
+    Block *block2 = (Block *)((char *)heap + BLOCK_SIZE);
+    Block *block3 = (Block *)((char *)heap + BLOCK_SIZE * 2);
+    BlockList_push(&list, block1);
+    BlockList_push(&list, block2);
+    BlockList_push(&list, block3);
+
+    // middle
+    ASSERT_EQ(block2, BlockList_removeNext(&list, block1));
+    ASSERT_EQ(block3, block1->next);
+    ASSERT_EQ(2, list.size);
+
+    // last
+    ASSERT_EQ(block3, BlockList_removeNext(&list, block1));
+    ASSERT_EQ(block1, list.last);
+    ASSERT_EQ(NULL, BlockList_removeNext(&list, block1));
+    ASSERT_EQ(1, list.size);
+
+    BlockList_push(&list, block2);
+    ASSERT_EQ(block2, block1->next);
+
+    // first
+    ASSERT_EQ(block1, BlockList_removeNext(&list, NULL));
+    ASSERT_EQ(block2, list.first);
+    ASSERT_EQ(1, list.size);
+
+    PASS();
+}
+
 SUITE(BlockListSuite) {
     RUN_TEST(test_BlockList_clear);
     RUN_TEST(test_BlockList_push);
     RUN_TEST(test_BlockList_shift);
+    RUN_TEST(test_BlockList_append);
+    RUN_TEST(test_BlockList_removeNext);
 }
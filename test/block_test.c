@@ -1,9 +1,16 @@
 #include "greatest.h"
 #include "block.h"
+#include "memory.h"
+
+// Returns the first block of a new region.
+static Block *test_Block_allocate() {
+    void *region = GC_mapAndAlign(REGION_SIZE, REGION_SIZE);
+    return Block_first(region);
+}
 
 TEST test_Block_init() {
-    Block *block = malloc(BLOCK_SIZE);
-    memset(block, 0xff, BLOCK_SIZE);
+    Block *block = test_Block_allocate();
+    memset(block, 0xff, sizeof(Block));
 
     Block_init(block);
 
@@ -16,14 +23,38 @@ TEST test_Block_init() {
         ASSERT_EQ_FMT(0, *Block_lineHeader(block, i), "%d");
     }
 
-    ASSERT_EQ((char *)block + LINE_SIZE, Block_start(block));
-    ASSERT_EQ((char *)block + BLOCK_SIZE, Block_stop(block));
+    ASSERT_EQ(Block_start(block) + BLOCK_SIZE, Block_stop(block));
+
+    PASS();
+}
+
+TEST test_Block_from() {
+    Block *block = test_Block_allocate();
+    char *region = (char *)block - REGION_METADATA_BLOCKS * sizeof(Block);
+
+    // the metadata of the region's blocks are at the start of the region
+    ASSERT_EQ(region + REGION_METADATA_BLOCKS * BLOCK_SIZE, Block_start(block));
+    ASSERT_EQ(block, Block_from(Block_start(block)));
+    ASSERT_EQ(block, Block_from(Block_stop(block) - 1));
+    ASSERT_EQ(block + 1, Block_from(Block_stop(block)));
+    ASSERT_EQ(Block_stop(block), Block_start(block + 1));
+
+    ASSERT(Block_isMetadata(Block_from(region)));
+    ASSERT_FALSE(Block_isMetadata(block));
+    ASSERT_EQ(block, Block_first(region));
+
+    // iterating skips the metadata of the next region
+    Block *last = (Block *)region + REGION_BLOCKS - 1;
+    ASSERT_EQ(last, Block_from(region + REGION_SIZE - 1));
+    ASSERT_EQ(Block_first(region + REGION_SIZE), Block_next(last));
+    ASSERT_EQ(region + REGION_SIZE + REGION_METADATA_BLOCKS * BLOCK_SIZE, Block_start(Block_next(last)));
+    ASSERT(Block_next(last) > Block_from(region + REGION_SIZE));
 
     PASS();
 }
 
 TEST test_Block_flags() {
-    Block *block = malloc(BLOCK_SIZE);
+    Block *block = test_Block_allocate();
 
     Block_setFlag(block, BLOCK_FLAG_FREE);
     ASSERT(Block_isFree(block));
@@ -44,7 +75,7 @@ TEST test_Block_flags() {
 }
 
 TEST test_Block_mark() {
-    Block *block = malloc(BLOCK_SIZE);
+    Block *block = test_Block_allocate();
 
     Block_mark(block);
     ASSERT(Block_isMarked(block));
@@ -56,43 +87,45 @@ TEST test_Block_mark() {
 }
 
 TEST test_Block_firstFreeLine() {
-    Block *block = malloc(BLOCK_SIZE);
+    Block *block = test_Block_allocate();
 
     Block_init(block);
-    ASSERT_EQ((char *)block + LINE_SIZE, Block_firstFreeLine(block));
+    ASSERT_EQ(Block_start(block), Block_firstFreeLine(block));
 
     block->first_free_line_index = 37;
-    ASSERT_EQ((char *)block + LINE_SIZE * 38, Block_firstFreeLine(block));
+    ASSERT_EQ(Block_start(block) + LINE_SIZE * 37, Block_firstFreeLine(block));
 
     PASS();
 }
 
 TEST test_Block_lineHeaders() {
-    Block *block = malloc(BLOCK_SIZE);
+    Block *block = test_Block_allocate();
     ASSERT_EQ(block->line_headers, Block_lineHeaders(block));
     PASS();
 }
 
 TEST test_Block_lineIndex() {
-    Block *block = malloc(BLOCK_SIZE);
+    Block *block = test_Block_allocate();
 
-    ASSERT_EQ(-1, Block_lineIndex(block, (char *)block));
+    char *metadata = Block_start(block) - BLOCK_SIZE;
+
+    ASSERT_EQ(-1, Block_lineIndex(Block_from(metadata), metadata + 53));
     ASSERT_EQ(-1, Block_lineIndex(block, Block_start(block) - WORD_SIZE));
     ASSERT_EQ(0, Block_lineIndex(block, Block_start(block) + 53));
-    ASSERT_EQ(125, Block_lineIndex(block, Block_start(block) + LINE_SIZE * 125 + 100));
-    ASSERT_EQ(126, Block_lineIndex(block, Block_start(block) + LINE_SIZE * 127 - WORD_SIZE));
+    ASSERT_EQ(LINE_COUNT - 3, Block_lineIndex(block, Block_start(block) + LINE_SIZE * (LINE_COUNT - 3) + LINE_SIZE / 2));
+    ASSERT_EQ(LINE_COUNT - 1, Block_lineIndex(block, Block_stop(block) - WORD_SIZE));
     PASS();
 }
 
 TEST test_Block_line() {
-    Block *block = malloc(BLOCK_SIZE);
+    Block *block = test_Block_allocate();
     ASSERT_EQ(Block_start(block), Block_line(block, 0));
-    ASSERT_EQ(Block_start(block) + LINE_SIZE * 125, Block_line(block, 125));
+    ASSERT_EQ(Block_start(block) + LINE_SIZE * (LINE_COUNT - 3), Block_line(block, LINE_COUNT - 3));
     PASS();
 }
 
 TEST test_Block_contains() {
-    Block *block = malloc(BLOCK_SIZE);
+    Block *block = test_Block_allocate();
     Block_init(block);
 
     ASSERT_FALSE(Block_contains(block, Block_start(block) - 1));
@@ -104,7 +137,7 @@ TEST test_Block_contains() {
 }
 
 TEST test_Line_update() {
-    Block *block = malloc(BLOCK_SIZE);
+    Block *block = test_Block_allocate();
     Block_init(block);
 
     Line_update(block, (void *)(Block_start(block)));
@@ -126,9 +159,188 @@ TEST test_Line_update() {
     PASS();
 }
 
+TEST test_Block_findObject() {
+    Block *block = test_Block_allocate();
+    Block_init(block);
+
+    // two objects in the first line, a medium object spanning the next lines:
+    char *start = Block_start(block);
+    Object *a = (Object *)start;
+    Object *b = (Object *)(start + 64);
+    Object *c = (Object *)(start + 128);
+    Object_allocate(a, 64, 0);
+    Object_allocate(b, 64, 0);
+    Object_allocate(c, LINE_SIZE * 2, 0);
+    ((Object *)(start + 128 + LINE_SIZE * 2))->size = 0;
+    Line_update(block, a);
+    Line_update(block, b);
+    Line_update(block, c);
+
+    ASSERT_EQ(a, Block_findObject(block, (char *)a));
+    ASSERT_EQ(b, Block_findObject(block, (char *)b));
+    ASSERT_EQ(c, Block_findObject(block, (char *)c));
+
+    // interior addresses
+    ASSERT_EQ(NULL, Block_findObject(block, (char *)a + WORD_SIZE));
+    ASSERT_EQ(NULL, Block_findObject(block, (char *)c + LINE_SIZE));
+
+    // end marker
+    ASSERT_EQ(NULL, Block_findObject(block, start + 128 + LINE_SIZE * 2));
+
+    // line without object / block metadata
+    ASSERT_EQ(NULL, Block_findObject(block, start + LINE_SIZE * 10));
+    ASSERT_EQ(NULL, Block_findObject(block, (char *)block));
+
+    PASS();
+}
+
+TEST test_Block_findObjectContaining() {
+    Block *block = test_Block_allocate();
+    Block_init(block);
+
+    // two objects in the first line, a medium object spanning the next lines:
+    char *start = Block_start(block);
+    Object *a = (Object *)start;
+    Object *b = (Object *)(start + 64);
+    Object *c = (Object *)(start + 128);
+    Object_allocate(a, 64, 0);
+    Object_allocate(b, 64, 0);
+    Object_allocate(c, LINE_SIZE * 2, 0);
+    ((Object *)(start + 128 + LINE_SIZE * 2))->size = 0;
+    Line_update(block, a);
+    Line_update(block, b);
+    Line_update(block, c);
+
+    // base and interior addresses
+    ASSERT_EQ(a, Block_findObjectContaining(block, Object_mutatorAddress(a)));
+    ASSERT_EQ(a, Block_findObjectContaining(block, (char *)a + 63));
+    ASSERT_EQ(b, Block_findObjectContaining(block, (char *)b + sizeof(Object) + WORD_SIZE));
+    ASSERT_EQ(c, Block_findObjectContaining(block, (char *)c + LINE_SIZE));
+    ASSERT_EQ(c, Block_findObjectContaining(block, (char *)c + LINE_SIZE * 2 - 1));
+
+    // object headers
+    ASSERT_EQ(NULL, Block_findObjectContaining(block, (char *)a));
+
+    // end marker, free lines, block metadata
+    ASSERT_EQ(NULL, Block_findObjectContaining(block, start + 128 + LINE_SIZE * 2));
+    ASSERT_EQ(NULL, Block_findObjectContaining(block, start + LINE_SIZE * 10));
+    ASSERT_EQ(NULL, Block_findObjectContaining(block, (char *)block));
+
+    PASS();
+}
+
+TEST test_Block_blacklist() {
+    Block *block = test_Block_allocate();
+    Block_init(block);
+
+    ASSERT_FALSE(Block_hasBlacklistedLines(block));
+
+    Block_blacklistLine(block, 0);
+    Block_blacklistLine(block, LINE_COUNT / 2 + 6);
+    Block_blacklistLine(block, LINE_COUNT - 1);
+    ASSERT(Block_hasBlacklistedLines(block));
+
+    for (int i = 0; i < LINE_COUNT; i++) {
+        int expected = i == 0 || i == LINE_COUNT / 2 + 6 || i == LINE_COUNT - 1;
+        ASSERT_EQ_FMT(expected, Block_isLineBlacklisted(block, i), "%d");
+    }
+
+    Block_clearBlacklist(block);
+    ASSERT_FALSE(Block_hasBlacklistedLines(block));
+    ASSERT_FALSE(Block_isLineBlacklisted(block, LINE_COUNT / 2 + 6));
+
+    PASS();
+}
+
+TEST test_Block_markObjectLines() {
+    Block *block = test_Block_allocate();
+    Block_init(block);
+
+    // small object: only marks the starting line
+    Object *small = (Object *)(Block_start(block) + LINE_SIZE - 32);
+    Object_allocate(small, 64, 0);
+    Block_markObjectLines(block, small, 0);
+    ASSERT(LineHeader_isMarked(Block_lineHeader(block, 0)));
+    ASSERT_FALSE(LineHeader_isMarked(Block_lineHeader(block, 1)));
+
+    // exact line marking: marks all the lines the small object touches
+    Block_markObjectLines(block, small, 1);
+    ASSERT(LineHeader_isMarked(Block_lineHeader(block, 1)));
+    LineHeader_unmark(Block_lineHeader(block, 1));
+
+    // medium object: marks all lines
+    Object *medium = (Object *)(Block_start(block) + LINE_SIZE * 2 + LINE_SIZE / 2);
+    Object_allocate(medium, LINE_SIZE * 2, 0);
+    Block_markObjectLines(block, medium, 0);
+    ASSERT(LineHeader_isMarked(Block_lineHeader(block, 2)));
+    ASSERT(LineHeader_isMarked(Block_lineHeader(block, 3)));
+    ASSERT(LineHeader_isMarked(Block_lineHeader(block, 4)));
+    ASSERT_FALSE(LineHeader_isMarked(Block_lineHeader(block, 5)));
+
+    PASS();
+}
+
+TEST test_Block_sweepLines() {
+    Block *block = test_Block_allocate();
+    Block_init(block);
+    LineStats stats;
+    LineStats_clear(&stats);
+
+    LineHeader_mark(Block_lineHeader(block, 0));
+    LineHeader_mark(Block_lineHeader(block, 1));
+    LineHeader_mark(Block_lineHeader(block, 10));
+
+    // skips a free line after a marked line (conservative marking)
+    ASSERT_EQ(3, Block_sweepLines(block, 0, &stats));
+    ASSERT_EQ(3, block->live_lines);
+    ASSERT_EQ(0, stats.blacklisted_lines);
+    ASSERT_EQ(1, stats.recyclable_blocks);
+    ASSERT_EQ(2, stats.holes);
+    ASSERT_EQ(LINE_COUNT - 5, stats.hole_lines);
+    ASSERT_EQ(2, stats.skipped_lines);
+    ASSERT_EQ(LINE_COUNT - 12, block->largest_hole);
+
+    // holes stop at the next marked line, or the end of the block
+    char *start, *limit;
+    int line_index = Block_nextHole(block, 0, &start, &limit);
+    ASSERT_EQ(10, line_index);
+    ASSERT_EQ(Block_line(block, 3), start);
+    ASSERT_EQ(Block_line(block, 10), limit);
+
+    line_index = Block_nextHole(block, line_index, &start, &limit);
+    ASSERT_EQ(LINE_COUNT, line_index);
+    ASSERT_EQ(Block_line(block, 12), start);
+    ASSERT_EQ(Block_stop(block), limit);
+
+    ASSERT_EQ(INVALID_LINE_INDEX, Block_nextHole(block, line_index, &start, &limit));
+
+    // exact line marking: doesn't skip free lines
+    LineHeader_mark(Block_lineHeader(block, 0));
+    LineHeader_mark(Block_lineHeader(block, 1));
+    LineHeader_mark(Block_lineHeader(block, 10));
+    ASSERT_EQ(2, Block_sweepLines(block, 1, &stats));
+    ASSERT_EQ(10, Block_nextHole(block, 0, &start, &limit));
+    ASSERT_EQ(Block_line(block, 2), start);
+
+    // but the hole starts after a (dead) object spanning into it
+    Object *object = (Object *)(Block_line(block, 1) + LINE_SIZE - 64);
+    object->size = 112;
+    LineHeader_setOffset(Block_lineHeader(block, 1), LINE_SIZE - 64);
+    ASSERT_EQ(10, Block_nextHole(block, 0, &start, &limit));
+    ASSERT_EQ(Block_line(block, 2) + 48, start);
+
+    // and the largest hole doesn't count the bytes of that object
+    LineHeader_mark(Block_lineHeader(block, 1));
+    LineHeader_unmark(Block_lineHeader(block, 10));
+    ASSERT_EQ(2, Block_sweepLines(block, 1, &stats));
+    ASSERT_EQ(LINE_COUNT - 3, block->largest_hole);
+
+    PASS();
+}
 
 SUITE(BlockSuite) {
     RUN_TEST(test_Block_init);
+    RUN_TEST(test_Block_from);
     RUN_TEST(test_Block_flags);
     RUN_TEST(test_Block_mark);
     RUN_TEST(test_Block_firstFreeLine);
@@ -137,4 +349,9 @@ SUITE(BlockSuite) {
     RUN_TEST(test_Block_line);
     RUN_TEST(test_Block_contains);
     RUN_TEST(test_Line_update);
+    RUN_TEST(test_Block_findObject);
+    RUN_TEST(test_Block_findObjectContaining);
+    RUN_TEST(test_Block_blacklist);
+    RUN_TEST(test_Block_markObjectLines);
+    RUN_TEST(test_Block_sweepLines);
 }
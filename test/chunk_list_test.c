@@ -10,7 +10,7 @@ TEST test_Chunk_init() {
 
     ASSERT_EQ(NULL, chunk.next);
     ASSERT_EQ(0, chunk.allocated);
-    ASSERT_EQ(123, chunk.object.size);
+    ASSERT_EQ(123, chunk.size);
 
     PASS();
 }
@@ -150,8 +150,8 @@ TEST test_ChunkList_split() {
     Chunk *chunk2 = ChunkList_split(&list, chunk1, 64);
     ASSERT_EQ((char *)chunk1 + CHUNK_HEADER_SIZE + 64, (char *)chunk2);
 
-    ASSERT_EQ_FMT((size_t)64, chunk1->object.size, "%zu");
-    ASSERT_EQ_FMT((size_t)960 - CHUNK_HEADER_SIZE * 2, chunk2->object.size, "%zu");
+    ASSERT_EQ_FMT((size_t)64, chunk1->size, "%zu");
+    ASSERT_EQ_FMT((size_t)960 - CHUNK_HEADER_SIZE * 2, chunk2->size, "%zu");
 
     // splits chunk2 into 2 parts:
     // [
@@ -162,9 +162,9 @@ TEST test_ChunkList_split() {
     Chunk *chunk3 = ChunkList_split(&list, chunk2, 512);
     ASSERT_EQ((char *)chunk2 + CHUNK_HEADER_SIZE + 512, (char *)chunk3);
 
-    ASSERT_EQ_FMT((size_t)64, chunk1->object.size, "%zu");
-    ASSERT_EQ_FMT((size_t)512, chunk2->object.size, "%zu");
-    ASSERT_EQ_FMT((size_t)448 - CHUNK_HEADER_SIZE * 3, chunk3->object.size, "%zu");
+    ASSERT_EQ_FMT((size_t)64, chunk1->size, "%zu");
+    ASSERT_EQ_FMT((size_t)512, chunk2->size, "%zu");
+    ASSERT_EQ_FMT((size_t)448 - CHUNK_HEADER_SIZE * 3, chunk3->size, "%zu");
 
     // splits chunk2 into 2 parts again:
     // [
@@ -177,20 +177,20 @@ TEST test_ChunkList_split() {
     ASSERT_EQ((char *)chunk2 + CHUNK_HEADER_SIZE + 64, (char *)chunk4);
 
     // can't split chunk4 (remaining space below minimum):
-    Chunk *chunk5 = ChunkList_split(&list, chunk4, chunk4->object.size - CHUNK_MIN_SIZE + sizeof(uintptr_t));
+    Chunk *chunk5 = ChunkList_split(&list, chunk4, chunk4->size - CHUNK_MIN_SIZE + sizeof(uintptr_t));
     ASSERT(chunk5 == NULL);
 
     // initialize mutator segments (makes sure sizes were fine, and we won't overwrite chunk metadata).
-    memset(Chunk_mutatorAddress(chunk1), 0x7f, chunk1->object.size - sizeof(Object));
-    memset(Chunk_mutatorAddress(chunk2), 0x7f, chunk2->object.size - sizeof(Object));
-    memset(Chunk_mutatorAddress(chunk4), 0x7f, chunk4->object.size - sizeof(Object));
-    memset(Chunk_mutatorAddress(chunk3), 0x7f, chunk3->object.size - sizeof(Object));
+    memset(Chunk_mutatorAddress(chunk1), 0x7f, chunk1->size - sizeof(Object));
+    memset(Chunk_mutatorAddress(chunk2), 0x7f, chunk2->size - sizeof(Object));
+    memset(Chunk_mutatorAddress(chunk4), 0x7f, chunk4->size - sizeof(Object));
+    memset(Chunk_mutatorAddress(chunk3), 0x7f, chunk3->size - sizeof(Object));
 
     // it sized chunks correctly:
-    ASSERT_EQ_FMT((size_t)64, chunk1->object.size, "%zu");
-    ASSERT_EQ_FMT((size_t)64, chunk2->object.size, "%zu");
-    ASSERT_EQ_FMT((size_t)448 - CHUNK_HEADER_SIZE, chunk4->object.size, "%zu");
-    ASSERT_EQ_FMT((size_t)448 - CHUNK_HEADER_SIZE * 3, chunk3->object.size, "%zu");
+    ASSERT_EQ_FMT((size_t)64, chunk1->size, "%zu");
+    ASSERT_EQ_FMT((size_t)64, chunk2->size, "%zu");
+    ASSERT_EQ_FMT((size_t)448 - CHUNK_HEADER_SIZE, chunk4->size, "%zu");
+    ASSERT_EQ_FMT((size_t)448 - CHUNK_HEADER_SIZE * 3, chunk3->size, "%zu");
 
     // it inserted chunks correctly:
     ASSERT_EQ((char *)chunk2, (char *)chunk1->next);
@@ -215,7 +215,7 @@ TEST test_ChunkList_split() {
     ASSERT_EQ(0, chunk3->object.atomic);
 
     // split chunk3:
-    chunk5 = ChunkList_split(&list, chunk3, chunk3->object.size - CHUNK_MIN_SIZE);
+    chunk5 = ChunkList_split(&list, chunk3, chunk3->size - CHUNK_MIN_SIZE);
 
     // ChunkList_debug(&list);
 
@@ -244,17 +244,17 @@ TEST test_ChunkList_merge() {
 
     ChunkList_merge(&list, chunk1, chunk3, 1);
     ASSERT_EQ(chunk3, chunk1->next);
-    ASSERT_EQ_FMT(256 - CHUNK_HEADER_SIZE, chunk1->object.size, "%zu");
+    ASSERT_EQ_FMT(256 - CHUNK_HEADER_SIZE, chunk1->size, "%zu");
     ASSERT_EQ_FMT((size_t)7, list.size, "%zu");
 
     ChunkList_merge(&list, chunk3, chunk6, 2);
     ASSERT_EQ(chunk6, chunk3->next);
-    ASSERT_EQ_FMT(384 - CHUNK_HEADER_SIZE, chunk3->object.size, "%zu");
+    ASSERT_EQ_FMT(384 - CHUNK_HEADER_SIZE, chunk3->size, "%zu");
     ASSERT_EQ_FMT((size_t)5, list.size, "%zu");
 
     ChunkList_merge(&list, chunk6, NULL, 2);
     ASSERT_EQ(NULL, chunk6->next);
-    ASSERT_EQ_FMT(384 - CHUNK_HEADER_SIZE, chunk6->object.size, "%zu");
+    ASSERT_EQ_FMT(384 - CHUNK_HEADER_SIZE, chunk6->size, "%zu");
     ASSERT_EQ_FMT((void *)chunk6, (void *)list.last, "%p");
     ASSERT_EQ_FMT((size_t)3, list.size, "%zu");
 
@@ -308,7 +308,7 @@ TEST test_ChunkList_sweep() {
     // merged chunks 1 and 2:
     ASSERT_FALSE(chunk1->allocated);
     ASSERT_EQ_FMT((void *)chunk3, (void *)chunk1->next, "%p");
-    ASSERT_EQ_FMT(256 - CHUNK_HEADER_SIZE, chunk1->object.size, "%zu");
+    ASSERT_EQ_FMT(256 - CHUNK_HEADER_SIZE, chunk1->size, "%zu");
 
     // kept chunks 3, 4 and 5:
     ASSERT(chunk3->allocated);
@@ -323,7 +323,7 @@ TEST test_ChunkList_sweep() {
     // merged chunks 6, 7 and 8:
     ASSERT_FALSE(chunk6->allocated);
     ASSERT_EQ_FMT(NULL, (void *)chunk6->next, "%p");
-    ASSERT_EQ_FMT(384 - CHUNK_HEADER_SIZE, chunk6->object.size, "%zu");
+    ASSERT_EQ_FMT(384 - CHUNK_HEADER_SIZE, chunk6->size, "%zu");
 
     // updated list:
     ASSERT_EQ_FMT((void *)chunk6, (void *)list.last, "%p");
@@ -332,6 +332,47 @@ TEST test_ChunkList_sweep() {
     PASS();
 }
 
+TEST test_ChunkList_sweepSome() {
+    char *heap = malloc(1024);
+
+    ChunkList list;
+    ChunkList_clear(&list);
+
+    size_t size = 128 - CHUNK_HEADER_SIZE;
+    Chunk *chunks[8];
+
+    for (int i = 0; i < 8; i++) {
+        chunks[i] = (Chunk *)(heap + i * 128);
+        Chunk_init(chunks[i], size);
+        ChunkList_push(&list, chunks[i]);
+        chunks[i]->allocated = 1;
+    }
+    Chunk_mark(chunks[2]);
+    Chunk_mark(chunks[4]);
+
+    // merges chunks 1 and 2, then stops on the next marked chunk:
+    ASSERT_EQ_FMT((void *)chunks[2], (void *)ChunkList_sweepSome(&list, list.first, 1), "%p");
+    ASSERT_FALSE(chunks[0]->allocated);
+    ASSERT_EQ_FMT((void *)chunks[2], (void *)chunks[0]->next, "%p");
+    ASSERT(chunks[3]->allocated);
+
+    // keeps chunk 3, frees chunk 4, stops on chunk 5:
+    ASSERT_EQ_FMT((void *)chunks[4], (void *)ChunkList_sweepSome(&list, chunks[2], 1), "%p");
+    ASSERT(chunks[2]->allocated);
+    ASSERT_FALSE(chunks[3]->allocated);
+    ASSERT(chunks[5]->allocated);
+
+    // merges chunks 6, 7 and 8, then reaches the end of the list:
+    ASSERT_EQ_FMT(NULL, (void *)ChunkList_sweepSome(&list, chunks[4], 1), "%p");
+    ASSERT_FALSE(chunks[5]->allocated);
+    ASSERT_EQ_FMT(384 - CHUNK_HEADER_SIZE, chunks[5]->size, "%zu");
+    ASSERT_EQ_FMT((void *)chunks[5], (void *)list.last, "%p");
+    ASSERT_EQ_FMT((size_t)5, list.size, "%zu");
+
+    free(heap);
+    PASS();
+}
+
 SUITE(ChunkListSuite) {
     RUN_TEST(test_ChunkList_clear);
     RUN_TEST(test_ChunkList_push);
@@ -341,4 +382,5 @@ SUITE(ChunkListSuite) {
     RUN_TEST(test_ChunkList_merge);
     RUN_TEST(test_ChunkList_find);
     RUN_TEST(test_ChunkList_sweep);
+    RUN_TEST(test_ChunkList_sweepSome);
 }
@@ -0,0 +1,660 @@
+#include "greatest.h"
+#include "test_heap.h"
+
+static void **test_Collector_stack;
+static size_t test_Collector_epoch;
+
+// A fiber stack (in the libc HEAP: not scanned unless registered).
+static void test_Collector_addStack() {
+    Collector_addCachedRoots(&test_heap->collector, test_Collector_stack, test_Collector_stack + 4, "fiber", test_Collector_epoch);
+}
+
+static StackRoots *test_Collector_stackRoots() {
+    return Hash_search(test_heap->collector.stack_roots, test_Collector_stack + 4);
+}
+
+TEST test_Collector_addCachedRoots_reuse() {
+    TestHeap *heap = TestHeap_get();
+    void *a = TestHeap_allocate(heap, 64);
+    void *b = TestHeap_allocate(heap, 64);
+
+    test_Collector_stack = calloc(4, sizeof(void *));
+    test_Collector_stack[1] = a;
+    test_Collector_epoch = 1;
+    Collector_registerCollectCallback(&heap->collector, test_Collector_addStack);
+
+    // scans the stack and records the HEAP pointers
+    TestHeap_collect(heap, NULL, NULL);
+    StackRoots *stack_roots = test_Collector_stackRoots();
+    ASSERT(stack_roots != NULL);
+    ASSERT_EQ(1, StackRoots_stop(stack_roots) - StackRoots_start(stack_roots));
+    ASSERT_EQ(a, StackRoots_start(stack_roots)[0]);
+    ASSERT(Object_isMarked((Object *)a - 1));
+
+    // same epoch: marks the recorded pointers (doesn't see the new pointer)
+    test_Collector_stack[2] = b;
+    TestHeap_collect(heap, NULL, NULL);
+    ASSERT_EQ(stack_roots, test_Collector_stackRoots());
+    ASSERT_EQ(1, StackRoots_stop(stack_roots) - StackRoots_start(stack_roots));
+    ASSERT(Object_isMarked((Object *)a - 1));
+    ASSERT_FALSE(Object_isMarked((Object *)b - 1));
+
+    // forgets stacks that aren't registered anymore (e.g. terminated fibers)
+    Collector_registerCollectCallback(&heap->collector, NULL);
+    TestHeap_collect(heap, NULL, NULL);
+    ASSERT_EQ(NULL, test_Collector_stackRoots());
+
+    free(test_Collector_stack);
+    PASS();
+}
+
+TEST test_Collector_addCachedRoots_epoch() {
+    TestHeap *heap = TestHeap_get();
+    void *a = TestHeap_allocate(heap, 64);
+    void *b = TestHeap_allocate(heap, 64);
+
+    test_Collector_stack = calloc(4, sizeof(void *));
+    test_Collector_stack[1] = a;
+    test_Collector_epoch = 1;
+    Collector_registerCollectCallback(&heap->collector, test_Collector_addStack);
+    TestHeap_collect(heap, NULL, NULL);
+
+    // stale epoch (the fiber was resumed): scans the stack again
+    test_Collector_stack[2] = b;
+    test_Collector_epoch = 2;
+    TestHeap_collect(heap, NULL, NULL);
+
+    StackRoots *stack_roots = test_Collector_stackRoots();
+    ASSERT_EQ(2, StackRoots_stop(stack_roots) - StackRoots_start(stack_roots));
+    ASSERT_EQ(b, StackRoots_start(stack_roots)[1]);
+    ASSERT(Object_isMarked((Object *)b - 1));
+
+    Collector_registerCollectCallback(&heap->collector, NULL);
+    TestHeap_collect(heap, NULL, NULL);
+    free(test_Collector_stack);
+    PASS();
+}
+
+// Nodes referencing each other (shared by the markers).
+#define TEST_COLLECTOR_SHARED 4096
+
+// Nodes only referenced by the array: more than a mark stack can hold.
+#define TEST_COLLECTOR_NODES (TEST_COLLECTOR_SHARED + MARK_STACK_CAPACITY + 1024)
+
+TEST test_Collector_mark_parallel() {
+    TestHeap *heap = TestHeap_get();
+    size_t count = TEST_COLLECTOR_NODES;
+    void ***nodes = malloc(sizeof(void **) * count);
+    void ***garbage = malloc(sizeof(void **) * 64);
+    void **roots = malloc(sizeof(void *) * TEST_HEAP_WORKERS);
+
+    // the worker scanning the array overflows its mark stack
+    void **array = LocalAllocator_allocateMedium(&heap->local_allocator, sizeof(void *) * count, 0);
+    size_t expected = Object_size((Object *)array - 1);
+
+    for (size_t i = 0; i < count; i++) {
+        nodes[i] = TestHeap_allocate(heap, sizeof(void *) * 2);
+        array[i] = nodes[i];
+        expected += Object_size((Object *)nodes[i] - 1);
+    }
+    for (size_t i = 0; i < count; i++) {
+        nodes[i][0] = nodes[(i * 7 + 1) % TEST_COLLECTOR_SHARED];
+        nodes[i][1] = nodes[(i * 13 + 5) % TEST_COLLECTOR_SHARED];
+    }
+    for (size_t i = 0; i < 64; i++) {
+        garbage[i] = TestHeap_allocate(heap, sizeof(void *) * 2);
+        garbage[i][0] = nodes[i];
+        garbage[i][1] = NULL;
+    }
+
+    // one region per worker
+    roots[0] = array;
+    Collector_addRoots(&heap->collector, roots, roots + 1, "test");
+    for (int i = 1; i < TEST_HEAP_WORKERS; i++) {
+        roots[i] = nodes[i * TEST_COLLECTOR_SHARED / TEST_HEAP_WORKERS];
+        Collector_addRoots(&heap->collector, roots + i, roots + i + 1, "test");
+    }
+    TestHeap_collect(heap, NULL, NULL);
+
+    ASSERT(Object_isMarked((Object *)array - 1));
+    for (size_t i = 0; i < count; i++) {
+        ASSERT(Object_isMarked((Object *)nodes[i] - 1));
+    }
+    for (size_t i = 0; i < 64; i++) {
+        ASSERT_FALSE(Object_isMarked((Object *)garbage[i] - 1));
+    }
+
+    // each object is marked (and counted) once; the DATA and BSS sections
+    // don't reference the test HEAP
+    ASSERT_EQ_FMT(expected, heap->collector.marked_bytes, "%zu");
+    ASSERT(Stack_isEmpty(&heap->collector.overflow_stack));
+
+    free(nodes);
+    free(garbage);
+    free(roots);
+    PASS();
+}
+
+TEST test_Collector_mark_baseOnly() {
+    TestHeap *heap = TestHeap_get();
+    void **roots = malloc(sizeof(void *) * 4);
+
+    void *small = TestHeap_allocate(heap, 64);
+    void *medium = LocalAllocator_allocateMedium(&heap->local_allocator, LARGE_OBJECT_SIZE * 2, 0);
+    void *object = TestHeap_allocate(heap, 64);
+    Object_setBaseOnly((Object *)small - 1);
+    Object_setBaseOnly((Object *)medium - 1);
+
+    // interior pointers don't retain base only objects (only other objects)
+    roots[0] = (char *)small + 16;
+    roots[1] = (char *)medium + 16;
+    roots[2] = (char *)object + 16;
+    roots[3] = NULL;
+    TestHeap_collect(heap, roots, roots + 4);
+    ASSERT_FALSE(Object_isMarked((Object *)small - 1));
+    ASSERT_FALSE(Object_isMarked((Object *)medium - 1));
+    ASSERT(Object_isMarked((Object *)object - 1));
+
+    // base pointers do
+    small = TestHeap_allocate(heap, 64);
+    medium = LocalAllocator_allocateMedium(&heap->local_allocator, LARGE_OBJECT_SIZE * 2, 0);
+    Object_setBaseOnly((Object *)small - 1);
+    Object_setBaseOnly((Object *)medium - 1);
+    roots[0] = small;
+    roots[1] = medium;
+    roots[2] = NULL;
+    TestHeap_collect(heap, roots, roots + 4);
+    ASSERT(Object_isMarked((Object *)small - 1));
+    ASSERT(Object_isMarked((Object *)medium - 1));
+
+    // disabled interior pointers: no object is retained by interior pointers
+    heap->collector.interior_pointers = 0;
+    object = TestHeap_allocate(heap, 64);
+    roots[0] = (char *)object + 16;
+    roots[1] = NULL;
+    TestHeap_collect(heap, roots, roots + 4);
+    ASSERT_FALSE(Object_isMarked((Object *)object - 1));
+
+    free(roots);
+    PASS();
+}
+
+static void *test_Collector_allocateZero(TestHeap *heap) {
+    void *pointer = TestHeap_allocate(heap, 64);
+    memset(pointer, 0, 64);
+    return pointer;
+}
+
+// Returns true if the line in the middle of the object is marked (the object
+// spans more than a line).
+static int test_Collector_isLineMarked(void *pointer) {
+    Block *block = Block_from(pointer);
+    int line_index = Block_lineIndex(block, (char *)pointer + LINE_SIZE);
+    return LineHeader_isMarked(Block_lineHeader(block, line_index));
+}
+
+TEST test_Collector_collect_minor() {
+    TestHeap *heap = TestHeap_get();
+    GlobalAllocator *global_allocator = &heap->global_allocator;
+    void ***roots = malloc(sizeof(void **) * 2);
+    global_allocator->generational = 1;
+
+    void **old = roots[0] = test_Collector_allocateZero(heap);
+    void *unreachable = roots[1] = TestHeap_allocate(heap, LINE_SIZE * 2);
+    memset(unreachable, 0, LINE_SIZE * 2);
+    TestHeap_collect(heap, roots, roots + 2);
+
+    void *young = TestHeap_allocate(heap, LINE_SIZE * 2);
+    void *referenced = TestHeap_allocate(heap, LINE_SIZE * 2);
+    memset(referenced, 0, LINE_SIZE * 2);
+    old[0] = referenced;
+    GlobalAllocator_writeBarrier(global_allocator, (Object *)old - 1);
+
+    // minor collection: the old objects stay marked (even unreachable ones),
+    // young objects are marked if reachable from the roots or from old objects
+    // recorded by the write barrier
+    roots[1] = NULL;
+    global_allocator->minor = 1;
+    TestHeap_collect(heap, roots, roots + 2);
+    ASSERT(Object_isMarked((Object *)old - 1));
+    ASSERT(Object_isMarked((Object *)unreachable - 1));
+    ASSERT(test_Collector_isLineMarked(unreachable));
+    ASSERT(Object_isMarked((Object *)referenced - 1));
+    ASSERT(test_Collector_isLineMarked(referenced));
+    ASSERT_FALSE(Object_isMarked((Object *)young - 1));
+    ASSERT_FALSE(test_Collector_isLineMarked(young));
+
+    // full collection: frees the unreachable old objects
+    TestHeap_collect(heap, roots, roots + 2);
+    ASSERT(Object_isMarked((Object *)old - 1));
+    ASSERT(Object_isMarked((Object *)referenced - 1));
+    ASSERT_FALSE(Object_isMarked((Object *)unreachable - 1));
+    ASSERT_FALSE(test_Collector_isLineMarked(unreachable));
+
+    free(roots);
+    PASS();
+}
+
+TEST test_Collector_findObject() {
+    TestHeap *heap = TestHeap_get();
+    GlobalAllocator *global_allocator = &heap->global_allocator;
+    char *small = TestHeap_allocate(heap, 64);
+    char *medium = LocalAllocator_allocateMedium(&heap->local_allocator, LARGE_OBJECT_SIZE * 2, 0);
+    char *large = GlobalAllocator_allocateLarge(global_allocator, MEDIUM_OBJECT_SIZE * 2, 0, 0);
+    char *pointers[] = {small, medium, large};
+
+    for (int i = 0; i < 3; i++) {
+        Object *object = (Object *)pointers[i] - 1;
+        ASSERT_EQ(object, GlobalAllocator_findObject(global_allocator, pointers[i], 0));
+        ASSERT_EQ(object, GlobalAllocator_findObject(global_allocator, pointers[i], 1));
+        ASSERT_EQ(object, GlobalAllocator_findObject(global_allocator, pointers[i] + 40, 1));
+        ASSERT_EQ(NULL, GlobalAllocator_findObject(global_allocator, pointers[i] + 40, 0));
+        ASSERT_EQ(NULL, GlobalAllocator_findObject(global_allocator, object, 1));
+    }
+    ASSERT_EQ(NULL, GlobalAllocator_findObject(global_allocator, pointers, 1));
+
+    // a free chunk
+    TestHeap_collect(heap, NULL, NULL);
+    GlobalAllocator_finishSweeping(global_allocator);
+    ASSERT_EQ(NULL, GlobalAllocator_findObject(global_allocator, large, 1));
+
+    PASS();
+}
+
+TEST test_Collector_rescanDirtyObjects() {
+    TestHeap *heap = TestHeap_get();
+    GlobalAllocator *global_allocator = &heap->global_allocator;
+    void ***roots = malloc(sizeof(void **) * 2);
+    global_allocator->generational = 1;
+
+    roots[0] = TestHeap_allocate(heap, 64);
+    roots[1] = LocalAllocator_allocateMedium(&heap->local_allocator, LARGE_OBJECT_SIZE * 2, 0);
+    memset(roots[0], 0, 64);
+    memset(roots[1], 0, LARGE_OBJECT_SIZE * 2);
+
+    // old objects (marked by a full collection)
+    TestHeap_collect(heap, roots, roots + 2);
+
+    for (int i = 0; i < 2; i++) {
+        void **old = roots[i];
+        void *young = TestHeap_allocate(heap, 64);
+        void *forgotten = TestHeap_allocate(heap, 64);
+        memset(young, 0, 64);
+        memset(forgotten, 0, 64);
+
+        // the barrier resolves the object from an interior pointer
+        old[1] = young;
+        Object *object = GlobalAllocator_findObject(global_allocator, old + 1, 1);
+        ASSERT_EQ((Object *)old - 1, object);
+        GlobalAllocator_writeBarrier(global_allocator, object);
+        ASSERT(Object_isDirty(object));
+
+        // not recorded by the barrier
+        void **other = roots[1 - i];
+        other[2] = forgotten;
+
+        // minor collection: old objects aren't scanned, unless dirty
+        global_allocator->minor = 1;
+        TestHeap_collect(heap, roots, roots + 2);
+        ASSERT(Object_isMarked((Object *)young - 1));
+        ASSERT_FALSE(Object_isMarked((Object *)forgotten - 1));
+        old[1] = other[2] = NULL;
+    }
+
+    free(roots);
+    PASS();
+}
+
+TEST test_Collector_startMarking_incremental() {
+    TestHeap *heap = TestHeap_get();
+    void ***roots = malloc(sizeof(void **));
+    void **a = test_Collector_allocateZero(heap);
+    void **b = test_Collector_allocateZero(heap);
+    void *white = test_Collector_allocateZero(heap);
+    a[0] = b;
+    b[0] = white;
+    roots[0] = a;
+
+    // scans the roots (marks a)
+    Collector_addRoots(&heap->collector, roots, roots + 1, "test");
+    Collector_startMarking(&heap->collector);
+    ASSERT(Collector_isMarking(&heap->collector));
+    ASSERT(Object_isMarked((Object *)a - 1));
+    ASSERT_FALSE(Object_isMarked((Object *)b - 1));
+
+    // objects allocated while marking are black
+    void *black = TestHeap_allocate(heap, 64);
+    ASSERT(Object_isMarked((Object *)black - 1));
+
+    // a single step scans a (marks b)
+    heap->collector.incremental_step = 1;
+    ASSERT(Collector_markStep(&heap->collector));
+    ASSERT(Object_isMarked((Object *)b - 1));
+    ASSERT_FALSE(Object_isMarked((Object *)white - 1));
+
+    // moves the reference from b (grey) to a (black)
+    a[1] = white;
+    b[0] = NULL;
+    GlobalAllocator_writeBarrier(&heap->global_allocator, (Object *)a - 1);
+
+    while (Collector_markStep(&heap->collector));
+    ASSERT_FALSE(Object_isMarked((Object *)white - 1));
+
+    // remark: rescans a
+    TestHeap_collect(heap, roots, roots + 1);
+    ASSERT_FALSE(Collector_isMarking(&heap->collector));
+    ASSERT(Object_isMarked((Object *)white - 1));
+
+    free(roots);
+    PASS();
+}
+
+#define TEST_COLLECTOR_CHAIN 1024
+
+TEST test_Collector_startMarking_concurrent() {
+    TestHeap *heap = TestHeap_get();
+    void ***roots = malloc(sizeof(void **));
+    heap->collector.concurrent = 1;
+
+    // a linked list
+    void **node = roots[0] = test_Collector_allocateZero(heap);
+    for (int i = 1; i < TEST_COLLECTOR_CHAIN; i++) {
+        node = node[0] = test_Collector_allocateZero(heap);
+    }
+
+    Collector_addRoots(&heap->collector, roots, roots + 1, "test");
+    Collector_startMarking(&heap->collector);
+    ASSERT(GlobalAllocator_isMarking(&heap->global_allocator));
+
+    // the background thread is marking
+    void *black = TestHeap_allocate(heap, 64);
+    ASSERT(Object_isMarked((Object *)black - 1));
+    while (Collector_markStep(&heap->collector));
+
+    node = roots[0];
+    for (int i = 0; i < TEST_COLLECTOR_CHAIN; i++) {
+        ASSERT(Object_isMarked((Object *)node - 1));
+        node = node[0];
+    }
+
+    TestHeap_collect(heap, roots, roots + 1);
+    ASSERT_FALSE(GlobalAllocator_isMarking(&heap->global_allocator));
+    ASSERT(Object_isMarked((Object *)roots[0] - 1));
+
+    free(roots);
+    PASS();
+}
+
+// Enough 64 bytes objects to fill 3 blocks (the object headers take more
+// room): the block of the object in the middle is full.
+#define TEST_COLLECTOR_OBJECTS ((int)(BLOCK_SIZE * 3 / 64))
+
+TEST test_Collector_evacuate() {
+    TestHeap *heap = TestHeap_get();
+    void ***objects = malloc(sizeof(void **) * TEST_COLLECTOR_OBJECTS);
+    void ***roots = malloc(sizeof(void **));
+
+    for (int i = 0; i < TEST_COLLECTOR_OBJECTS; i++) {
+        objects[i] = test_Collector_allocateZero(heap);
+        ((size_t *)objects[i])[1] = i;
+    }
+
+    // a few objects survive in a block: referenced from the roots, from
+    // another object and pinned
+    Block *block = Block_from(objects[TEST_COLLECTOR_OBJECTS / 2]);
+    void **rooted = NULL, **moved = NULL, **pinned = NULL;
+    for (int i = 0; i < TEST_COLLECTOR_OBJECTS; i++) {
+        if (Block_from(objects[i]) != block) continue;
+        if (rooted == NULL) rooted = objects[i];
+        else if (moved == NULL && i % 64 == 0) moved = objects[i];
+        else if (pinned == NULL && i % 64 == 32) pinned = objects[i];
+    }
+    ASSERT(moved != NULL && pinned != NULL);
+    roots[0] = rooted;
+    rooted[0] = moved;
+    Collector_pin(&heap->collector, pinned);
+
+    // the block is swept (few live lines), then evacuated
+    TestHeap_collect(heap, roots, roots + 1);
+    heap->global_allocator.evacuate = 1;
+    TestHeap_collect(heap, roots, roots + 1);
+    ASSERT(heap->collector.evacuated_objects > 0);
+
+    // the copy is referenced instead
+    ASSERT(rooted[0] != moved);
+    ASSERT(Block_from(rooted[0]) != block);
+    ASSERT(Object_isMarked((Object *)rooted[0] - 1));
+    ASSERT_EQ(((size_t *)moved)[1], ((size_t *)rooted[0])[1]);
+
+    // the others didn't move
+    ASSERT_EQ(rooted, roots[0]);
+    ASSERT(Object_isMarked((Object *)rooted - 1));
+    ASSERT(Object_isMarked((Object *)pinned - 1));
+    ASSERT_FALSE(Object_isForwarded((Object *)pinned - 1));
+
+    Collector_unpin(&heap->collector, pinned);
+    free(objects);
+    free(roots);
+    PASS();
+}
+
+// Fills 3 blocks with unreachable objects, but one: returns the block in the
+// middle (full), whose object is stored into the root.
+static Block *test_Collector_fillBlocks(TestHeap *heap, void ***root) {
+    void **middle = NULL;
+    for (size_t allocated = 0; allocated < BLOCK_SIZE * 3; allocated += sizeof(Object) + 64) {
+        void **object = test_Collector_allocateZero(heap);
+        if (middle == NULL && allocated >= BLOCK_SIZE * 3 / 2) middle = object;
+    }
+    *root = middle;
+    return Block_from(middle);
+}
+
+TEST test_Collector_sweep_lazy() {
+    TestHeap *heap = TestHeap_get();
+    GlobalAllocator *global_allocator = &heap->global_allocator;
+    void ***roots = malloc(sizeof(void **));
+    Block *block = test_Collector_fillBlocks(heap, roots);
+
+    // the collection doesn't sweep blocks (the local allocator swept the
+    // first blocks it needed)
+    TestHeap_collect(heap, roots, roots + 1);
+    ASSERT(GlobalAllocator_isSweeping(global_allocator));
+    ASSERT(global_allocator->sweep_cursor <= block);
+
+    // allocators sweep blocks one at a time until they get one
+    Block *next;
+    do {
+        next = GlobalAllocator_nextBlock(global_allocator, 64);
+        ASSERT(next < global_allocator->sweep_cursor);
+    } while (next != block && GlobalAllocator_isSweeping(global_allocator));
+    ASSERT_EQ(block, next);
+    ASSERT(Block_isRecyclable(block));
+    ASSERT_EQ(Block_next(block), global_allocator->sweep_cursor);
+
+    next = GlobalAllocator_nextFreeBlock(global_allocator);
+    ASSERT(Block_isFree(next));
+    ASSERT(next < global_allocator->sweep_cursor);
+    ASSERT(GlobalAllocator_isSweeping(global_allocator));
+
+    free(roots);
+    PASS();
+}
+
+TEST test_Collector_finishSweeping() {
+    TestHeap *heap = TestHeap_get();
+    GlobalAllocator *global_allocator = &heap->global_allocator;
+    void ***roots = malloc(sizeof(void **) * 2);
+    Block *block = test_Collector_fillBlocks(heap, roots);
+    roots[1] = GlobalAllocator_allocateLarge(global_allocator, LARGE_OBJECT_SIZE * 2, 0, 0);
+
+    // the large chunk list is swept concurrently
+    TestHeap_collect(heap, roots, roots + 2);
+    GlobalAllocator_startSweepingLarge(global_allocator);
+    ASSERT(global_allocator->sweep_cursor <= block);
+    ASSERT(global_allocator->large_sweep_cursor != NULL);
+
+    // the HEAP is swept with the previous marks before objects are unmarked
+    Collector_addRoots(&heap->collector, roots, roots + 2, "test");
+    Collector_startMarking(&heap->collector);
+    ASSERT_FALSE(GlobalAllocator_isSweeping(global_allocator));
+    ASSERT_EQ(NULL, global_allocator->large_sweep_cursor);
+    ASSERT(Block_isRecyclable(block));
+
+    TestHeap_collect(heap, roots, roots + 2);
+    ASSERT(Object_isMarked((Object *)roots[0] - 1));
+    ASSERT(Object_isMarked((Object *)roots[1] - 1));
+
+    free(roots);
+    PASS();
+}
+
+// Holes of at least 2^(RECYCLABLE_BUCKETS - 1) lines are in the last bucket:
+// objects rooted every TEST_COLLECTOR_HOLE_LINES lines leave holes that fall
+// in it, yet are smaller than 2 * TEST_COLLECTOR_HOLE_LINES lines.
+#define TEST_COLLECTOR_BUCKET_LINES (1 << (RECYCLABLE_BUCKETS - 1))
+#define TEST_COLLECTOR_HOLE_LINES (TEST_COLLECTOR_BUCKET_LINES + 4)
+
+// Same as GlobalAllocator_recyclableBucket.
+static int test_Collector_recyclableBucket(int lines) {
+    if (lines <= 1) return 0;
+    int bucket = 31 - __builtin_clz((unsigned)lines);
+    return bucket < RECYCLABLE_BUCKETS ? bucket : RECYCLABLE_BUCKETS - 1;
+}
+
+TEST test_Collector_shiftRecyclableBlock() {
+    TestHeap *heap = TestHeap_get();
+    GlobalAllocator *global_allocator = &heap->global_allocator;
+    void ***objects = malloc(sizeof(void **) * TEST_COLLECTOR_OBJECTS);
+    void ***roots = calloc(LINE_COUNT, sizeof(void **));
+    ASSERT(LINE_COUNT >= TEST_COLLECTOR_HOLE_LINES * 4);
+
+    for (int i = 0; i < TEST_COLLECTOR_OBJECTS; i++) {
+        objects[i] = test_Collector_allocateZero(heap);
+    }
+
+    // a block whose holes are smaller than TEST_COLLECTOR_HOLE_LINES lines
+    Block *block = Block_from(objects[TEST_COLLECTOR_OBJECTS / 2]);
+    int count = 0, line_index = -TEST_COLLECTOR_HOLE_LINES;
+    for (int i = 0; i < TEST_COLLECTOR_OBJECTS; i++) {
+        if (Block_from(objects[i]) != block) continue;
+        if (Block_lineIndex(block, objects[i]) < line_index + TEST_COLLECTOR_HOLE_LINES) continue;
+        line_index = Block_lineIndex(block, objects[i]);
+        roots[count++] = objects[i];
+    }
+    TestHeap_collect(heap, roots, roots + count);
+    ASSERT(block != heap->local_allocator.small.block);
+
+    // allocations of 2 * TEST_COLLECTOR_HOLE_LINES lines don't get the block,
+    // although it's in the bucket of the largest holes
+    int lines = TEST_COLLECTOR_HOLE_LINES * 2;
+    do {
+        Block *next = GlobalAllocator_nextBlock(global_allocator, lines * LINE_SIZE);
+        ASSERT(next != block);
+        ASSERT(Block_isFree(next) || next->largest_hole >= lines);
+    } while (global_allocator->sweep_cursor <= block);
+
+    ASSERT(Block_isRecyclable(block));
+    ASSERT(block->largest_hole >= TEST_COLLECTOR_BUCKET_LINES);
+    ASSERT(block->largest_hole < lines);
+
+    int bucket = test_Collector_recyclableBucket(block->largest_hole);
+    ASSERT_EQ(test_Collector_recyclableBucket(lines), bucket);
+    Block *listed = global_allocator->recyclable_lists[bucket].first;
+    while (listed != NULL && listed != block) listed = listed->next;
+    ASSERT_EQ(block, listed);
+
+    free(objects);
+    free(roots);
+    PASS();
+}
+
+TEST test_Collector_releaseIoPool() {
+    TestHeap *heap = TestHeap_get();
+    void *buffer = LocalAllocator_allocateIo(&heap->local_allocator, 1);
+    ASSERT(GlobalAllocator_isIoBuffer(&heap->global_allocator, buffer));
+
+    LocalAllocator_freeIo(&heap->local_allocator, buffer);
+    ASSERT_EQ(1, heap->local_allocator.io_pool_size);
+
+    // the pool is emptied before marking: the buffer is swept
+    TestHeap_collect(heap, NULL, NULL);
+    ASSERT_EQ(0, heap->local_allocator.io_pool_size);
+    ASSERT_FALSE(GlobalAllocator_isIoBuffer(&heap->global_allocator, buffer));
+
+    PASS();
+}
+
+TEST test_Collector_pin() {
+    TestHeap *heap = TestHeap_get();
+    Collector *collector = &heap->collector;
+    long count = Array_size(&collector->pinned_roots);
+    char *small = test_Collector_allocateZero(heap);
+    char *large = GlobalAllocator_allocateLarge(&heap->global_allocator, LARGE_OBJECT_SIZE * 2, 0, 0);
+
+    // only the base address of allocated objects
+    Collector_pin(collector, small + WORD_SIZE);
+    Collector_pin(collector, large + WORD_SIZE);
+    Collector_pin(collector, &count);
+    ASSERT_EQ(count, Array_size(&collector->pinned_roots));
+
+    Collector_pin(collector, small);
+    Collector_pin(collector, small);
+    Collector_pin(collector, large);
+    ASSERT_EQ(count + 3, Array_size(&collector->pinned_roots));
+    ASSERT(Object_isPinnedRoot((Object *)large - 1));
+
+    // freed objects lose all their pins
+    Collector_unpinAll(collector, small);
+    ASSERT_FALSE(Object_isPinnedRoot((Object *)small - 1));
+    ASSERT_EQ(count + 1, Array_size(&collector->pinned_roots));
+
+    Collector_unpin(collector, small);
+    ASSERT_EQ(count + 1, Array_size(&collector->pinned_roots));
+    Collector_unpin(collector, large);
+    ASSERT_FALSE(Object_isPinnedRoot((Object *)large - 1));
+    ASSERT_EQ(count, Array_size(&collector->pinned_roots));
+
+    PASS();
+}
+
+TEST test_LocalAllocator_deallocateSmall() {
+    TestHeap *heap = TestHeap_get();
+    char *object = test_Collector_allocateZero(heap);
+    test_Collector_allocateZero(heap);
+
+    // only base addresses
+    LocalAllocator_deallocateSmall(&heap->local_allocator, object + WORD_SIZE);
+    LocalAllocator_deallocateSmall(&heap->local_allocator, object - WORD_SIZE);
+    ASSERT_EQ(0, ((Object *)object - 1)->atomic);
+
+    // the object becomes a filler, left for the next collection
+    LocalAllocator_deallocateSmall(&heap->local_allocator, object);
+    ASSERT(Object_isFiller((Object *)object - 1));
+
+    // freeing it again is ignored
+    heap->global_allocator.allocated_bytes_since_collect = BLOCK_SIZE;
+    LocalAllocator_deallocateSmall(&heap->local_allocator, object);
+    ASSERT_EQ(BLOCK_SIZE, heap->global_allocator.allocated_bytes_since_collect);
+
+    PASS();
+}
+
+SUITE(CollectorSuite) {
+    RUN_TEST(test_Collector_addCachedRoots_reuse);
+    RUN_TEST(test_Collector_addCachedRoots_epoch);
+    RUN_TEST(test_Collector_mark_parallel);
+    RUN_TEST(test_Collector_mark_baseOnly);
+    RUN_TEST(test_Collector_collect_minor);
+    RUN_TEST(test_Collector_findObject);
+    RUN_TEST(test_Collector_rescanDirtyObjects);
+    RUN_TEST(test_Collector_startMarking_incremental);
+    RUN_TEST(test_Collector_startMarking_concurrent);
+    RUN_TEST(test_Collector_evacuate);
+    RUN_TEST(test_Collector_sweep_lazy);
+    RUN_TEST(test_Collector_finishSweeping);
+    RUN_TEST(test_Collector_shiftRecyclableBlock);
+    RUN_TEST(test_Collector_releaseIoPool);
+    RUN_TEST(test_Collector_pin);
+    RUN_TEST(test_LocalAllocator_deallocateSmall);
+}
@@ -4,6 +4,7 @@
 #include "constants.h"
 #include "chunk_list.h"
 #include "block_list.h"
+#include "medium_block.h"
 
 TEST test_GC_malloc_small() {
     void *small = GC_malloc(64);
@@ -13,13 +14,13 @@ TEST test_GC_malloc_small() {
 
     // initialized object
     Object *object = (Object *)((char *)small - sizeof(Object));
-    ASSERT_EQ_FMT(sizeof(Object) + 64, object->size, "%zu");
+    ASSERT_EQ_FMT(sizeof(Object) + 64, Object_size(object), "%zu");
     ASSERT_EQ_FMT(0, object->marked, "%d");
     ASSERT_EQ_FMT(0, object->atomic, "%d");
 
     // cleared next object size
     object = (Object *)((char *)small - sizeof(Object) + object->size);
-    ASSERT_EQ_FMT((size_t)0, object->size, "%zu");
+    ASSERT_EQ_FMT((size_t)0, Object_size(object), "%zu");
 
     PASS();
 }
@@ -33,15 +34,39 @@ TEST test_GC_malloc_small_max() {
 
     // initialized object
     Object *object = (Object *)((char *)small - sizeof(Object));
-    ASSERT_EQ_FMT(size + sizeof(Object), object->size, "%zu");
+    ASSERT_EQ_FMT(size + sizeof(Object), Object_size(object), "%zu");
     ASSERT_EQ_FMT(0, object->marked, "%d");
     ASSERT_EQ_FMT(0, object->atomic, "%d");
 
     PASS();
 }
 
+TEST test_GC_malloc_medium() {
+    void *medium = GC_malloc(LARGE_OBJECT_SIZE);
+
+    // allocated memory
+    ASSERT(medium != NULL);
+
+    // initialized object, at the start of a granule
+    Object *object = (Object *)((char *)medium - sizeof(Object));
+    ASSERT_EQ_FMT(sizeof(Object) + LARGE_OBJECT_SIZE, Object_size(object), "%zu");
+    ASSERT_EQ_FMT(0, object->marked, "%d");
+    ASSERT_EQ_FMT(0, object->atomic, "%d");
+    ASSERT_EQ_FMT((uintptr_t)0, (uintptr_t)object % MEDIUM_GRANULE_SIZE, "%lu");
+
+    // published object
+    MediumBlock *block = MediumBlock_from(medium);
+    ASSERT_EQ(object, MediumBlock_findObject(block, (char *)medium + LARGE_OBJECT_SIZE - 1));
+
+    // deallocated object
+    GC_free(medium);
+    ASSERT(MediumBlock_findObject(block, medium) != object);
+
+    PASS();
+}
+
 TEST test_GC_malloc_large() {
-    void *large = GC_malloc(LARGE_OBJECT_SIZE);
+    void *large = GC_malloc(MEDIUM_OBJECT_SIZE);
 
     // allocated memory
     ASSERT(large != NULL);
@@ -53,7 +78,7 @@ TEST test_GC_malloc_large() {
 
     // initialized object
     Object *object = (Object *)((char *)large - sizeof(Object));
-    ASSERT_EQ_FMT(sizeof(Object) + LARGE_OBJECT_SIZE, object->size, "%zu");
+    ASSERT_EQ_FMT(sizeof(Object) + MEDIUM_OBJECT_SIZE, Object_size(object), "%zu");
     ASSERT_EQ_FMT(0, object->marked, "%d");
     ASSERT_EQ_FMT(0, object->atomic, "%d");
 
@@ -68,19 +93,25 @@ TEST test_GC_malloc_atomic_small() {
 
     // initialized object
     Object *object = (Object *)((char *)small - sizeof(Object));
-    ASSERT_EQ_FMT(sizeof(Object) + 256, object->size, "%zu");
+    ASSERT_EQ_FMT(sizeof(Object) + 256, Object_size(object), "%zu");
     ASSERT_EQ_FMT(0, object->marked, "%d");
     ASSERT_EQ_FMT(1, object->atomic, "%d");
 
     // cleared next object size
     object = (Object *)((char *)small - sizeof(Object) + object->size);
-    ASSERT_EQ_FMT((size_t)0, object->size, "%zu");
+    ASSERT_EQ_FMT((size_t)0, Object_size(object), "%zu");
+
+    // segregated from objects that may contain pointers
+    void *other = GC_malloc(256);
+    ASSERT(Block_from(small) != Block_from(other));
+    ASSERT(Block_isAtomic(Block_from(small)));
+    ASSERT_FALSE(Block_isAtomic(Block_from(other)));
 
     PASS();
 }
 
 TEST test_GC_malloc_atomic_large() {
-    void *large = GC_malloc_atomic(LARGE_OBJECT_SIZE * 2);
+    void *large = GC_malloc_atomic(MEDIUM_OBJECT_SIZE * 2);
 
     // allocated memory
     ASSERT(large != NULL);
@@ -92,7 +123,7 @@ TEST test_GC_malloc_atomic_large() {
 
     // initialized object
     Object *object = (Object *)((char *)large - sizeof(Object));
-    ASSERT_EQ_FMT(sizeof(Object) + LARGE_OBJECT_SIZE * 2, object->size, "%zu");
+    ASSERT_EQ_FMT(sizeof(Object) + MEDIUM_OBJECT_SIZE * 2, Object_size(object), "%zu");
     ASSERT_EQ_FMT(0, object->marked, "%d");
     ASSERT_EQ_FMT(1, object->atomic, "%d");
 
@@ -105,7 +136,7 @@ TEST test_GC_realloc_small() {
     ASSERT(ptr1 != NULL);
 
     Object *obj = (Object *)((char *)ptr1 - sizeof(Object));
-    ASSERT_EQ_FMT(sizeof(Object) + 64, obj->size, "%zu");
+    ASSERT_EQ_FMT(sizeof(Object) + 64, Object_size(obj), "%zu");
     ASSERT_EQ(0, obj->atomic);
 
     // no resize: keep allocation
@@ -130,8 +161,8 @@ TEST test_GC_realloc_small() {
     void *ptr6 = GC_realloc(ptr5, 0);
     ASSERT(ptr6 == NULL);
 
-    obj = (Object *)((char *)ptr5 - sizeof(Object));
-    ASSERT_EQ_FMT(sizeof(Object) + 128, obj->size, "%zu");
+    // freed the last allocation: reuse the space
+    ASSERT_EQ(ptr5, GC_malloc(128));
 
     PASS();
 }
@@ -140,12 +171,154 @@ TEST test_GC_realloc_large() {
     SKIP();
 }
 
+TEST test_GC_memalign() {
+    size_t alignments[] = { 16, 64, LINE_SIZE, 4096 };
+
+    for (size_t i = 0; i < sizeof(alignments) / sizeof(size_t); i++) {
+        size_t alignment = alignments[i];
+
+        // unaligns the next small allocation
+        GC_malloc(8);
+
+        void *small = GC_memalign(alignment, 40);
+        ASSERT(small != NULL);
+        ASSERT_EQ_FMT((uintptr_t)0, (uintptr_t)small % alignment, "%lu");
+        ASSERT_EQ_FMT(0, ((Object *)small - 1)->atomic, "%d");
+
+        void *large = GC_memalign_atomic(alignment, LARGE_OBJECT_SIZE);
+        ASSERT(large != NULL);
+        ASSERT_EQ_FMT((uintptr_t)0, (uintptr_t)large % alignment, "%lu");
+        ASSERT_EQ_FMT(1, ((Object *)large - 1)->atomic, "%d");
+
+        // small objects are never evacuated (large objects never move)
+        if (alignment <= LINE_SIZE) {
+            ASSERT(Object_isAligned((Object *)small - 1));
+        }
+    }
+
+    PASS();
+}
+
+TEST test_GC_malloc_io() {
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+    void *buffer = GC_malloc_io(page_size + 1);
+    ASSERT(buffer != NULL);
+    ASSERT_EQ_FMT((uintptr_t)0, (uintptr_t)buffer % page_size, "%lu");
+    ASSERT_EQ_FMT(1, ((Object *)buffer - 1)->atomic, "%d");
+
+    // whole pages (the next chunk starts on the next page)
+    ASSERT_EQ_FMT(page_size * 2, Object_mutatorSize((Object *)buffer - 1), "%zu");
+
+    // recycles freed buffers (that fit)
+    GC_free_io(buffer);
+    ASSERT(GC_malloc_io(page_size * 4) != buffer);
+    ASSERT_EQ(buffer, GC_malloc_io(page_size * 2));
+
+    // only pools IO buffers, once
+    void *large = GC_malloc_atomic(page_size * 2);
+    GC_free_io(large);
+    GC_free_io((char *)buffer + page_size);
+    GC_free_io(buffer);
+    GC_free_io(buffer);
+    ASSERT_EQ(buffer, GC_malloc_io(page_size * 2));
+    void *other = GC_malloc_io(page_size * 2);
+    ASSERT(other != buffer && other != large);
+
+    PASS();
+}
+
+TEST test_GC_malloc_base_only() {
+    void *small = GC_malloc_base_only(64);
+    ASSERT(small != NULL);
+    ASSERT_EQ_FMT(1, Object_isBaseOnly((Object *)small - 1), "%d");
+    ASSERT_EQ_FMT(0, ((Object *)small - 1)->atomic, "%d");
+
+    void *atomic = GC_malloc_atomic_base_only(LARGE_OBJECT_SIZE);
+    ASSERT(atomic != NULL);
+    ASSERT_EQ_FMT(1, Object_isBaseOnly((Object *)atomic - 1), "%d");
+    ASSERT_EQ_FMT(1, ((Object *)atomic - 1)->atomic, "%d");
+
+    // keeps the policy when reallocating
+    void *larger = GC_realloc(small, 1024);
+    ASSERT_EQ_FMT(1, Object_isBaseOnly((Object *)larger - 1), "%d");
+
+    // regular allocations recognize interior pointers
+    void *regular = GC_malloc(64);
+    ASSERT_EQ_FMT(0, Object_isBaseOnly((Object *)regular - 1), "%d");
+
+    PASS();
+}
+
+TEST test_GC_write_barrier() {
+    void *small = GC_malloc(64);
+    void *large = GC_malloc(LARGE_OBJECT_SIZE);
+
+    // not marking: no-op
+    GC_write_barrier(small);
+    GC_write_barrier(large);
+    ASSERT_EQ_FMT(0, ((Object *)small - 1)->dirty, "%d");
+    ASSERT_EQ_FMT(0, ((Object *)large - 1)->dirty, "%d");
+
+    PASS();
+}
+
 TEST test_GC_collect() {
     SKIP();
 }
 
+TEST test_GC_collect_a_little() {
+    // takes the root snapshot through GC_collect, then objects are allocated
+    // black until the collection completes
+    ASSERT(GC_collect_a_little());
+    ASSERT(Object_isMarked((Object *)GC_malloc(64) - 1));
+
+    int steps = 0;
+    while (GC_collect_a_little()) {
+        ASSERT(steps++ < 100000);
+    }
+    ASSERT_FALSE(Object_isMarked((Object *)GC_malloc(64) - 1));
+
+    PASS();
+}
+
+TEST test_GC_pin() {
+    void **external = malloc(sizeof(void *));
+    *external = GC_malloc(64);
+    Object *object = (Object *)*external - 1;
+
+    // pins nest
+    GC_pin(*external);
+    GC_pin(*external);
+    GC_unpin(*external);
+    ASSERT(Object_isPinnedRoot(object));
+
+    // reachable from the pinned roots only
+    GC_collect_once();
+    ASSERT(Object_isMarked(object));
+
+    GC_unpin(*external);
+    ASSERT_FALSE(Object_isPinnedRoot(object));
+
+    GC_collect_once();
+    ASSERT_FALSE(Object_isMarked(object));
+
+    // freeing drops the pins (allocates another object so the freed object
+    // isn't the last allocation, that would be popped)
+    *external = GC_malloc(64);
+    object = (Object *)*external - 1;
+    GC_malloc(64);
+    GC_pin(*external);
+    GC_free(*external);
+    GC_collect_once();
+    ASSERT_FALSE(Object_isMarked(object));
+
+    free(external);
+    PASS();
+}
+
 TEST test_GC_free() {
-    void *pointer = GC_malloc_atomic(8192);
+    void *pointer = GC_malloc_atomic(MEDIUM_OBJECT_SIZE);
     ASSERT(pointer != NULL);
 
     Chunk *chunk = (Chunk *)((char *)pointer - sizeof(Chunk));
@@ -157,13 +330,74 @@ TEST test_GC_free() {
     ASSERT_EQ_FMT(0, chunk->allocated, "%d");
 
     // didn't touch object
-    ASSERT_EQ_FMT(sizeof(Object) + 8192, object->size, "%zu");
+    ASSERT_EQ_FMT(sizeof(Object) + MEDIUM_OBJECT_SIZE, Object_size(object), "%zu");
     ASSERT_EQ_FMT(0, object->marked, "%d");
     ASSERT_EQ_FMT(1, object->atomic, "%d");
 
     PASS();
 }
 
+TEST test_GC_free_small() {
+    void *first = GC_malloc(64);
+    void *second = GC_malloc(64);
+
+    // not the last allocation: filler (collected later)
+    GC_free(first);
+    ASSERT_EQ_FMT(sizeof(Object) + 64, Object_size((Object *)first - 1), "%zu");
+    ASSERT(Object_isFiller((Object *)first - 1));
+
+    // the last allocation: pop the cursor back
+    GC_free(second);
+    ASSERT_EQ_FMT((size_t)0, Object_size((Object *)second - 1), "%zu");
+    ASSERT_EQ(second, GC_malloc(32));
+
+    PASS();
+}
+
+static int test_GC_free_finalized;
+
+static void test_GC_free_finalize(__attribute__((__unused__)) void *pointer) {
+    test_GC_free_finalized++;
+}
+
+TEST test_GC_free_finalizer() {
+    void *pointers[3] = {
+        GC_malloc(64),
+        GC_malloc(LARGE_OBJECT_SIZE),
+        GC_malloc(MEDIUM_OBJECT_SIZE),
+    };
+    GC_malloc(64);
+    test_GC_free_finalized = 0;
+
+    // freeing drops the finalizers without calling them
+    for (int i = 0; i < 3; i++) {
+        GC_register_finalizer(pointers[i], test_GC_free_finalize);
+        GC_free(pointers[i]);
+        ASSERT_FALSE(Object_hasFinalizer((Object *)pointers[i] - 1));
+    }
+    GC_collect_once();
+    ASSERT_EQ(0, test_GC_free_finalized);
+
+    PASS();
+}
+
+TEST test_GC_get_heap_usage() {
+    GC_collect_once();
+    size_t usage = GC_get_heap_usage();
+
+    // the alignment padding isn't counted
+    GC_malloc(8);
+    void *aligned = GC_memalign(LINE_SIZE, 64);
+    ASSERT_EQ_FMT(usage + 8 + 64, GC_get_heap_usage(), "%zu");
+
+    // nor freed objects (not the last allocation: not popped)
+    GC_malloc(64);
+    GC_free(aligned);
+    ASSERT_EQ_FMT(usage + 8 + 64, GC_get_heap_usage(), "%zu");
+
+    PASS();
+}
+
 TEST test_grows_memory() {
     void *pointers[3];
     int i = 0;
@@ -182,12 +416,22 @@ TEST test_grows_memory() {
 SUITE(ImmixSuite) {
     RUN_TEST(test_GC_malloc_small);
     RUN_TEST(test_GC_malloc_small_max);
+    RUN_TEST(test_GC_malloc_medium);
     RUN_TEST(test_GC_malloc_large);
     RUN_TEST(test_GC_malloc_atomic_small);
     RUN_TEST(test_GC_malloc_atomic_large);
     RUN_TEST(test_GC_realloc_small);
     RUN_TEST(test_GC_realloc_large);
+    RUN_TEST(test_GC_memalign);
+    RUN_TEST(test_GC_malloc_io);
+    RUN_TEST(test_GC_malloc_base_only);
+    RUN_TEST(test_GC_write_barrier);
     RUN_TEST(test_GC_collect);
+    RUN_TEST(test_GC_collect_a_little);
+    RUN_TEST(test_GC_pin);
     RUN_TEST(test_GC_free);
+    RUN_TEST(test_GC_free_small);
+    RUN_TEST(test_GC_free_finalizer);
+    RUN_TEST(test_GC_get_heap_usage);
     RUN_TEST(test_grows_memory);
 }
@@ -35,17 +35,17 @@ TEST test_LineHeader_containsObject() {
 
 TEST test_LineHeader_mark() {
     char flag = 0;
-    LineHeader_setOffset(&flag, 248);
+    LineHeader_setOffset(&flag, LINE_SIZE - WORD_SIZE);
     LineHeader_mark(&flag);
 
     ASSERT(LineHeader_containsObject(&flag));
-    ASSERT_EQ(248, LineHeader_getOffset(&flag));
+    ASSERT_EQ(LINE_SIZE - WORD_SIZE, LineHeader_getOffset(&flag));
     ASSERT(LineHeader_isMarked(&flag));
 
     LineHeader_unmark(&flag);
 
     ASSERT(LineHeader_containsObject(&flag));
-    ASSERT_EQ(248, LineHeader_getOffset(&flag));
+    ASSERT_EQ(LINE_SIZE - WORD_SIZE, LineHeader_getOffset(&flag));
     ASSERT_FALSE(LineHeader_isMarked(&flag));
 
     PASS();
@@ -72,9 +72,24 @@ TEST test_LineHeader_clear() {
     PASS();
 }
 
+TEST test_LineHeader_publishOffset() {
+    char flag = 0;
+
+    // keeps the mark bit (e.g. set by a concurrent marker)
+    LineHeader_mark(&flag);
+    LineHeader_publishOffset(&flag, LINE_SIZE / 2);
+
+    ASSERT(LineHeader_containsObject(&flag));
+    ASSERT_EQ(LINE_SIZE / 2, LineHeader_getOffset(&flag));
+    ASSERT(LineHeader_isMarked(&flag));
+
+    PASS();
+}
+
 SUITE(LineHeaderSuite) {
     RUN_TEST(test_LineHeader_isMarked);
     RUN_TEST(test_LineHeader_containsObject);
     RUN_TEST(test_LineHeader_clear);
     RUN_TEST(test_LineHeader_mark);
+    RUN_TEST(test_LineHeader_publishOffset);
 }
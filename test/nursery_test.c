@@ -0,0 +1,154 @@
+#include "greatest.h"
+#include "immix.h"
+#include "test_heap.h"
+
+// A thread-local nursery allocating into the test HEAP.
+static LocalAllocator *test_Nursery_allocator;
+
+// A suspended fiber stack (in the libc HEAP: not scanned unless registered).
+static void **test_Nursery_stack;
+
+// DATA and BSS sections are scanned by nursery collections: objects
+// referenced from there escape the thread.
+static void *test_Nursery_global;
+
+static void test_Nursery_addStack() {
+    GC_add_roots(test_Nursery_stack, test_Nursery_stack + 4, "fiber");
+}
+
+static LocalAllocator *test_Nursery_get() {
+    TestHeap *heap = TestHeap_get();
+    test_Nursery_allocator = malloc(sizeof(LocalAllocator));
+    LocalAllocator_init(test_Nursery_allocator, &heap->global_allocator, BLOCK_SIZE * 2);
+    return test_Nursery_allocator;
+}
+
+static void test_Nursery_release(LocalAllocator *local_allocator) {
+    Nursery_deinit(&local_allocator->nursery);
+    free(local_allocator);
+}
+
+static void *test_Nursery_allocate(LocalAllocator *local_allocator, size_t size) {
+    void *pointer = LocalAllocator_allocateSmall(local_allocator, size, 0);
+    memset(pointer, 0, size);
+    return pointer;
+}
+
+// Allocates (and overwrites) garbage until the nursery has been collected
+// twice: the lines of any object freed by the first collection are reused.
+static void test_Nursery_fill(LocalAllocator *local_allocator) {
+    size_t collections = local_allocator->nursery.collections + 2;
+
+    while (local_allocator->nursery.collections < collections) {
+        memset(LocalAllocator_allocateSmall(local_allocator, 64, 0), 0xff, 64);
+    }
+}
+
+TEST test_Nursery_collect_survival() {
+    LocalAllocator *local_allocator = test_Nursery_get();
+    ASSERT(Nursery_isEnabled(&local_allocator->nursery));
+
+    // local objects only referenced from another stack (e.g. a suspended
+    // fiber) and from a local object
+    test_Nursery_stack = calloc(4, sizeof(void *));
+    void **object = test_Nursery_stack[1] = test_Nursery_allocate(local_allocator, 64);
+    object[0] = test_Nursery_allocate(local_allocator, 64);
+    ((size_t *)object)[1] = 0x1234;
+    ((size_t *)object[0])[1] = 0x5678;
+    object = NULL;
+    GC_register_collect_callback(test_Nursery_addStack);
+
+    test_Nursery_fill(local_allocator);
+
+    object = test_Nursery_stack[1];
+    ASSERT(Nursery_contains(&local_allocator->nursery, object));
+    ASSERT_EQ_FMT((size_t)0x1234, ((size_t *)object)[1], "%zx");
+    ASSERT_EQ_FMT((size_t)0x5678, ((size_t *)object[0])[1], "%zx");
+
+    GC_register_collect_callback(NULL);
+    free(test_Nursery_stack);
+    test_Nursery_release(local_allocator);
+    PASS();
+}
+
+TEST test_Nursery_collect_stackBottom() {
+    LocalAllocator *local_allocator = test_Nursery_get();
+    Nursery *nursery = &local_allocator->nursery;
+
+    // running on a stack that isn't the thread stack (e.g. a fiber): the
+    // nursery collects the stack the program switched to
+    nursery->stack_start = NULL;
+    nursery->stack_stop = NULL;
+    nursery->stack_bottom = __builtin_frame_address(0);
+
+    void **volatile object = test_Nursery_allocate(local_allocator, 64);
+    ((size_t *)object)[1] = 0x1234;
+
+    test_Nursery_fill(local_allocator);
+
+    ASSERT(Nursery_contains(nursery, object));
+    ASSERT_EQ_FMT((size_t)0x1234, ((size_t *)object)[1], "%zx");
+
+    test_Nursery_release(local_allocator);
+    PASS();
+}
+
+TEST test_Nursery_publishReferences() {
+    LocalAllocator *local_allocator = test_Nursery_get();
+    Nursery *nursery = &local_allocator->nursery;
+
+    void **local = test_Nursery_allocate(local_allocator, 64);
+    void **referenced = test_Nursery_allocate(local_allocator, 64);
+    void *other = test_Nursery_allocate(local_allocator, 64);
+    local[0] = referenced;
+    ASSERT(Nursery_isLocal(nursery, (Object *)local - 1));
+
+    // storing into a local object doesn't publish anything
+    Nursery_publishReferences(nursery, (Object *)local - 1);
+    ASSERT(Nursery_isLocal(nursery, (Object *)referenced - 1));
+
+    // storing into a shared object (e.g. allocated by another thread)
+    // publishes the local objects it references, recursively
+    void **shared = TestHeap_allocate(test_heap, 64);
+    memset(shared, 0, 64);
+    shared[0] = local;
+    Nursery_publishReferences(nursery, (Object *)shared - 1);
+    ASSERT(Object_isShared((Object *)local - 1));
+    ASSERT(Object_isShared((Object *)referenced - 1));
+    ASSERT(Nursery_isLocal(nursery, (Object *)other - 1));
+
+    test_Nursery_release(local_allocator);
+    PASS();
+}
+
+TEST test_Nursery_collect_escape() {
+    LocalAllocator *local_allocator = test_Nursery_get();
+    Nursery *nursery = &local_allocator->nursery;
+
+    void **object = test_Nursery_allocate(local_allocator, 64);
+    object[0] = test_Nursery_allocate(local_allocator, 64);
+    ((size_t *)object[0])[1] = 0x1234;
+    test_Nursery_global = object;
+    object = NULL;
+
+    // referenced from the BSS section: escapes on the next collection (and
+    // survives the following ones)
+    test_Nursery_fill(local_allocator);
+
+    object = test_Nursery_global;
+    ASSERT(Object_isShared((Object *)object - 1));
+    ASSERT(Object_isShared((Object *)object[0] - 1));
+    ASSERT_FALSE(Nursery_isLocal(nursery, (Object *)object[0] - 1));
+    ASSERT_EQ_FMT((size_t)0x1234, ((size_t *)object[0])[1], "%zx");
+
+    test_Nursery_global = NULL;
+    test_Nursery_release(local_allocator);
+    PASS();
+}
+
+SUITE(NurserySuite) {
+    RUN_TEST(test_Nursery_collect_survival);
+    RUN_TEST(test_Nursery_collect_stackBottom);
+    RUN_TEST(test_Nursery_publishReferences);
+    RUN_TEST(test_Nursery_collect_escape);
+}
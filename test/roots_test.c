@@ -0,0 +1,127 @@
+#include "greatest.h"
+#include "roots.h"
+#include "root_sources.h"
+
+TEST test_Roots_push_claim() {
+    Roots roots;
+    Roots_init(&roots, 16);
+    ASSERT(Roots_isEmpty(&roots));
+
+    int a, b, c, d;
+    Roots_push(&roots, &a, &b, "fiber", NULL);
+    Roots_push(&roots, &c, &d, ".bss", NULL);
+    ASSERT_EQ(2, Roots_size(&roots));
+
+    Root *root = Roots_claim(&roots);
+    ASSERT_EQ((void *)&a, root->top);
+    ASSERT_EQ((void *)&b, root->bottom);
+    ASSERT_EQ(NULL, root->stack_roots);
+
+    root = Roots_claim(&roots);
+    ASSERT_EQ((void *)&c, root->top);
+    ASSERT_EQ((void *)&d, root->bottom);
+
+    // all regions have been claimed:
+    ASSERT_EQ(NULL, Roots_claim(&roots));
+    ASSERT_EQ(NULL, Roots_claim(&roots));
+
+    // clear resets claims:
+    Roots_clear(&roots);
+    ASSERT(Roots_isEmpty(&roots));
+    Roots_push(&roots, &a, &b, "fiber", NULL);
+    ASSERT_EQ(roots.buffer, Roots_claim(&roots));
+
+    free(roots.buffer);
+    PASS();
+}
+
+TEST test_Roots_push_grows() {
+    Roots roots;
+    Roots_init(&roots, 2);
+
+    int a[5];
+    for (int i = 0; i < 5; i++) {
+        Roots_push(&roots, &a[i], &a[i] + 1, "fiber", NULL);
+    }
+    ASSERT_EQ(5, Roots_size(&roots));
+
+    for (int i = 0; i < 5; i++) {
+        ASSERT_EQ((void *)&a[i], Roots_claim(&roots)->top);
+    }
+    ASSERT_EQ(NULL, Roots_claim(&roots));
+
+    free(roots.buffer);
+    PASS();
+}
+
+TEST test_RootSources_add() {
+    RootSources sources;
+    RootSources_clear(&sources);
+
+    char name[] = "fiber";
+    RootSources_add(&sources, "fiber", 1, 100, 10);
+    RootSources_add(&sources, ".bss", 1, 300, 5);
+    RootSources_add(&sources, name, 2, 50, 20);
+    ASSERT_EQ(2, sources.size);
+
+    // aggregated by name (not by pointer):
+    RootSource *entry = RootSources_find(&sources, "fiber");
+    ASSERT_EQ_FMT((size_t)3, entry->count, "%zu");
+    ASSERT_EQ_FMT((size_t)150, entry->bytes, "%zu");
+    ASSERT_EQ(30, entry->nanoseconds);
+
+    PASS();
+}
+
+TEST test_RootSources_merge() {
+    RootSources sources, other;
+    RootSources_clear(&sources);
+    RootSources_clear(&other);
+
+    RootSources_add(&sources, "fiber", 1, 100, 10);
+    RootSources_add(&other, "fiber", 1, 100, 10);
+    RootSources_add(&other, ".data", 1, 8, 1);
+    RootSources_merge(&sources, &other);
+
+    ASSERT_EQ(2, sources.size);
+    ASSERT_EQ_FMT((size_t)2, RootSources_find(&sources, "fiber")->count, "%zu");
+    ASSERT_EQ_FMT((size_t)8, RootSources_find(&sources, ".data")->bytes, "%zu");
+
+    PASS();
+}
+
+TEST test_RootSources_overflow() {
+    RootSources sources;
+    RootSources_clear(&sources);
+
+    char names[ROOT_SOURCES_MAX + 4][8];
+    for (int i = 0; i < ROOT_SOURCES_MAX + 4; i++) {
+        snprintf(names[i], 8, "s%d", i);
+        RootSources_add(&sources, names[i], 1, 1, 1);
+    }
+    ASSERT_EQ(ROOT_SOURCES_MAX - 1, sources.size);
+    ASSERT_EQ(0, strcmp(names[ROOT_SOURCES_MAX - 2], sources.entries[ROOT_SOURCES_MAX - 2].name));
+
+    // the sources that didn't fit are aggregated into the reserved entry
+    RootSource *other = RootSources_other(&sources);
+    ASSERT_EQ(0, strcmp("other", other->name));
+    ASSERT_EQ_FMT((size_t)5, other->count, "%zu");
+    ASSERT_EQ(other, RootSources_find(&sources, "other"));
+
+    // and merged as such
+    RootSources merged;
+    RootSources_clear(&merged);
+    RootSources_merge(&merged, &sources);
+    ASSERT_EQ(ROOT_SOURCES_MAX - 1, merged.size);
+    ASSERT_EQ_FMT((size_t)5, RootSources_other(&merged)->count, "%zu");
+
+    PASS();
+}
+
+SUITE(RootsSuite) {
+    RUN_TEST(test_Roots_push_claim);
+    RUN_TEST(test_Roots_push_grows);
+    RUN_TEST(test_RootSources_add);
+    RUN_TEST(test_RootSources_merge);
+    RUN_TEST(test_RootSources_overflow);
+}
@@ -11,6 +11,10 @@
 #include "block_test.c"
 #include "block_list_test.c"
 #include "stack_test.c"
+#include "stack_roots_test.c"
+#include "roots_test.c"
+#include "collector_test.c"
+#include "nursery_test.c"
 #include "immix_test.c"
 #include "array_test.c"
 #include "hash_test.c"
@@ -73,9 +77,15 @@ int main(int argc, char *argv[]) {
         RUN_SUITE(BlockSuite);
         RUN_SUITE(BlockListSuite);
         RUN_SUITE(StackSuite);
+        RUN_SUITE(StackRootsSuite);
+        RUN_SUITE(RootsSuite);
         RUN_SUITE(HashSuite);
         RUN_SUITE(ArraySuite);
 
+        // collector (on a test HEAP)
+        RUN_SUITE(CollectorSuite);
+        RUN_SUITE(NurserySuite);
+
         // public api
         RUN_SUITE(ImmixSuite);
     });
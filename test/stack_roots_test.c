@@ -0,0 +1,62 @@
+#include "greatest.h"
+#include "stack_roots.h"
+
+TEST test_StackRoots_create() {
+    int top;
+    StackRoots *stack_roots = StackRoots_create(&top, 12, 4096);
+
+    ASSERT_EQ(&top, stack_roots->top);
+    ASSERT_EQ_FMT((size_t)12, stack_roots->epoch, "%zu");
+    ASSERT_EQ_FMT((size_t)4096, stack_roots->heap_size, "%zu");
+    ASSERT_EQ(0, stack_roots->seen);
+    ASSERT_EQ(StackRoots_start(stack_roots), StackRoots_stop(stack_roots));
+
+    StackRoots_free(stack_roots);
+    PASS();
+}
+
+TEST test_StackRoots_isValid() {
+    int top, other;
+    StackRoots *stack_roots = StackRoots_create(&top, 12, 4096);
+
+    ASSERT(StackRoots_isValid(stack_roots, &top, 12, 4096));
+
+    // fiber was resumed:
+    ASSERT_FALSE(StackRoots_isValid(stack_roots, &top, 13, 4096));
+
+    // stack top moved:
+    ASSERT_FALSE(StackRoots_isValid(stack_roots, &other, 12, 4096));
+
+    // heap grew (more values may be pointers to the HEAP):
+    ASSERT_FALSE(StackRoots_isValid(stack_roots, &top, 12, 8192));
+
+    StackRoots_free(stack_roots);
+    PASS();
+}
+
+TEST test_StackRoots_record() {
+    int top, a, b;
+    StackRoots *stack_roots = StackRoots_create(&top, 1, 4096);
+
+    StackRoots_record(stack_roots, &a);
+    StackRoots_record(stack_roots, &b);
+
+    void **start = StackRoots_start(stack_roots);
+    ASSERT_EQ(2, StackRoots_stop(stack_roots) - start);
+    ASSERT_EQ((void *)&a, start[0]);
+    ASSERT_EQ((void *)&b, start[1]);
+
+    // reset forgets recorded pointers:
+    StackRoots_reset(stack_roots, &top, 2, 4096);
+    ASSERT_EQ(StackRoots_start(stack_roots), StackRoots_stop(stack_roots));
+    ASSERT(StackRoots_isValid(stack_roots, &top, 2, 4096));
+
+    StackRoots_free(stack_roots);
+    PASS();
+}
+
+SUITE(StackRootsSuite) {
+    RUN_TEST(test_StackRoots_create);
+    RUN_TEST(test_StackRoots_isValid);
+    RUN_TEST(test_StackRoots_record);
+}
@@ -76,8 +76,40 @@ TEST test_Stack_grows_limitless() {
     PASS();
 }
 
+TEST test_Stack_transfer() {
+    Stack stack, other;
+    Stack_init(&stack, 4);
+    Stack_init(&other, 2);
+
+    int a[4];
+    for (int i = 0; i < 4; i++) {
+        Stack_push(&stack, &a[i], &a[i] + 1);
+    }
+    ASSERT(Stack_isFull(&stack));
+
+    // moves the top regions, as many as the other stack can hold:
+    ASSERT_EQ(2, Stack_transfer(&stack, &other, 3));
+    ASSERT_EQ(2, Stack_size(&stack));
+    ASSERT(Stack_isFull(&other));
+
+    void *sp;
+    void *bottom;
+    ASSERT(Stack_pop(&other, &sp, &bottom));
+    ASSERT_EQ_FMT((void *)&a[3], sp, "%p");
+    ASSERT(Stack_pop(&other, &sp, &bottom));
+    ASSERT_EQ_FMT((void *)&a[2], sp, "%p");
+
+    // as many as the stack has:
+    ASSERT_EQ(2, Stack_transfer(&stack, &other, 3));
+    ASSERT(Stack_isEmpty(&stack));
+    ASSERT_EQ(0, Stack_transfer(&stack, &other, 3));
+
+    PASS();
+}
+
 SUITE(StackSuite) {
     RUN_TEST(test_Stack_init);
     RUN_TEST(test_Stack_push_pop);
     RUN_TEST(test_Stack_grows_limitless);
+    RUN_TEST(test_Stack_transfer);
 }
@@ -0,0 +1,75 @@
+#ifndef GC_TEST_HEAP_H
+#define GC_TEST_HEAP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "collector.h"
+#include "local_allocator.h"
+#include "options.h"
+
+// Number of GC workers of the test HEAP (so parallel marking is exercised).
+#define TEST_HEAP_WORKERS 4
+
+// A HEAP of its own for the tests that drive the collector (e.g. a minor
+// collection or an evacuation), whatever the options of the HEAP initialized
+// by GC_init. Tests decide what's reachable: the stack is never scanned, the
+// only roots are the DATA and BSS sections (as always) and the regions passed
+// to TestHeap_collect.
+//
+// The HEAP is allocated into the libc HEAP (see GC_init) and shared by all the
+// tests: TestHeap_get collects everything and resets the options.
+typedef struct {
+    GlobalAllocator global_allocator;
+    Collector collector;
+    LocalAllocator local_allocator;
+} TestHeap;
+
+static TestHeap *test_heap;
+
+// Runs a collection (see GC_collect_once), scanning the [start, stop) region
+// in addition to the DATA and BSS sections.
+static void TestHeap_collect(TestHeap *self, void *start, void *stop) {
+    if (start != NULL) {
+        Collector_addRoots(&self->collector, start, stop, "test");
+    }
+    LocalAllocator_releaseIoPool(&self->local_allocator);
+    Collector_setCollecting(&self->collector, 1);
+    Collector_collect(&self->collector);
+    LocalAllocator_reset(&self->local_allocator);
+    Collector_setCollecting(&self->collector, 0);
+}
+
+static TestHeap *TestHeap_get() {
+    if (test_heap == NULL) {
+        test_heap = malloc(sizeof(TestHeap));
+        if (test_heap == NULL) {
+            fprintf(stderr, "malloc failed\n");
+            abort();
+        }
+        GlobalAllocator_init(&test_heap->global_allocator, GC_INITIAL_HEAP_SIZE);
+        Collector_init(&test_heap->collector, &test_heap->global_allocator, TEST_HEAP_WORKERS, 1, 0);
+        LocalAllocator_init(&test_heap->local_allocator, &test_heap->global_allocator, 0);
+    }
+    GlobalAllocator *global_allocator = &test_heap->global_allocator;
+
+    // deterministic sweeps: no background thread
+    global_allocator->concurrent_sweep = 0;
+    global_allocator->lazy_sweep = 1;
+    global_allocator->incremental = 0;
+    global_allocator->generational = 0;
+    global_allocator->minor = 0;
+    global_allocator->evacuate = 0;
+    global_allocator->exact_line_marking = 0;
+    test_heap->collector.interior_pointers = 1;
+    test_heap->collector.concurrent = 0;
+    test_heap->collector.incremental_step = GC_INCREMENTAL_STEP;
+
+    TestHeap_collect(test_heap, NULL, NULL);
+    return test_heap;
+}
+
+static inline void *TestHeap_allocate(TestHeap *self, size_t size) {
+    return LocalAllocator_allocateSmall(&self->local_allocator, size, 0);
+}
+
+#endif